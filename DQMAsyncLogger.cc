@@ -0,0 +1,253 @@
+/*
+ *
+ * DQMAsyncLogger.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMAsyncLogger.h"
+
+// -- std headers
+#include <sstream>
+
+namespace dqm4hep
+{
+
+DQMAsyncLogger *DQMAsyncLogger::instance()
+{
+	// function local static : thread safe init, flushed at exit
+	static DQMAsyncLogger logger;
+	return &logger;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMAsyncLogger::DQMAsyncLogger() :
+	m_pRing(new Cell[RING_SIZE]),
+	m_writePosition(0),
+	m_readPosition(0),
+	m_nDroppedRecords(0),
+	m_stopFlag(false),
+	m_sleeping(false)
+{
+	for(unsigned int i=0 ; i<RING_SIZE ; i++)
+		m_pRing[i].m_sequence.store(i, std::memory_order_relaxed);
+
+	m_thread = std::thread(&DQMAsyncLogger::run, this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMAsyncLogger::~DQMAsyncLogger()
+{
+	m_stopFlag = true;
+	this->wakeUp();
+
+	if(m_thread.joinable())
+		m_thread.join();
+
+	this->flush();
+
+	delete [] m_pRing;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMAsyncLogger::getNDroppedRecords() const
+{
+	return m_nDroppedRecords.load(std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMAsyncLogger::flush()
+{
+	DQMLogRecord record;
+
+	while(this->pop(record))
+		this->output(record);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMAsyncLogger::push(const DQMLogRecord &record)
+{
+	uint64_t position = m_writePosition.load(std::memory_order_relaxed);
+
+	while(1)
+	{
+		Cell &cell = m_pRing[position & (RING_SIZE-1)];
+		uint64_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+		int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+
+		if(0 == diff)
+		{
+			if(m_writePosition.compare_exchange_weak(position, position+1, std::memory_order_relaxed))
+			{
+				cell.m_record = record;
+				cell.m_sequence.store(position+1, std::memory_order_release);
+
+				// pairs with the fence in run() : either we see the consumer
+				// sleeping, or it sees our record before waiting
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+
+				if(m_sleeping.load(std::memory_order_relaxed))
+					this->wakeUp();
+
+				return true;
+			}
+		}
+		else if(diff < 0)
+		{
+			// ring full, never wait on the hot path
+			m_nDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+			position = m_writePosition.load(std::memory_order_relaxed);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMAsyncLogger::pop(DQMLogRecord &record)
+{
+	Cell &cell = m_pRing[m_readPosition & (RING_SIZE-1)];
+	uint64_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+
+	if(sequence != m_readPosition+1)
+		return false;
+
+	record = cell.m_record;
+	cell.m_sequence.store(m_readPosition+RING_SIZE, std::memory_order_release);
+	m_readPosition++;
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMAsyncLogger::hasPending() const
+{
+	const Cell &cell = m_pRing[m_readPosition & (RING_SIZE-1)];
+	return cell.m_sequence.load(std::memory_order_acquire) == m_readPosition+1;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMAsyncLogger::wakeUp()
+{
+	std::lock_guard<std::mutex> lock(m_wakeMutex);
+	m_wakeCondition.notify_one();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMAsyncLogger::output(const DQMLogRecord &record) const
+{
+	std::stringstream message;
+	const char *pFormat = record.m_pFormat;
+	unsigned int argIndex = 0;
+
+	while(*pFormat)
+	{
+		if('{' == pFormat[0] && '}' == pFormat[1] && argIndex < record.m_nArgs)
+		{
+			const DQMLogRecord::Arg &arg = record.m_args[argIndex];
+
+			switch(record.m_argTypes[argIndex])
+			{
+			case DQMLogRecord::INT_ARG: message << arg.m_int; break;
+			case DQMLogRecord::UINT_ARG: message << arg.m_uint; break;
+			case DQMLogRecord::DOUBLE_ARG: message << arg.m_double; break;
+			}
+
+			argIndex++;
+			pFormat += 2;
+			continue;
+		}
+
+		message << *pFormat;
+		pFormat++;
+	}
+
+	record.m_pLogger->forcedLog(log4cxx::Level::toLevel(record.m_level), message.str());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMAsyncLogger::run()
+{
+	DQMLogRecord record;
+	uint64_t nReportedDrops = 0;
+
+	while(!m_stopFlag)
+	{
+		while(this->pop(record))
+			this->output(record);
+
+		uint64_t nDrops = this->getNDroppedRecords();
+
+		if(nDrops != nReportedDrops)
+		{
+			LOG4CXX_WARN( dqmMainLogger , "Async logger : " << nDrops - nReportedDrops << " record(s) dropped (ring full)" );
+			nReportedDrops = nDrops;
+		}
+
+		// sleep until the next push. The timeout is only a safety net
+		// against a missed notification
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if(!m_stopFlag && !this->hasPending())
+			m_wakeCondition.wait_for(lock, std::chrono::milliseconds(100));
+
+		m_sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMLogRateLimiter::DQMLogRateLimiter(unsigned int maxPerSecond) :
+	m_maxPerSecond(maxPerSecond),
+	m_currentSecond(0),
+	m_count(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMLogRateLimiter::allow()
+{
+	int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t currentSecond = m_currentSecond.load(std::memory_order_relaxed);
+
+	if(second != currentSecond && m_currentSecond.compare_exchange_strong(currentSecond, second))
+		m_count.store(0, std::memory_order_relaxed);
+
+	return m_count.fetch_add(1, std::memory_order_relaxed) < m_maxPerSecond;
+}
+
+}
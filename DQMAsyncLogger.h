@@ -0,0 +1,301 @@
+/*
+ *
+ * DQMAsyncLogger.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMASYNCLOGGER_H
+#define DQMASYNCLOGGER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <cstdint>
+
+namespace dqm4hep
+{
+
+/** DQMLogRecord struct
+ *
+ *  Binary log record as written by the hot path. The format string
+ *  must be a literal : only its address is stored. Arguments are
+ *  numbers only, formatted in place of the "{}" markers.
+ */
+struct DQMLogRecord
+{
+	static const unsigned int MAX_ARGS = 4;
+
+	enum ArgType : uint8_t
+	{
+		INT_ARG,
+		UINT_ARG,
+		DOUBLE_ARG
+	};
+
+	union Arg
+	{
+		int64_t       m_int;
+		uint64_t      m_uint;
+		double        m_double;
+	};
+
+	log4cxx::Logger         *m_pLogger;        ///< The target logger
+	const char              *m_pFormat;        ///< The format literal
+	int                      m_level;          ///< The log4cxx level (toInt())
+	uint8_t                  m_nArgs;          ///< The number of arguments
+	ArgType                  m_argTypes[MAX_ARGS];  ///< The argument types
+	Arg                      m_args[MAX_ARGS];      ///< The argument values
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMAsyncLogger class
+ *
+ *  Hot path logging facade. Records are pushed in a bounded lock-free
+ *  ring (multi producers, single consumer) and formatted/forwarded to
+ *  log4cxx by a background thread. Pushing never blocks : if the ring
+ *  is full the record is dropped and counted. The background thread
+ *  sleeps when the ring is empty and is woken up by the next push.
+ */
+class DQMAsyncLogger
+{
+public:
+	/** Get the logger instance. The background thread is started on first call
+	 */
+	static DQMAsyncLogger *instance();
+
+	/** Destructor. Flush the pending records and stop the background thread
+	 */
+	~DQMAsyncLogger();
+
+	/** Push a record. Return false if the ring was full
+	 */
+	template <typename ...Args>
+	bool log(log4cxx::Logger *pLogger, const log4cxx::LevelPtr &level, const char *pFormat, Args... args);
+
+	/** Get the number of records dropped because the ring was full
+	 */
+	uint64_t getNDroppedRecords() const;
+
+	/** Format and output all pending records, from the caller thread
+	 */
+	void flush();
+
+private:
+	/** Constructor
+	 */
+	DQMAsyncLogger();
+
+	/** Push a filled record in the ring
+	 */
+	bool push(const DQMLogRecord &record);
+
+	/** Pop a record from the ring. Single consumer only
+	 */
+	bool pop(DQMLogRecord &record);
+
+	/** Whether a record is ready to be popped. Single consumer only
+	 */
+	bool hasPending() const;
+
+	/** Wake up the background thread if it is waiting for records
+	 */
+	void wakeUp();
+
+	/** Format and output a record
+	 */
+	void output(const DQMLogRecord &record) const;
+
+	/** The background thread loop
+	 */
+	void run();
+
+	template <typename T>
+	static void setArg(DQMLogRecord &record, unsigned int index, T value,
+			typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type * = 0);
+
+	template <typename T>
+	static void setArg(DQMLogRecord &record, unsigned int index, T value,
+			typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type * = 0);
+
+	template <typename T>
+	static void setArg(DQMLogRecord &record, unsigned int index, T value,
+			typename std::enable_if<std::is_floating_point<T>::value>::type * = 0);
+
+	static void setArgs(DQMLogRecord &record, unsigned int index);
+
+	template <typename T, typename ...Args>
+	static void setArgs(DQMLogRecord &record, unsigned int index, T value, Args... args);
+
+private:
+	static const unsigned int RING_SIZE = 8192;    ///< Must be a power of 2
+
+	struct Cell
+	{
+		std::atomic<uint64_t>     m_sequence;
+		DQMLogRecord              m_record;
+	};
+
+	Cell                         *m_pRing;
+	alignas(64) std::atomic<uint64_t>   m_writePosition;
+	alignas(64) uint64_t                m_readPosition;
+	alignas(64) std::atomic<uint64_t>   m_nDroppedRecords;
+	std::atomic<bool>             m_stopFlag;
+	std::atomic<bool>             m_sleeping;
+	std::mutex                    m_wakeMutex;
+	std::condition_variable       m_wakeCondition;
+	std::thread                   m_thread;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename ...Args>
+inline bool DQMAsyncLogger::log(log4cxx::Logger *pLogger, const log4cxx::LevelPtr &level, const char *pFormat, Args... args)
+{
+	static_assert(sizeof...(Args) <= DQMLogRecord::MAX_ARGS, "DQMAsyncLogger : too many arguments");
+
+	DQMLogRecord record;
+	record.m_pLogger = pLogger;
+	record.m_pFormat = pFormat;
+	record.m_level = level->toInt();
+	record.m_nArgs = sizeof...(Args);
+	setArgs(record, 0, args...);
+
+	return this->push(record);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline void DQMAsyncLogger::setArg(DQMLogRecord &record, unsigned int index, T value,
+		typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type *)
+{
+	record.m_argTypes[index] = DQMLogRecord::INT_ARG;
+	record.m_args[index].m_int = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline void DQMAsyncLogger::setArg(DQMLogRecord &record, unsigned int index, T value,
+		typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type *)
+{
+	record.m_argTypes[index] = DQMLogRecord::UINT_ARG;
+	record.m_args[index].m_uint = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline void DQMAsyncLogger::setArg(DQMLogRecord &record, unsigned int index, T value,
+		typename std::enable_if<std::is_floating_point<T>::value>::type *)
+{
+	record.m_argTypes[index] = DQMLogRecord::DOUBLE_ARG;
+	record.m_args[index].m_double = value;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+inline void DQMAsyncLogger::setArgs(DQMLogRecord &/*record*/, unsigned int /*index*/)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T, typename ...Args>
+inline void DQMAsyncLogger::setArgs(DQMLogRecord &record, unsigned int index, T value, Args... args)
+{
+	setArg(record, index, value);
+	setArgs(record, index+1, args...);
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMLogRateLimiter class
+ *
+ *  Token bucket allowing at most n records per second, used by
+ *  the rate limited log macros. Lock free.
+ */
+class DQMLogRateLimiter
+{
+public:
+	/** Constructor
+	 */
+	DQMLogRateLimiter(unsigned int maxPerSecond);
+
+	/** Whether a record can be emitted now
+	 */
+	bool allow();
+
+private:
+	const unsigned int            m_maxPerSecond;
+	std::atomic<int64_t>          m_currentSecond;
+	std::atomic<unsigned int>     m_count;
+};
+
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Hot path log macros. The level is checked before anything is
+ *  recorded, so a disabled level costs a single comparison.
+ */
+#define DQM_ASYNC_LOG( logger , level , ... ) \
+	do { \
+		if( logger->isEnabledFor( level ) ) \
+			dqm4hep::DQMAsyncLogger::instance()->log( &*logger , level , __VA_ARGS__ ); \
+	} while(0)
+
+/** Emit only one record out of n
+ */
+#define DQM_ASYNC_LOG_EVERY_N( logger , level , n , ... ) \
+	do { \
+		static std::atomic<uint64_t> dqmLogEveryNCounter(0); \
+		if( logger->isEnabledFor( level ) && 0 == (dqmLogEveryNCounter++ % (n)) ) \
+			dqm4hep::DQMAsyncLogger::instance()->log( &*logger , level , __VA_ARGS__ ); \
+	} while(0)
+
+/** Emit at most n records per second
+ */
+#define DQM_ASYNC_LOG_RATE_LIMITED( logger , level , n , ... ) \
+	do { \
+		static dqm4hep::DQMLogRateLimiter dqmLogRateLimiter(n); \
+		if( logger->isEnabledFor( level ) && dqmLogRateLimiter.allow() ) \
+			dqm4hep::DQMAsyncLogger::instance()->log( &*logger , level , __VA_ARGS__ ); \
+	} while(0)
+
+#define DQM_ASYNC_LOG_DEBUG( logger , ... ) DQM_ASYNC_LOG( logger , log4cxx::Level::getDebug() , __VA_ARGS__ )
+#define DQM_ASYNC_LOG_INFO( logger , ... ) DQM_ASYNC_LOG( logger , log4cxx::Level::getInfo() , __VA_ARGS__ )
+#define DQM_ASYNC_LOG_WARN( logger , ... ) DQM_ASYNC_LOG( logger , log4cxx::Level::getWarn() , __VA_ARGS__ )
+
+#endif  //  DQMASYNCLOGGER_H
@@ -0,0 +1,219 @@
+/*
+ *
+ * DQMBoundedQueue.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMBOUNDEDQUEUE_H
+#define DQMBOUNDEDQUEUE_H
+
+// -- std headers
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace dqm4hep
+{
+
+/** DQMBoundedQueue class
+ *
+ *  Blocking fifo with a maximum size, used to connect the threads
+ *  of a pipeline. A full queue blocks the producer (back pressure),
+ *  an empty queue blocks the consumer. Once closed, push fails and
+ *  pop returns the remaining elements then fails, until it is reopened.
+ */
+template <typename T>
+class DQMBoundedQueue
+{
+public:
+	/** Constructor. A queue created closed is opened with reopen()
+	 */
+	DQMBoundedQueue(size_t maxSize, bool closed = false);
+
+	/** Push an element, wait if the queue is full. Return false if the queue is closed
+	 */
+	bool push(const T &element);
+
+	/** Push an element if the queue is not full. Return false if full or closed
+	 */
+	bool tryPush(const T &element);
+
+	/** Pop an element, wait if the queue is empty. Return false if the queue is closed and empty
+	 */
+	bool pop(T &element);
+
+	/** Close the queue and wake up all the waiting threads
+	 */
+	void close();
+
+	/** Reopen a closed queue with a new maximum size. The remaining elements are removed.
+	 *  The threads using the queue are kept, as the pointers to it
+	 */
+	void reopen(size_t maxSize);
+
+	/** Whether the queue is closed
+	 */
+	bool isClosed() const;
+
+	/** Get the current number of elements
+	 */
+	size_t size() const;
+
+	/** Get the maximum number of elements
+	 */
+	size_t getMaxSize() const;
+
+private:
+	size_t                      m_maxSize;
+	bool                        m_closed;
+	std::deque<T>               m_queue;
+	mutable std::mutex          m_mutex;
+	std::condition_variable     m_notFullCondition;
+	std::condition_variable     m_notEmptyCondition;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline DQMBoundedQueue<T>::DQMBoundedQueue(size_t maxSize, bool closed) :
+	m_maxSize(maxSize ? maxSize : 1),
+	m_closed(closed)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline bool DQMBoundedQueue<T>::push(const T &element)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFullCondition.wait(lock, [this]{ return m_closed || m_queue.size() < m_maxSize; });
+
+		if(m_closed)
+			return false;
+
+		m_queue.push_back(element);
+	}
+
+	m_notEmptyCondition.notify_one();
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline bool DQMBoundedQueue<T>::tryPush(const T &element)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_closed || m_queue.size() >= m_maxSize)
+			return false;
+
+		m_queue.push_back(element);
+	}
+
+	m_notEmptyCondition.notify_one();
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline bool DQMBoundedQueue<T>::pop(T &element)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmptyCondition.wait(lock, [this]{ return m_closed || !m_queue.empty(); });
+
+		if(m_queue.empty())
+			return false;
+
+		element = m_queue.front();
+		m_queue.pop_front();
+	}
+
+	m_notFullCondition.notify_one();
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline void DQMBoundedQueue<T>::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+	}
+
+	m_notFullCondition.notify_all();
+	m_notEmptyCondition.notify_all();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline void DQMBoundedQueue<T>::reopen(size_t maxSize)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxSize = maxSize ? maxSize : 1;
+	m_queue.clear();
+	m_closed = false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline bool DQMBoundedQueue<T>::isClosed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_closed;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline size_t DQMBoundedQueue<T>::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queue.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline size_t DQMBoundedQueue<T>::getMaxSize() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_maxSize;
+}
+
+}
+
+#endif  //  DQMBOUNDEDQUEUE_H
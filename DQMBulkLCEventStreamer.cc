@@ -0,0 +1,334 @@
+/*
+ *
+ * DQMBulkLCEventStreamer.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMBulkLCEventStreamer.h"
+#include "DQMXdrBulkCodec.h"
+#include "dqm4hep/DQMEvent.h"
+#include "dqm4hep/DQMLogging.h"
+#include "dqm4hep/DQMPluginManager.h"
+#include "dqm4ilc/DQMLCEvent.h"
+#include "dqm4ilc/DQMLCEventStreamer.h"
+
+// -- lcio headers
+#include "EVENT/LCEvent.h"
+#include "EVENT/LCCollection.h"
+#include "EVENT/LCIO.h"
+#include "EVENT/CalorimeterHit.h"
+#include "Exceptions.h"
+
+// -- xdrstream headers
+#include "xdrstream/xdrstream.h"
+#include "xdrstream/BufferDevice.h"
+
+namespace dqm4hep
+{
+
+/** DQMLCEventView class
+ *
+ *  Lcio event forwarding to another event, with some collections
+ *  hidden. Used to write the non bulk part of an event without
+ *  modifying it
+ */
+class DQMLCEventView : public EVENT::LCEvent
+{
+public:
+	DQMLCEventView(EVENT::LCEvent *pLCEvent, const std::vector<std::string> &collectionNames) :
+		m_pLCEvent(pLCEvent),
+		m_collectionNames(collectionNames)
+	{
+		/* nop */
+	}
+
+	int getRunNumber() const { return m_pLCEvent->getRunNumber(); }
+	int getEventNumber() const { return m_pLCEvent->getEventNumber(); }
+	const std::string &getDetectorName() const { return m_pLCEvent->getDetectorName(); }
+	EVENT::long64 getTimeStamp() const { return m_pLCEvent->getTimeStamp(); }
+	double getWeight() const { return m_pLCEvent->getWeight(); }
+	const std::vector<std::string> *getCollectionNames() const { return &m_collectionNames; }
+	EVENT::LCCollection *getCollection(const std::string &name) const { return m_pLCEvent->getCollection(name); }
+	EVENT::LCCollection *takeCollection(const std::string &name) const { return m_pLCEvent->takeCollection(name); }
+	void addCollection(EVENT::LCCollection *pCollection, const std::string &name) { m_pLCEvent->addCollection(pCollection, name); }
+	void removeCollection(const std::string &name) { m_pLCEvent->removeCollection(name); }
+	const EVENT::LCParameters &getParameters() const { return m_pLCEvent->getParameters(); }
+	EVENT::LCParameters &parameters() { return m_pLCEvent->parameters(); }
+
+private:
+	EVENT::LCEvent                *m_pLCEvent;
+	std::vector<std::string>       m_collectionNames;    ///< The visible collections
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** Whether the (non bulk) collection may hold pointers to elements of bulk encoded collections
+ */
+static bool DQMBulkLCEventStreamer_canReferenceBulk(EVENT::LCCollection *pCollection)
+{
+	const std::string &typeName(pCollection->getTypeName());
+
+	if(pCollection->isSubset())
+		return DQMLCBulkCodecs::isSupported(typeName);
+
+	return EVENT::LCIO::CLUSTER == typeName || EVENT::LCIO::LCRELATION == typeName;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Whether the (bulk candidate) collection holds calorimeter hits linked to raw hits
+ */
+static bool DQMBulkLCEventStreamer_hasRawHitLinks(EVENT::LCCollection *pCollection)
+{
+	if(EVENT::LCIO::CALORIMETERHIT != pCollection->getTypeName())
+		return false;
+
+	const int nElements = pCollection->getNumberOfElements();
+
+	for(int e = 0 ; e < nElements ; e++)
+	{
+		EVENT::CalorimeterHit *pHit = static_cast<EVENT::CalorimeterHit *>(pCollection->getElementAt(e));
+
+		if(NULL != pHit->getRawHit())
+			return true;
+	}
+
+	return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQM_PLUGIN_DECL( DQMBulkLCEventStreamer , "BulkLCIOStreamer" )
+
+DQMBulkLCEventStreamer::DQMBulkLCEventStreamer() :
+	m_pLCEventStreamer(new DQMLCEventStreamer())
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMBulkLCEventStreamer::~DQMBulkLCEventStreamer()
+{
+	delete m_pLCEventStreamer;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEvent *DQMBulkLCEventStreamer::createEvent() const
+{
+	return new DQMLCEvent();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMBulkLCEventStreamer::write(const DQMEvent *const pObject, xdrstream::IODevice *pDevice)
+{
+	if(NULL == pObject)
+		return STATUS_CODE_INVALID_PTR;
+
+	EVENT::LCEvent *pLCEvent = pObject->getEvent<EVENT::LCEvent>();
+
+	if(NULL == pLCEvent)
+		return STATUS_CODE_INVALID_PTR;
+
+	const std::vector<std::string> *pCollectionNames = pLCEvent->getCollectionNames();
+	std::vector<std::string> genericCollectionNames;
+	std::vector<EVENT::LCCollection*> bulkCollections;
+	std::vector<std::string> bulkCollectionNames;
+	bool genericOnly = false;
+
+	for(std::vector<std::string>::const_iterator iter = pCollectionNames->begin(), endIter = pCollectionNames->end() ;
+			endIter != iter ; ++iter)
+	{
+		EVENT::LCCollection *pCollection = pLCEvent->getCollection(*iter);
+
+		if(!pCollection->isSubset() && DQMLCBulkCodecs::isSupported(pCollection->getTypeName()))
+		{
+			bulkCollections.push_back(pCollection);
+			bulkCollectionNames.push_back(*iter);
+			genericOnly = genericOnly || DQMBulkLCEventStreamer_hasRawHitLinks(pCollection);
+		}
+		else
+		{
+			genericCollectionNames.push_back(*iter);
+			genericOnly = genericOnly || DQMBulkLCEventStreamer_canReferenceBulk(pCollection);
+		}
+	}
+
+	// pointers to bulk encoded elements would be lost : write the whole event generically
+	if(genericOnly)
+		bulkCollections.clear();
+
+	uint32_t format = bulkCollections.empty() ? GENERIC_FORMAT : BULK_FORMAT;
+
+	if(xdrstream::XDR_SUCCESS != pDevice->write<uint32_t>(&format))
+		return STATUS_CODE_FAILURE;
+
+	if(bulkCollections.empty())
+		return m_pLCEventStreamer->write(pObject, pDevice);
+
+	// the rest of the event, bulk collections hidden
+	DQMLCEventView eventView(pLCEvent, genericCollectionNames);
+	DQMLCEvent viewEvent;
+	viewEvent.setEvent<EVENT::LCEvent>(&eventView, false);
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pLCEventStreamer->write(&viewEvent, pDevice));
+
+	uint32_t nBulkCollections = bulkCollections.size();
+
+	if(xdrstream::XDR_SUCCESS != pDevice->write<uint32_t>(&nBulkCollections))
+		return STATUS_CODE_FAILURE;
+
+	for(uint32_t c = 0 ; c < nBulkCollections ; c++)
+	{
+		DQMXdrBulkWriter writer(m_bulkBuffer);
+		writer.writeString(bulkCollectionNames[c]);
+		writer.writeString(bulkCollections[c]->getTypeName());
+
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, DQMLCBulkCodecs::encode(bulkCollections[c], writer));
+
+		if(xdrstream::XDR_SUCCESS != pDevice->writeArray<char>(&m_bulkBuffer[0], m_bulkBuffer.size()))
+			return STATUS_CODE_FAILURE;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMBulkLCEventStreamer::read(DQMEvent *&pObject, xdrstream::IODevice *pDevice)
+{
+	uint32_t format = GENERIC_FORMAT;
+
+	if(xdrstream::XDR_SUCCESS != pDevice->read<uint32_t>(&format))
+		return STATUS_CODE_FAILURE;
+
+	if(GENERIC_FORMAT != format && BULK_FORMAT != format)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Unknown bulk lcio event format " << format );
+		return STATUS_CODE_INVALID_PARAMETER;
+	}
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pLCEventStreamer->read(pObject, pDevice));
+
+	if(GENERIC_FORMAT == format)
+		return STATUS_CODE_SUCCESS;
+
+	EVENT::LCEvent *pLCEvent = pObject->getEvent<EVENT::LCEvent>();
+	uint32_t nBulkCollections = 0;
+
+	if(NULL == pLCEvent || xdrstream::XDR_SUCCESS != pDevice->read<uint32_t>(&nBulkCollections))
+	{
+		delete pObject;
+		pObject = NULL;
+		return STATUS_CODE_FAILURE;
+	}
+
+	// buffer devices are read in place, without copying the blocks
+	xdrstream::BufferDevice *pBufferDevice = dynamic_cast<xdrstream::BufferDevice *>(pDevice);
+
+	for(uint32_t c = 0 ; c < nBulkCollections ; c++)
+	{
+		char *pBlock = NULL;
+		const char *pBlockData = NULL;
+		xdrstream::xdr_size_t blockSize = 0;
+		bool blockRead = false;
+
+		if(NULL != pBufferDevice)
+		{
+			// same layout as writeArray<char>() : the block size, then the block padded to 4 bytes
+			if(xdrstream::XDR_SUCCESS == pBufferDevice->read<xdrstream::xdr_size_t>(&blockSize))
+			{
+				const xdrstream::xdr_size_t position = pBufferDevice->getPosition();
+				const xdrstream::xdr_size_t paddedSize = (blockSize + 3) & ~static_cast<xdrstream::xdr_size_t>(3);
+
+				if(paddedSize >= blockSize && paddedSize <= pBufferDevice->getBufferSize() - position
+						&& xdrstream::XDR_SUCCESS == pBufferDevice->seek(position + paddedSize))
+				{
+					pBlockData = pBufferDevice->getBuffer() + position;
+					blockRead = true;
+				}
+			}
+		}
+		else if(xdrstream::XDR_SUCCESS == pDevice->readArray<char>(pBlock, blockSize))
+		{
+			pBlockData = pBlock;
+			blockRead = true;
+		}
+
+		if(!blockRead)
+		{
+			delete [] pBlock;
+			delete pObject;
+			pObject = NULL;
+			return STATUS_CODE_FAILURE;
+		}
+
+		DQMXdrBulkReader reader(pBlockData, blockSize);
+		std::string collectionName, typeName;
+		EVENT::LCCollection *pCollection = NULL;
+
+		StatusCode statusCode = (reader.readString(collectionName) && reader.readString(typeName))
+				? DQMLCBulkCodecs::decode(typeName, reader, pCollection) : STATUS_CODE_FAILURE;
+
+		delete [] pBlock;
+
+		try
+		{
+			if(STATUS_CODE_SUCCESS == statusCode)
+				pLCEvent->addCollection(pCollection, collectionName);
+		}
+		catch(EVENT::Exception &exception)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Couldn't add bulk collection " << collectionName << " : " << exception.what() );
+			delete pCollection;
+			statusCode = STATUS_CODE_FAILURE;
+		}
+
+		if(STATUS_CODE_SUCCESS != statusCode)
+		{
+			delete pObject;
+			pObject = NULL;
+			return statusCode;
+		}
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMBulkLCEventStreamer::write(const DQMEvent *const pObject, const std::string &subEventIdentifier, xdrstream::IODevice *pDevice)
+{
+	uint32_t format = GENERIC_FORMAT;
+
+	if(xdrstream::XDR_SUCCESS != pDevice->write<uint32_t>(&format))
+		return STATUS_CODE_FAILURE;
+
+	return m_pLCEventStreamer->write(pObject, subEventIdentifier, pDevice);
+}
+
+}
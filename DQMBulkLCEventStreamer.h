@@ -0,0 +1,95 @@
+/*
+ *
+ * DQMBulkLCEventStreamer.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMBULKLCEVENTSTREAMER_H
+#define DQMBULKLCEVENTSTREAMER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "dqm4hep/DQMEventStreamer.h"
+
+// -- std headers
+#include <vector>
+
+namespace dqm4hep
+{
+
+class DQMLCEventStreamer;
+
+/** DQMBulkLCEventStreamer class
+ *
+ *  Lcio event streamer encoding the hot collection types (see DQMLCBulkCodecs)
+ *  with the bulk xdr codecs, and the rest of the event with DQMLCEventStreamer.
+ *  A format tag is written first :
+ *   - GENERIC_FORMAT : no bulk collection, the event follows as written by DQMLCEventStreamer
+ *   - BULK_FORMAT : the event without the bulk collections, as written by DQMLCEventStreamer,
+ *     then the number of bulk collections and one opaque block per bulk collection
+ *
+ *  Subset collections are always encoded by DQMLCEventStreamer. Events in which
+ *  pointers to bulk encoded elements would be lost (subsets of bulk types, clusters,
+ *  lc relations, CalorimeterHit raw hit links) are written in GENERIC_FORMAT.
+ *  Both the sender and the receiver have to use it (plugin "BulkLCIOStreamer")
+ */
+class DQMBulkLCEventStreamer : public DQMEventStreamer
+{
+public:
+	enum Format
+	{
+		GENERIC_FORMAT = 0,
+		BULK_FORMAT = 1
+	};
+
+	/** Constructor
+	 */
+	DQMBulkLCEventStreamer();
+
+	/** Destructor
+	 */
+	~DQMBulkLCEventStreamer();
+
+	/** Create a new lcio event wrapper
+	 */
+	DQMEvent *createEvent() const;
+
+	/** Serialize the event
+	 */
+	StatusCode write(const DQMEvent *const pObject, xdrstream::IODevice *pDevice);
+
+	/** De-serialize the event
+	 */
+	StatusCode read(DQMEvent *&pObject, xdrstream::IODevice *pDevice);
+
+	/** Serialize a part of the event, with the generic format
+	 */
+	StatusCode write(const DQMEvent *const pObject, const std::string &subEventIdentifier, xdrstream::IODevice *pDevice);
+
+private:
+	DQMLCEventStreamer            *m_pLCEventStreamer;    ///< The streamer of the non bulk part
+	std::vector<char>              m_bulkBuffer;          ///< The bulk block buffer, reused between events
+};
+
+}
+
+#endif  //  DQMBULKLCEVENTSTREAMER_H
@@ -0,0 +1,115 @@
+/*
+ *
+ * DQMBulkLCEventWriter.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMBulkLCEventWriter.h"
+#include "DQMBulkLCEventStreamer.h"
+#include "dqm4ilc/DQMLCEvent.h"
+#include "dqm4ilc/DQMLCEventStreamer.h"
+
+// -- lcio headers
+#include "EVENT/LCEvent.h"
+#include "IMPL/LCEventImpl.h"
+
+// -- xdrstream headers
+#include "xdrstream/xdrstream.h"
+
+namespace dqm4hep
+{
+
+DQMBulkLCEventWriter::DQMBulkLCEventWriter() :
+	m_pLCEvent(new IMPL::LCEventImpl()),
+	m_pEvent(new DQMLCEvent()),
+	m_pLCEventStreamer(new DQMLCEventStreamer()),
+	m_nBlocks(0)
+{
+	m_pEvent->setEvent<EVENT::LCEvent>(m_pLCEvent, false);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMBulkLCEventWriter::~DQMBulkLCEventWriter()
+{
+	delete m_pLCEventStreamer;
+	delete m_pEvent;
+	delete m_pLCEvent;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMBulkLCEventWriter::beginEvent(int runNumber, int eventNumber, int64_t timeStamp, const std::string &detectorName)
+{
+	m_pLCEvent->setRunNumber(runNumber);
+	m_pLCEvent->setEventNumber(eventNumber);
+	m_pLCEvent->setTimeStamp(timeStamp);
+	m_pLCEvent->setDetectorName(detectorName);
+
+	m_nBlocks = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMBulkLCEventWriter::getNCollections() const
+{
+	return m_nBlocks;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMBulkLCEventWriter::endEvent(xdrstream::IODevice *pDevice)
+{
+	// same layout as DQMBulkLCEventStreamer::write()
+	uint32_t format = DQMBulkLCEventStreamer::BULK_FORMAT;
+
+	if(xdrstream::XDR_SUCCESS != pDevice->write<uint32_t>(&format))
+		return STATUS_CODE_FAILURE;
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pLCEventStreamer->write(m_pEvent, pDevice));
+
+	uint32_t nBulkCollections = m_nBlocks;
+
+	if(xdrstream::XDR_SUCCESS != pDevice->write<uint32_t>(&nBulkCollections))
+		return STATUS_CODE_FAILURE;
+
+	for(unsigned int b = 0 ; b < m_nBlocks ; b++)
+	{
+		if(xdrstream::XDR_SUCCESS != pDevice->writeArray<char>(&m_blocks[b][0], m_blocks[b].size()))
+			return STATUS_CODE_FAILURE;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::vector<char> &DQMBulkLCEventWriter::nextBlock()
+{
+	if(m_nBlocks == m_blocks.size())
+		m_blocks.push_back(std::vector<char>());
+
+	return m_blocks[m_nBlocks];
+}
+
+}
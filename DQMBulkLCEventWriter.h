@@ -0,0 +1,119 @@
+/*
+ *
+ * DQMBulkLCEventWriter.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMBULKLCEVENTWRITER_H
+#define DQMBULKLCEVENTWRITER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "DQMXdrBulkCodec.h"
+
+// -- std headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xdrstream { class IODevice; }
+namespace IMPL { class LCEventImpl; }
+
+namespace dqm4hep
+{
+
+class DQMLCEvent;
+class DQMLCEventStreamer;
+
+/** DQMBulkLCEventWriter class
+ *
+ *  Write an lcio event in the DQMBulkLCEventStreamer bulk format directly
+ *  from field arrays, without creating lcio objects. Used by the eudaq
+ *  converters : only the event header goes through an (empty, reused)
+ *  LCEventImpl, the collections are encoded from the arrays into blocks
+ *  that keep their capacity from one event to the next.
+ *
+ *  Usage : beginEvent(), addCollection<T>() for each collection, endEvent()
+ */
+class DQMBulkLCEventWriter
+{
+public:
+	/** Constructor
+	 */
+	DQMBulkLCEventWriter();
+
+	/** Destructor
+	 */
+	~DQMBulkLCEventWriter();
+
+	/** Start a new event, the collections of the previous event are discarded
+	 */
+	void beginEvent(int runNumber, int eventNumber, int64_t timeStamp, const std::string &detectorName);
+
+	/** Encode a collection of type T (see DQMXdrBulkCodec) from its field arrays.
+	 *  The parameters may be NULL
+	 */
+	template <typename T>
+	StatusCode addCollection(const std::string &collectionName, int flag, const EVENT::LCParameters *const pParameters,
+			const typename DQMXdrBulkCodec<T>::Arrays &arrays);
+
+	/** Get the number of collections of the current event
+	 */
+	unsigned int getNCollections() const;
+
+	/** Write the event in the device
+	 */
+	StatusCode endEvent(xdrstream::IODevice *pDevice);
+
+private:
+	/** Get the next block buffer, keeping its capacity
+	 */
+	std::vector<char> &nextBlock();
+
+	IMPL::LCEventImpl                  *m_pLCEvent;           ///< The event header, no collection
+	DQMLCEvent                         *m_pEvent;
+	DQMLCEventStreamer                 *m_pLCEventStreamer;
+	std::vector<std::vector<char> >     m_blocks;
+	unsigned int                        m_nBlocks;            ///< The number of blocks used by the current event
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline StatusCode DQMBulkLCEventWriter::addCollection(const std::string &collectionName, int flag,
+		const EVENT::LCParameters *const pParameters, const typename DQMXdrBulkCodec<T>::Arrays &arrays)
+{
+	DQMXdrBulkWriter writer(this->nextBlock());
+	writer.writeString(collectionName);
+	writer.writeString(DQMXdrBulkCodec<T>::getTypeName());
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, DQMXdrBulkCodec<T>::encode(flag, pParameters, arrays, writer));
+
+	m_nBlocks++;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
+
+#endif  //  DQMBULKLCEVENTWRITER_H
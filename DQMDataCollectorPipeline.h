@@ -0,0 +1,397 @@
+/*
+ *
+ * DQMDataCollectorPipeline.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMDATACOLLECTORPIPELINE_H
+#define DQMDATACOLLECTORPIPELINE_H
+
+// -- dqm4hep headers
+#include "DQMBoundedQueue.h"
+#include "DQMEventBuilder.h"
+#include "DQMThreadTopology.h"
+
+// -- std headers
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dqm4hep
+{
+
+/** DQMDataCollectorPipeline class template
+ *
+ *  The data path of the eudaq data collector, from the reception to the
+ *  conversion : reception queue -> building thread -> conversion queue ->
+ *  conversion thread. The caller thread (i.e the eudaq dataserver thread)
+ *  queues the received events and the connection changes, in order. The
+ *  building thread gives them to the builder and hands each built event to
+ *  the built function, which fills the event to convert. The conversion
+ *  queue never blocks the building thread : an event is not converted if
+ *  the queue is full. The conversion thread calls the convert function.
+ *
+ *  The queues are reopened at each start, never reallocated, so that they
+ *  can be used at any time. While stopped, the received events are dropped
+ *  and the connection changes are given to the builder once the building
+ *  thread has built the events queued before the stop.
+ *
+ *  ConnectionT and EventT are as in DQMEventBuilder. ConvertedT is the
+ *  event handed over to the conversion thread.
+ */
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+class DQMDataCollectorPipeline
+{
+public:
+	typedef DQMEventBuilder<ConnectionT, EventT> Builder;
+
+	/** The built function, called by the building thread with the trigger number and the
+	 *  sub events of each built event. Fill the event to convert and return whether it is
+	 *  to be converted
+	 */
+	typedef std::function<bool(uint32_t, const std::vector<EventT> &, ConvertedT &)> BuiltFunction;
+
+	/** The convert function, called by the conversion thread
+	 */
+	typedef std::function<void(const ConvertedT &)> ConvertFunction;
+
+	/** Constructor. The builder is not owned
+	 */
+	DQMDataCollectorPipeline(Builder &builder, BuiltFunction builtFunction, ConvertFunction convertFunction);
+
+	/** Destructor. Stop the pipeline
+	 */
+	~DQMDataCollectorPipeline();
+
+	/** Set the thread topology applied by the building and conversion threads when they start.
+	 *  The topology is not owned, may be NULL
+	 */
+	void setThreadTopology(const DQMThreadTopology *pThreadTopology);
+
+	/** Start the building thread, and the conversion thread if converting, with the given queue sizes
+	 */
+	void start(size_t receiveQueueSize, size_t conversionQueueSize, bool converting);
+
+	/** Stop the pipeline : the queued events are built and converted first
+	 */
+	void stop();
+
+	/** Queue a received event, wait if the reception queue is full (back pressure).
+	 *  Return false if the event is dropped, the pipeline being stopped
+	 */
+	bool receive(const ConnectionT &connection, const EventT &event);
+
+	/** A producer connected
+	 */
+	void connect(const ConnectionT &connection);
+
+	/** A producer disconnected
+	 */
+	void disconnect(const ConnectionT &connection);
+
+	/** Whether the built events are converted, since the last start
+	 */
+	bool isConverting() const;
+
+	/** Get the number of built events
+	 */
+	uint64_t getNBuilt() const;
+
+	/** Get the number of built events not converted, the conversion queue being full
+	 */
+	uint64_t getNConversionDropped() const;
+
+	/** Get the number of events in the reception and conversion queues
+	 */
+	size_t getQueueSize() const;
+
+private:
+	/** Received class
+	 *
+	 *  A received event, or a connection change kept in order with the events
+	 */
+	class Received
+	{
+	public:
+		enum Kind { EVENT, CONNECT, DISCONNECT };
+
+		Received(Kind kind = EVENT, const ConnectionT &connection = ConnectionT(), const EventT &event = EventT());
+
+		Kind                 m_kind;
+		ConnectionT          m_connection;
+		EventT               m_event;
+	};
+
+	/** Queue a connection change, or apply it if the pipeline is stopped
+	 */
+	void changeConnection(const Received &received);
+
+	/** The building thread loop
+	 */
+	void buildingLoop();
+
+	/** The conversion thread loop
+	 */
+	void conversionLoop();
+
+	Builder                          &m_builder;
+	BuiltFunction                     m_builtFunction;
+	ConvertFunction                   m_convertFunction;
+	const DQMThreadTopology          *m_pThreadTopology;
+	DQMBoundedQueue<Received>         m_receivedQueue;     ///< Closed until the pipeline starts
+	DQMBoundedQueue<ConvertedT>       m_convertQueue;      ///< Closed until the pipeline starts
+	bool                              m_converting;        ///< Set while the pipeline is stopped
+	std::vector<EventT>               m_subEvents;         ///< Building thread only, capacity reused
+	std::thread                       m_buildingThread;
+	std::thread                       m_conversionThread;
+	std::mutex                        m_mutex;             ///< Held while starting or stopping, and by the connection changes
+	std::atomic<uint64_t>             m_nBuilt;
+	std::atomic<uint64_t>             m_nConversionDropped;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::Received::Received(Kind kind, const ConnectionT &connection, const EventT &event) :
+	m_kind(kind),
+	m_connection(connection),
+	m_event(event)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::DQMDataCollectorPipeline(Builder &builder,
+		BuiltFunction builtFunction, ConvertFunction convertFunction) :
+	m_builder(builder),
+	m_builtFunction(builtFunction),
+	m_convertFunction(convertFunction),
+	m_pThreadTopology(NULL),
+	m_receivedQueue(1, true),
+	m_convertQueue(1, true),
+	m_converting(false),
+	m_nBuilt(0),
+	m_nConversionDropped(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::~DQMDataCollectorPipeline()
+{
+	this->stop();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::setThreadTopology(const DQMThreadTopology *pThreadTopology)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pThreadTopology = pThreadTopology;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::start(size_t receiveQueueSize, size_t conversionQueueSize, bool converting)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(m_buildingThread.joinable())
+		return;
+
+	m_converting = converting;
+	m_receivedQueue.reopen(receiveQueueSize);
+
+	if(m_converting)
+		m_convertQueue.reopen(conversionQueueSize);
+
+	// the threads place themselves
+	m_buildingThread = std::thread(&DQMDataCollectorPipeline::buildingLoop, this);
+
+	if(m_converting)
+		m_conversionThread = std::thread(&DQMDataCollectorPipeline::conversionLoop, this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::stop()
+{
+	// the connection changes wait for the building thread to be joined
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// stays closed until the next start, a late event is then dropped
+	m_receivedQueue.close();
+
+	if(m_buildingThread.joinable())
+		m_buildingThread.join();
+
+	m_convertQueue.close();
+
+	if(m_conversionThread.joinable())
+		m_conversionThread.join();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline bool DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::receive(const ConnectionT &connection, const EventT &event)
+{
+	return m_receivedQueue.push(Received(Received::EVENT, connection, event));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::connect(const ConnectionT &connection)
+{
+	this->changeConnection(Received(Received::CONNECT, connection));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::disconnect(const ConnectionT &connection)
+{
+	this->changeConnection(Received(Received::DISCONNECT, connection));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline bool DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::isConverting() const
+{
+	return m_converting;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline uint64_t DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::getNBuilt() const
+{
+	return m_nBuilt;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline uint64_t DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::getNConversionDropped() const
+{
+	return m_nConversionDropped;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline size_t DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::getQueueSize() const
+{
+	return m_receivedQueue.size() + m_convertQueue.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::changeConnection(const Received &received)
+{
+	// while stopping, applied once the events queued before it are built
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(m_receivedQueue.push(received))
+		return;
+
+	if(Received::CONNECT == received.m_kind)
+		m_builder.connect(received.m_connection);
+	else
+		m_builder.disconnect(received.m_connection);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::buildingLoop()
+{
+	if(NULL != m_pThreadTopology)
+		m_pThreadTopology->apply(DQMThreadTopology::BUILDING);
+
+	Received received;
+	ConvertedT converted;
+
+	while(m_receivedQueue.pop(received))
+	{
+		if(Received::EVENT != received.m_kind)
+		{
+			if(Received::CONNECT == received.m_kind)
+				m_builder.connect(received.m_connection);
+			else
+				m_builder.disconnect(received.m_connection);
+
+			continue;
+		}
+
+		uint32_t triggerNumber = 0;
+		const bool built = m_builder.receive(received.m_connection, received.m_event, m_subEvents, triggerNumber);
+		received = Received();
+
+		if(!built)
+			continue;
+
+		// the raw data path never waits for the conversion
+		if(m_builtFunction(triggerNumber, m_subEvents, converted) && m_converting && !m_convertQueue.tryPush(converted))
+			m_nConversionDropped++;
+
+		converted = ConvertedT();
+		m_subEvents.clear();
+		m_nBuilt++;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT, typename ConvertedT>
+inline void DQMDataCollectorPipeline<ConnectionT, EventT, ConvertedT>::conversionLoop()
+{
+	if(NULL != m_pThreadTopology)
+		m_pThreadTopology->apply(DQMThreadTopology::CONVERSION);
+
+	ConvertedT converted;
+
+	while(m_convertQueue.pop(converted))
+	{
+		m_convertFunction(converted);
+		converted = ConvertedT();
+	}
+}
+
+}
+
+#endif  //  DQMDATACOLLECTORPIPELINE_H
@@ -25,19 +25,44 @@
  */
 
 // -- dqm4hep headers
-#include "dqm4hep/DQMDimEventCollector.h"
+#include "DQMDimEudaqClient.h"
 #include "dqm4hep/DQMEvent.h"
 #include "dqm4hep/DQMEventStreamer.h"
 #include "dqm4hep/DQMLogging.h"
 #include "dqm4hep/DQMCoreTool.h"
+#include "dqm4hep/DQMPluginManager.h"
+
+#include "DQMAsyncLogger.h"
+#include "DQMEventJournal.h"
+#include "DQMOccupancyAggregator.h"
+
+// -- lcio headers
+#include "EVENT/LCEvent.h"
+
+// -- dim headers
+#include "dic.hxx"
+
+// -- std headers
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
 
 namespace dqm4hep
 {
 
-static const char DQMDimEventCollector_emptyBuffer [] = "EMPTY";
-static const uint32_t DQMDimEventCollector_emptyBufferSize = 5;
+static const char DQMDimEudaqClient_emptyBuffer [] = "EMPTY";
+static const uint32_t DQMDimEudaqClient_emptyBufferSize = 5;
+static const unsigned int DQMDimEudaqClient_snapshotPeriod = 5; // sec
 
-DimEventRequestRpc::DimEventRequestRpc(DQMDimEventCollector *pCollector) :
+/** Whether the named streamer plugin reads the events as lcio events
+ */
+static bool DQMDimEudaqClient_isLcioStreamer(const std::string &streamerName)
+{
+	return "LCIOStreamer" == streamerName || "BulkLCIOStreamer" == streamerName;
+}
+
+DimEventRequestRpc::DimEventRequestRpc(DQMDimEudaqClient *pCollector) :
 	DimRpc((char*)("DQM4HEP/EventCollector/" + pCollector->getCollectorName() + "/EVENT_RAW_REQUEST").c_str(), "C", "C"),
 	m_pCollector(pCollector)
 {
@@ -54,32 +79,71 @@ void DimEventRequestRpc::rpcHandler()
 //-------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------
 
-DQMDimEudaqClient::DQMDimEudaqClient() :
-		m_eudaqName("DEFAULT"),
-		m_streamerName("DEFAULT"),
-		m_isRunning(false),
+DimEventUpdateService::DimEventUpdateService(DQMDimEudaqClient *pCollector, void *pBuffer, int bufferSize) :
+	DimService(("DQM4HEP/EventCollector/" + pCollector->getCollectorName() + "/EVENT_RAW_UPDATE").c_str(), "C", pBuffer, bufferSize),
+	m_pCollector(pCollector)
+{
+	/* nop */
+}
 
-		m_pCollectEventCommand(NULL),  // Not sure about these
-		m_pEventRequestRpc(NULL),      // Not sure about these
-		m_pUpdateModeCommand(NULL),    // Not sure about these
-		m_pEventUpdateService(NULL),   // Not sure about these
-		m_pEventStreamer(NULL),        // Not sure about these
+//-------------------------------------------------------------------------------------------------
 
-		m_pCurrentEvent(NULL),
+void DimEventUpdateService::serviceHandler()
+{
+	m_pCollector->handleClientSubscription();
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMDimEudaqClient::DQMDimEudaqClient() :
+		m_collectorName("DEFAULT"),
+		m_isRunning(false),
 		m_state(0),
 		m_clientRegisteredId(0),
-		m_pBuffer(0),
-		m_pSubEventBuffer(0)
+		m_readinessTimeout(5000),
+		m_nSampledEvents(0),
+		m_snapshotPending(false),
+		m_pServerStateService(NULL),
+		m_pClientRegisteredService(NULL),
+		m_pEventUpdateService(NULL),
+		m_pSpillSummaryService(NULL),
+		m_pStatisticsService(NULL),
+		m_pCollectEventCommand(NULL),
+		m_pUpdateModeCommand(NULL),
+		m_pSubEventIdentifierCommand(NULL),
+		m_pClientRegitrationCommand(NULL),
+		m_pConfigReloadCommand(NULL),
+		m_pSpillMarkerCommand(NULL),
+		m_pEventRequestRpc(NULL),
+		m_pBuffer(NULL),
+		m_pSubEventBuffer(NULL),
+		m_pEventStreamer(NULL),
+		m_pCurrentEvent(NULL),
+		m_lcioEvents(false),
+		m_pJournalWriter(new DQMEventJournalWriter()),
+		m_nReceivedEvents(0),
+		m_pSpillAggregator(NULL),
+		m_pOccupancyAggregator(NULL),
+		m_pPendingOccupancyAggregator(NULL),
+		m_occupancyPending(false),
+		m_occupancyThreadRunning(false)
 {
 	DimServer::addClientExitHandler(this);
 
 	// write only buffer with an initial size of 4 Mo (should be enough to start)
 	m_pSubEventBuffer = new xdrstream::BufferDevice(4*1024*1024);
+
+	memset(&m_spillSummary, 0, sizeof(DQMSpillSummary));
+	m_pSpillAggregator = new DQMSpillAggregator([this](const DQMSpillSummary &summary)
+	{
+		this->publishSpillSummary(summary);
+	});
 }
 
 //-------------------------------------------------------------------------------------------------
 
-DQMDimEudaqClient::~DQMDimEudaqClient() :
+DQMDimEudaqClient::~DQMDimEudaqClient()
 {
 	if(isRunning())
 		stopCollector();
@@ -93,6 +157,12 @@ DQMDimEudaqClient::~DQMDimEudaqClient() :
 	if(m_pBuffer)
 		delete m_pBuffer;
 
+	delete m_pJournalWriter;
+
+	if(m_pOccupancyAggregator)
+		delete m_pOccupancyAggregator;
+
+	delete m_pSpillAggregator;
 	delete m_pSubEventBuffer;
 }
 
@@ -116,12 +186,30 @@ const std::string & DQMDimEudaqClient::getCollectorName() const
 	return m_collectorName;
 }
 
-void DQMDimEudaqClient::setEventStreamer(DQMEventStreamer *pEventStreamer)
+void DQMDimEudaqClient::setEventStreamer(DQMEventStreamer *pEventStreamer, const std::string &streamerName)
 {
-	if(m_pEventStreamer)
-		delete m_pEventStreamer;
+	DQMEventStreamer *pOldEventStreamer = NULL;
+	DQMEvent *pOldEvent = NULL;
+
+	{
+		// wait for the in-flight event to be processed
+		std::lock_guard<std::mutex> lock(m_eventMutex);
 
-	m_pEventStreamer = pEventStreamer;
+		pOldEventStreamer = m_pEventStreamer;
+		m_pEventStreamer = pEventStreamer;
+		m_settings.m_streamerName = streamerName;
+		m_lcioEvents = DQMDimEudaqClient_isLcioStreamer(streamerName);
+
+		// the current event was read by the old streamer
+		pOldEvent = m_pCurrentEvent;
+		m_pCurrentEvent = NULL;
+	}
+
+	if(pOldEvent)
+		delete pOldEvent;
+
+	if(pOldEventStreamer && pOldEventStreamer != pEventStreamer)
+		delete pOldEventStreamer;
 }
 
 DQMEventStreamer *DQMDimEudaqClient::getEventStreamer() const
@@ -129,32 +217,313 @@ DQMEventStreamer *DQMDimEudaqClient::getEventStreamer() const
 	return m_pEventStreamer;
 }
 
+void DQMDimEudaqClient::setReadinessTimeout(unsigned int timeout)
+{
+	m_readinessTimeout = timeout;
+}
+
+void DQMDimEudaqClient::setSnapshotFile(const std::string &fileName)
+{
+	m_snapshotFile = fileName;
+}
+
+const std::string &DQMDimEudaqClient::getSnapshotFile() const
+{
+	return m_snapshotFile;
+}
+
+void DQMDimEudaqClient::setConfigurationFile(const std::string &fileName)
+{
+	m_configurationFile = fileName;
+}
+
+StatusCode DQMDimEudaqClient::reloadConfiguration(const std::string &fileName)
+{
+	std::ifstream configFile(fileName.c_str());
+
+	if(!configFile.is_open())
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Couldn't open configuration file '" << fileName << "'" );
+		return STATUS_CODE_NOT_FOUND;
+	}
+
+	Settings settings;
+	std::string line;
+
+	while(std::getline(configFile, line))
+	{
+		std::stringstream lineStream(line);
+		std::string key;
+
+		if(!(lineStream >> key) || '#' == key[0])
+			continue;
+
+		bool valid = true;
+
+		if("sampling" == key)
+			valid = (lineStream >> settings.m_samplingFactor) && settings.m_samplingFactor > 0;
+		else if("max-update-rate" == key)
+			valid = (lineStream >> settings.m_maxUpdateRate) && settings.m_maxUpdateRate >= 0.f;
+		else if("min-event-size" == key)
+			valid = static_cast<bool>(lineStream >> settings.m_minEventSize);
+		else if("max-event-size" == key)
+			valid = static_cast<bool>(lineStream >> settings.m_maxEventSize);
+		else if("streamer" == key)
+			valid = static_cast<bool>(lineStream >> settings.m_streamerName);
+		else if("spill-gap" == key)
+			valid = static_cast<bool>(lineStream >> settings.m_spillGap);
+		else if("journal" == key)
+			valid = static_cast<bool>(lineStream >> settings.m_journalDirectory);
+		else if("occupancy-period" == key)
+			valid = (lineStream >> settings.m_occupancyPeriod) && settings.m_occupancyPeriod > 0;
+		else if("occupancy" == key)
+		{
+			std::string definition;
+			valid = static_cast<bool>(std::getline(lineStream >> std::ws, definition));
+
+			if(valid)
+				settings.m_occupancyMaps.push_back(definition);
+		}
+		else
+			valid = false;
+
+		if(!valid)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Invalid configuration line '" << line << "' in " << fileName << ", nothing reloaded" );
+			return STATUS_CODE_INVALID_PARAMETER;
+		}
+	}
+
+	// create the occupancy maps first, so that a bad definition leaves the settings unchanged
+	DQMOccupancyAggregator *pOccupancyAggregator = NULL;
+
+	if(!settings.m_occupancyMaps.empty())
+	{
+		std::string streamerName(settings.m_streamerName);
+
+		if(streamerName.empty())
+		{
+			std::lock_guard<std::mutex> lock(m_eventMutex);
+			streamerName = m_settings.m_streamerName;
+		}
+
+		// the occupancy maps read the calorimeter hits of lcio events
+		if(!DQMDimEudaqClient_isLcioStreamer(streamerName))
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Occupancy maps need the LCIOStreamer or BulkLCIOStreamer streamer, not '" << streamerName
+					<< "', in " << fileName << ", nothing reloaded" );
+			return STATUS_CODE_INVALID_PARAMETER;
+		}
+
+		pOccupancyAggregator = new DQMOccupancyAggregator();
+		pOccupancyAggregator->setPublishPeriod(settings.m_occupancyPeriod);
+
+		for(std::vector<std::string>::const_iterator iter = settings.m_occupancyMaps.begin(), endIter = settings.m_occupancyMaps.end() ;
+				endIter != iter ; ++iter)
+		{
+			std::stringstream definitionStream(*iter);
+			std::string collectionName, cellIdEncoding;
+			unsigned int nBins = 0;
+			float amplitudeMin = 0.f, amplitudeMax = 0.f;
+
+			if(!(definitionStream >> collectionName >> cellIdEncoding >> nBins >> amplitudeMin >> amplitudeMax)
+			|| STATUS_CODE_SUCCESS != pOccupancyAggregator->addCollection(collectionName, cellIdEncoding, nBins, amplitudeMin, amplitudeMax))
+			{
+				LOG4CXX_ERROR( dqmMainLogger , "Invalid occupancy definition '" << *iter << "' in " << fileName << ", nothing reloaded" );
+				delete pOccupancyAggregator;
+				return STATUS_CODE_INVALID_PARAMETER;
+			}
+		}
+	}
+
+	// create the streamer first, so that a bad plugin name leaves the settings unchanged
+	if(!settings.m_streamerName.empty() && settings.m_streamerName != m_settings.m_streamerName)
+	{
+		DQMEventStreamer *pEventStreamer = DQMPluginManager::instance()->createPluginClass<DQMEventStreamer>(settings.m_streamerName);
+
+		if(NULL == pEventStreamer)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Event streamer plugin '" << settings.m_streamerName << "' not found, nothing reloaded" );
+
+			if(pOccupancyAggregator)
+				delete pOccupancyAggregator;
+
+			return STATUS_CODE_NOT_FOUND;
+		}
+
+		this->setEventStreamer(pEventStreamer, settings.m_streamerName);
+	}
+
+	// a journal failure is not fatal, the events are still published
+	if(!settings.m_journalDirectory.empty())
+	{
+		const StatusCode statusCode = ("off" == settings.m_journalDirectory) ? this->stopJournal()
+				: this->startJournal(settings.m_journalDirectory);
+
+		if(STATUS_CODE_SUCCESS != statusCode)
+			LOG4CXX_ERROR( dqmMainLogger , "Couldn't apply 'journal " << settings.m_journalDirectory << "' from " << fileName );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_eventMutex);
+
+		if(settings.m_streamerName.empty())
+			settings.m_streamerName = m_settings.m_streamerName;
+
+		m_settings = settings;
+		m_nSampledEvents = 0;
+	}
+
+	// stopping the old maps waits for their publication thread, which may wait for the dim
+	// lock held by the CONFIG_RELOAD handler : while running, replace them from another thread
+	bool replaceLater = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_occupancyMutex);
+
+		if(m_occupancyThreadRunning)
+		{
+			if(m_occupancyPending && NULL != m_pPendingOccupancyAggregator)
+				delete m_pPendingOccupancyAggregator;
+
+			m_pPendingOccupancyAggregator = pOccupancyAggregator;
+			m_occupancyPending = true;
+			replaceLater = true;
+		}
+	}
+
+	if(replaceLater)
+		m_occupancyCondition.notify_one();
+	else
+		this->replaceOccupancyAggregator(pOccupancyAggregator);
+
+	m_pSpillAggregator->setSpillGap(settings.m_spillGap);
+
+	LOG4CXX_INFO( dqmMainLogger , "Configuration reloaded from " << fileName << " : sampling " << settings.m_samplingFactor
+			<< ", max update rate " << settings.m_maxUpdateRate << " Hz, event size [" << settings.m_minEventSize
+			<< ", " << settings.m_maxEventSize << "], spill gap " << settings.m_spillGap << " ms" );
+
+	return STATUS_CODE_SUCCESS;
+}
+
+void DQMDimEudaqClient::replaceOccupancyAggregator(DQMOccupancyAggregator *pOccupancyAggregator)
+{
+	DQMOccupancyAggregator *pOldOccupancyAggregator = NULL;
+
+	{
+		std::lock_guard<std::mutex> lock(m_eventMutex);
+
+		pOldOccupancyAggregator = m_pOccupancyAggregator;
+		m_pOccupancyAggregator = pOccupancyAggregator;
+	}
+
+	// remove the old services before creating the new ones, same names
+	if(pOldOccupancyAggregator)
+		delete pOldOccupancyAggregator;
+
+	if(pOccupancyAggregator && this->isRunning())
+		pOccupancyAggregator->start("DQM4HEP/EventCollector/" + getCollectorName());
+}
+
+void DQMDimEudaqClient::occupancyLoop()
+{
+	std::unique_lock<std::mutex> lock(m_occupancyMutex);
+
+	while(1)
+	{
+		m_occupancyCondition.wait(lock, [this]{ return m_occupancyPending || !m_occupancyThreadRunning; });
+
+		// apply the last reload before stopping
+		if(!m_occupancyPending)
+			break;
+
+		DQMOccupancyAggregator *pOccupancyAggregator = m_pPendingOccupancyAggregator;
+		m_pPendingOccupancyAggregator = NULL;
+		m_occupancyPending = false;
+
+		lock.unlock();
+		this->replaceOccupancyAggregator(pOccupancyAggregator);
+		lock.lock();
+	}
+}
+
+StatusCode DQMDimEudaqClient::startJournal(const std::string &directory)
+{
+	std::lock_guard<std::mutex> lock(m_journalMutex);
+
+	if(m_pJournalWriter->isOpen())
+	{
+		// reopening would overwrite the first segments
+		if(directory == m_pJournalWriter->getDirectory())
+			return STATUS_CODE_SUCCESS;
+
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pJournalWriter->close());
+	}
+
+	return m_pJournalWriter->open(directory);
+}
+
+StatusCode DQMDimEudaqClient::stopJournal()
+{
+	std::lock_guard<std::mutex> lock(m_journalMutex);
+
+	return m_pJournalWriter->close();
+}
+
+void DQMDimEudaqClient::setSpillGap(unsigned int spillGap)
+{
+	m_pSpillAggregator->setSpillGap(spillGap);
+
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+	m_settings.m_spillGap = spillGap;
+}
+
 StatusCode DQMDimEudaqClient::startCollector()
 {
 	if(this->isRunning())
 		return STATUS_CODE_SUCCESS;
 
+	// restore the client settings of the previous run, if any
+	if(STATUS_CODE_SUCCESS != this->loadSnapshot())
+		LOG4CXX_WARN( dqmMainLogger , "Couldn't load snapshot file '" << m_snapshotFile << "', starting without client settings" );
+
 	m_pEventRequestRpc = new DimEventRequestRpc(this);
 
 	m_pUpdateModeCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/UPDATE_MODE").c_str(), "I", this);
 	m_pCollectEventCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/COLLECT_RAW_EVENT").c_str(), "C", this);
 	m_pSubEventIdentifierCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/SUB_EVENT_IDENTIFIER").c_str(), "C", this);
 	m_pClientRegitrationCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/CLIENT_REGISTRATION").c_str(), "I", this);
+	m_pConfigReloadCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/CONFIG_RELOAD").c_str(), "C", this);
+	m_pSpillMarkerCommand = new DimCommand(("DQM4HEP/EventCollector/" + getCollectorName() + "/SPILL_MARKER").c_str(), "I", this);
 
-	m_pEventUpdateService = new DimService(("DQM4HEP/EventCollector/" + getCollectorName() + "/EVENT_RAW_UPDATE").c_str(), "C",
-			(void*) &DQMDimEventCollector_emptyBuffer[0], DQMDimEventCollector_emptyBufferSize);
+	m_pEventUpdateService = new DimEventUpdateService(this, (void*) &DQMDimEudaqClient_emptyBuffer[0], DQMDimEudaqClient_emptyBufferSize);
 
 	m_pStatisticsService = new DQMStatisticsService("DQM4HEP/EventCollector/" + getCollectorName() + "/STATS");
 	m_pClientRegisteredService = new DimService(("DQM4HEP/EventCollector/" + getCollectorName() + "/CLIENT_REGISTERED").c_str(), m_clientRegisteredId);
 	m_pServerStateService = new DimService(("DQM4HEP/EventCollector/" + getCollectorName() + "/SERVER_STATE").c_str(), m_state);
 
+	{
+		std::lock_guard<std::mutex> lock(m_spillMutex);
+		m_pSpillSummaryService = new DimService(("DQM4HEP/EventCollector/" + getCollectorName() + "/SPILL_SUMMARY").c_str(),
+				(char *) DQMSpillSummary::m_dimFormat, (void *) &m_spillSummary, sizeof(DQMSpillSummary));
+	}
+
+	m_pSpillAggregator->start();
+
+	if(m_pOccupancyAggregator)
+		m_pOccupancyAggregator->start("DQM4HEP/EventCollector/" + getCollectorName());
+
+	m_occupancyThreadRunning = true;
+	m_occupancyThread = std::thread(&DQMDimEudaqClient::occupancyLoop, this);
+
 	// inform clients that the server is available for registrations
 	LOG4CXX_INFO( dqmMainLogger , "Changing server application to running !" );
 
 	DimServer::start( ("DQM4HEP/EventCollector/" + getCollectorName()).c_str() );
 
-	// time needed for registration on dns node
-	DQMCoreTool::sleep(std::chrono::seconds(1));
+	// wait for the registration on dns node
+	if(STATUS_CODE_SUCCESS != this->waitForReadiness())
+		LOG4CXX_WARN( dqmMainLogger , "Server not visible on dns after " << m_readinessTimeout << " ms, starting anyway" );
 
 	m_state = 1;
 	m_pServerStateService->updateService(m_state);
@@ -173,20 +542,46 @@ StatusCode DQMDimEudaqClient::stopCollector()
 	// inform clients that the server is shut down
 	m_pServerStateService->updateService(m_state);
 
+	if(STATUS_CODE_SUCCESS != this->saveSnapshot())
+		LOG4CXX_WARN( dqmMainLogger , "Couldn't save snapshot file '" << m_snapshotFile << "'" );
+
+	// publish the spill in progress
+	m_pSpillAggregator->stop();
+
 	delete m_pCollectEventCommand;
 	delete m_pUpdateModeCommand;
 	delete m_pSubEventIdentifierCommand;
 	delete m_pClientRegitrationCommand;
+	delete m_pConfigReloadCommand;
+	delete m_pSpillMarkerCommand;
+
+	// no more reload from now, apply the pending one and publish the last maps
+	{
+		std::lock_guard<std::mutex> lock(m_occupancyMutex);
+		m_occupancyThreadRunning = false;
+	}
+
+	m_occupancyCondition.notify_one();
+	m_occupancyThread.join();
+
+	if(m_pOccupancyAggregator)
+		m_pOccupancyAggregator->stop();
 
 	delete m_pEventUpdateService;
 	delete m_pStatisticsService;
 	delete m_pClientRegisteredService;
 	delete m_pServerStateService;
 
-	delete m_pEventRequestRpc;
+	{
+		std::lock_guard<std::mutex> lock(m_spillMutex);
+		delete m_pSpillSummaryService;
+		m_pSpillSummaryService = NULL;
+	}
 
-	m_pBuffer->reset();
+	delete m_pEventRequestRpc;
 
+	if(NULL != m_pBuffer)
+		m_pBuffer->reset();
 
 	m_isRunning = false;
 
@@ -204,6 +599,27 @@ void DQMDimEudaqClient::handleEventReception(DimCommand *pDimCommand)
 	m_pStatisticsService->update(bufferSize);
 	DQMEvent *pEvent = NULL;
 
+	// record the buffer as received, before any filtering.
+	// No-op when the journal is not open
+	m_pJournalWriter->append(pBuffer, bufferSize, m_nReceivedEvents);
+
+	m_nReceivedEvents++;
+
+	std::unique_lock<std::mutex> lock(m_eventMutex);
+
+	const bool filtered = (0 != m_settings.m_minEventSize && bufferSize < m_settings.m_minEventSize)
+			|| (0 != m_settings.m_maxEventSize && bufferSize > m_settings.m_maxEventSize);
+
+	if(filtered)
+	{
+		m_pSpillAggregator->processEvent(bufferSize, filtered);
+		DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Event of {} bytes filtered out" , bufferSize );
+		return;
+	}
+
+	// the event time stamp delimits the spills of buffered or replayed data
+	int64_t timeStamp = 0;
+
 	try
 	{
 		xdrstream::BufferDevice *pDevice = this->configureBuffer(pBuffer, bufferSize);
@@ -220,6 +636,18 @@ void DQMDimEudaqClient::handleEventReception(DimCommand *pDimCommand)
 					delete m_pCurrentEvent;
 
 				m_pCurrentEvent = pEvent;
+
+				// only lcio streamers give events that can be read as lcio events
+				if(m_lcioEvents)
+				{
+					EVENT::LCEvent *pLCEvent = m_pCurrentEvent->getEvent<EVENT::LCEvent>();
+
+					if(NULL != pLCEvent)
+						timeStamp = pLCEvent->getTimeStamp();
+
+					if(NULL != m_pOccupancyAggregator)
+						m_pOccupancyAggregator->processEvent(m_pCurrentEvent);
+				}
 			}
 		}
 	}
@@ -228,22 +656,23 @@ void DQMDimEudaqClient::handleEventReception(DimCommand *pDimCommand)
 		if(NULL != pEvent)
 			delete pEvent;
 
+		m_pSpillAggregator->processEvent(bufferSize, filtered);
 		LOG4CXX_ERROR( dqmMainLogger , "Couldn't deserialize the buffer : " << exception.getStatusCode() );
 		return;
 	}
 
-	LOG4CXX_DEBUG( dqmMainLogger , "Event received" );
+	m_pSpillAggregator->processEvent(bufferSize, filtered, timeStamp);
 
-	this->updateEventService();
-}
+	lock.unlock();
 
-                            //----------//
+	DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Event received ({} bytes)" , bufferSize );
 
-//   Everything above here is done, everything below is from the source, and still needs to be edited   //
+	this->updateEventService();
+}
 
-                            //----------//
+//-------------------------------------------------------------------------------------------------
 
-void DQMDimEventCollector::handleEventRequest(DimEventRequestRpc *pDimRpc)
+void DQMDimEudaqClient::handleEventRequest(DimEventRequestRpc *pDimRpc)
 {
 	char *pSubEventIdentifier = pDimRpc->getString();
 	std::string subEventIdentifier;
@@ -251,6 +680,8 @@ void DQMDimEventCollector::handleEventRequest(DimEventRequestRpc *pDimRpc)
 	if(NULL != pSubEventIdentifier)
 		subEventIdentifier = pSubEventIdentifier;
 
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+
 	if(NULL != m_pEventStreamer && NULL != m_pCurrentEvent && !subEventIdentifier.empty())
 	{
 		try
@@ -270,10 +701,10 @@ void DQMDimEventCollector::handleEventRequest(DimEventRequestRpc *pDimRpc)
 	else if(NULL != m_pBuffer && NULL != m_pBuffer->getBuffer() && 0 != m_pBuffer->getPosition())
 		pDimRpc->setData((void *) m_pBuffer->getBuffer(), m_pBuffer->getPosition());
 	else
-		pDimRpc->setData((void *) &DQMDimEventCollector_emptyBuffer[0], DQMDimEventCollector_emptyBufferSize);
+		pDimRpc->setData((void *) &DQMDimEudaqClient_emptyBuffer[0], DQMDimEudaqClient_emptyBufferSize);
 }
 
-DQMDimEventCollector::Client &DQMDimEventCollector::getClient(int clientId)
+DQMDimEudaqClient::Client &DQMDimEudaqClient::getClient(int clientId)
 {
 	ClientMap::iterator findIter = m_clientMap.find(clientId);
 
@@ -285,18 +716,39 @@ DQMDimEventCollector::Client &DQMDimEventCollector::getClient(int clientId)
 	newClient.m_updateMode = false;
 	newClient.m_subEventIdentifier = "";
 
+	char *pClientName = DimServer::getClientName();
+
+	if(NULL != pClientName)
+		newClient.m_clientName = pClientName;
+
+	// client known from a previous run ?
+	RestoredClientMap::iterator restoredIter = m_restoredClientMap.find(newClient.m_clientName);
+
+	if(!newClient.m_clientName.empty() && m_restoredClientMap.end() != restoredIter)
+	{
+		newClient.m_updateMode = restoredIter->second.m_updateMode;
+		newClient.m_subEventIdentifier = restoredIter->second.m_subEventIdentifier;
+		m_restoredClientMap.erase(restoredIter);
+
+		LOG4CXX_INFO( dqmMainLogger , "Client " << clientId << " (" << newClient.m_clientName << ") restored from previous run" );
+	}
+
 	m_clientMap.insert(std::pair<int, Client>(clientId, newClient));
 
 	return m_clientMap.find(clientId)->second;
 }
 
-void DQMDimEventCollector::commandHandler()
+void DQMDimEudaqClient::commandHandler()
 {
 	DimCommand *pCommand = getCommand();
 
 	if(!pCommand)
 		return;
 
+	// save a client change delayed by the throttling
+	if(m_snapshotPending)
+		this->saveSnapshotThrottled();
+
 	if(pCommand == m_pUpdateModeCommand)
 	{
 		bool updateMode = static_cast<bool>(pCommand->getInt());
@@ -307,6 +759,7 @@ void DQMDimEventCollector::commandHandler()
 
 		Client &client = getClient(clientId);
 		client.m_updateMode = updateMode;
+		this->saveSnapshotThrottled();
 		return;
 	}
 
@@ -324,6 +777,7 @@ void DQMDimEventCollector::commandHandler()
 
 		Client &client = getClient(clientId);
 		client.m_subEventIdentifier = subEventIdentifier;
+		this->saveSnapshotThrottled();
 		return;
 	}
 
@@ -333,6 +787,19 @@ void DQMDimEventCollector::commandHandler()
 		return;
 	}
 
+	if(pCommand == m_pConfigReloadCommand)
+	{
+		this->handleConfigReload(pCommand);
+		return;
+	}
+
+	if(pCommand == m_pSpillMarkerCommand)
+	{
+		// 1 : spill start, 0 : spill end
+		m_pSpillAggregator->processMarker(0 != pCommand->getInt());
+		return;
+	}
+
 	if(pCommand == m_pClientRegitrationCommand)
 	{
 		int clientId = getClientId();
@@ -359,45 +826,68 @@ void DQMDimEventCollector::commandHandler()
 		{
 			this->removeClient(clientId);
 		}
+
+		this->saveSnapshotThrottled();
 	}
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void DQMDimEventCollector::clientExitHandler()
+void DQMDimEudaqClient::clientExitHandler()
 {
 	this->removeClient(getClientId());
+	this->saveSnapshotThrottled();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMDimEudaqClient::getNClients() const
+{
+	return m_clientMap.size();
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void DQMDimEventCollector::updateEventService()
+size_t DQMDimEudaqClient::getNRestoredClients() const
+{
+	return m_restoredClientMap.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMDimEudaqClient::updateEventService()
 {
 	// if not running, do not update
 	if(!isRunning())
 		return;
 
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+
+	if(!this->acceptEventUpdate())
+		return;
+
 	// event available ?
 	if(NULL == m_pBuffer)
 	{
-		LOG4CXX_DEBUG( dqmMainLogger , "Buffer device is null" );
+		DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Buffer device is null" );
 		return;
 	}
 
 	if(NULL == m_pBuffer->getBuffer())
 	{
-		LOG4CXX_DEBUG( dqmMainLogger , "Buffer is null" );
+		DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Buffer is null" );
 		return;
 	}
 
 	if( 0 == m_pBuffer->getBufferSize() )
 	{
-		LOG4CXX_DEBUG( dqmMainLogger , "Buffer position is 0" );
+		DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Buffer position is 0" );
 		return;
 	}
 
-	int *clientIds = new int[m_clientMap.size()];
-	memset(&clientIds[0], 0, m_clientMap.size());
+	// dim expects a 0 terminated list
+	int *clientIds = new int[m_clientMap.size()+1];
+	memset(&clientIds[0], 0, (m_clientMap.size()+1)*sizeof(int));
 	int currentId = 0;
 
 	for(ClientMap::iterator iter = m_clientMap.begin(), endIter = m_clientMap.end() ;
@@ -416,7 +906,7 @@ void DQMDimEventCollector::updateEventService()
 
 			if(STATUS_CODE_SUCCESS != m_pEventStreamer->write(m_pCurrentEvent, iter->second.m_subEventIdentifier, m_pSubEventBuffer))
 			{
-				LOG4CXX_WARN( dqmMainLogger , "Couldn't write event (sub event serialization)" );
+				DQM_ASYNC_LOG_RATE_LIMITED( dqmMainLogger , log4cxx::Level::getWarn() , 10 , "Couldn't write event (sub event serialization) for client {}" , iter->first );
 				continue;
 			}
 
@@ -441,7 +931,7 @@ void DQMDimEventCollector::updateEventService()
 
 	if(currentId != 0)
 	{
-		LOG4CXX_DEBUG( dqmMainLogger , "Sending updates to " << currentId << " clients !" );
+		DQM_ASYNC_LOG_DEBUG( dqmMainLogger , "Sending updates to {} clients !" , currentId );
 		m_pEventUpdateService->selectiveUpdateService((void *) m_pBuffer->getBuffer(), m_pBuffer->getBufferSize(), clientIds);
 	}
 
@@ -452,7 +942,7 @@ void DQMDimEventCollector::updateEventService()
 
 //-------------------------------------------------------------------------------------------------
 
-void DQMDimEventCollector::removeClient(int clientId)
+void DQMDimEudaqClient::removeClient(int clientId)
 {
 	if(clientId < 0)
 		return;
@@ -469,7 +959,7 @@ void DQMDimEventCollector::removeClient(int clientId)
 
 //-------------------------------------------------------------------------------------------------
 
-xdrstream::BufferDevice *DQMDimEventCollector::configureBuffer(char *pBuffer, xdrstream::xdr_size_t bufferSize)
+xdrstream::BufferDevice *DQMDimEudaqClient::configureBuffer(char *pBuffer, xdrstream::xdr_size_t bufferSize)
 {
 	// allocate it in read only mode and set ownership to false
 	if(0 == m_pBuffer)
@@ -483,4 +973,253 @@ xdrstream::BufferDevice *DQMDimEventCollector::configureBuffer(char *pBuffer, xd
 	return m_pBuffer;
 }
 
-} 
+//-------------------------------------------------------------------------------------------------
+
+void DQMDimEudaqClient::handleClientSubscription()
+{
+	int clientId = getClientId();
+
+	// only restore clients known from a previous run.
+	// New clients still have to register explicitly
+	if(clientId < 0 || m_restoredClientMap.empty() || m_clientMap.end() != m_clientMap.find(clientId))
+		return;
+
+	char *pClientName = DimServer::getClientName();
+
+	if(NULL == pClientName || m_restoredClientMap.end() == m_restoredClientMap.find(pClientName))
+		return;
+
+	this->getClient(clientId);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMDimEudaqClient::waitForReadiness()
+{
+	const std::string serviceName("DQM4HEP/EventCollector/" + getCollectorName() + "/SERVER_STATE");
+	DimBrowser browser;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::chrono::milliseconds timeout(m_readinessTimeout);
+
+	// the dns publishes the services as soon as the registration is done
+	while(0 == browser.getServices(serviceName.c_str()))
+	{
+		if(std::chrono::steady_clock::now() - startTime > timeout)
+			return STATUS_CODE_FAILURE;
+
+		DQMCoreTool::sleep(std::chrono::milliseconds(5));
+	}
+
+	LOG4CXX_DEBUG( dqmMainLogger , "Server registered on dns after "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << " ms" );
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMDimEudaqClient::saveSnapshot()
+{
+	// clients of the previous run that did not come back during this one are gone
+	// (a restarted client has a new pid@node name) : forget them, or the list grows forever
+	m_restoredClientMap.clear();
+
+	// dim client ids are only valid for the current connections,
+	// keep the settings by client name for the next start
+	for(ClientMap::iterator iter = m_clientMap.begin(), endIter = m_clientMap.end() ;
+			endIter != iter ; ++iter)
+	{
+		if(!iter->second.m_clientName.empty())
+			m_restoredClientMap[iter->second.m_clientName] = iter->second;
+	}
+
+	m_clientMap.clear();
+	m_snapshotPending = false;
+
+	return this->writeSnapshot();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMDimEudaqClient::saveSnapshotThrottled()
+{
+	m_snapshotPending = true;
+
+	const std::chrono::steady_clock::time_point now(std::chrono::steady_clock::now());
+
+	if(now - m_lastSnapshotTime < std::chrono::seconds(DQMDimEudaqClient_snapshotPeriod))
+		return;
+
+	m_snapshotPending = false;
+	m_lastSnapshotTime = now;
+
+	if(STATUS_CODE_SUCCESS != this->writeSnapshot())
+		LOG4CXX_WARN( dqmMainLogger , "Couldn't save snapshot file '" << m_snapshotFile << "'" );
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMDimEudaqClient::writeSnapshot() const
+{
+	if(m_snapshotFile.empty())
+		return STATUS_CODE_SUCCESS;
+
+	// clients of the previous run that did not come back yet are kept,
+	// the registered clients override them
+	RestoredClientMap clientMap(m_restoredClientMap);
+
+	for(ClientMap::const_iterator iter = m_clientMap.begin(), endIter = m_clientMap.end() ;
+			endIter != iter ; ++iter)
+	{
+		if(!iter->second.m_clientName.empty())
+			clientMap[iter->second.m_clientName] = iter->second;
+	}
+
+	// write a temporary file and rename it, so that a crash never leaves a truncated snapshot
+	const std::string tmpFileName(m_snapshotFile + ".tmp");
+	std::ofstream snapshotFile(tmpFileName.c_str(), std::ios::trunc);
+
+	if(!snapshotFile.is_open())
+		return STATUS_CODE_FAILURE;
+
+	snapshotFile << "# DQMDimEudaqClient snapshot : name update-mode sub-event-identifier\n";
+
+	for(RestoredClientMap::const_iterator iter = clientMap.begin(), endIter = clientMap.end() ;
+			endIter != iter ; ++iter)
+		snapshotFile << iter->first << '\t' << iter->second.m_updateMode << '\t' << iter->second.m_subEventIdentifier << '\n';
+
+	snapshotFile.close();
+
+	if(snapshotFile.fail() || 0 != std::rename(tmpFileName.c_str(), m_snapshotFile.c_str()))
+		return STATUS_CODE_FAILURE;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMDimEudaqClient::loadSnapshot()
+{
+	if(m_snapshotFile.empty())
+		return STATUS_CODE_SUCCESS;
+
+	std::ifstream snapshotFile(m_snapshotFile.c_str());
+
+	// first start, nothing to restore
+	if(!snapshotFile.is_open())
+		return STATUS_CODE_SUCCESS;
+
+	std::string line;
+	RestoredClientMap restoredClientMap;
+
+	while(std::getline(snapshotFile, line))
+	{
+		if(line.empty() || '#' == line[0])
+			continue;
+
+		std::string::size_type firstTab = line.find('\t');
+		std::string::size_type secondTab = line.find('\t', firstTab+1);
+
+		if(std::string::npos == firstTab || std::string::npos == secondTab)
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		Client client;
+		client.m_clientId = -1;
+		client.m_clientName = line.substr(0, firstTab);
+		client.m_updateMode = ("1" == line.substr(firstTab+1, secondTab-firstTab-1));
+		client.m_subEventIdentifier = line.substr(secondTab+1);
+
+		restoredClientMap[client.m_clientName] = client;
+	}
+
+	// in-memory settings are more recent than the file
+	for(RestoredClientMap::iterator iter = m_restoredClientMap.begin(), endIter = m_restoredClientMap.end() ;
+			endIter != iter ; ++iter)
+		restoredClientMap[iter->first] = iter->second;
+
+	m_restoredClientMap.swap(restoredClientMap);
+
+	LOG4CXX_INFO( dqmMainLogger , m_restoredClientMap.size() << " client(s) to restore from snapshot" );
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMDimEudaqClient::handleConfigReload(DimCommand *pDimCommand)
+{
+	char *pFileName = pDimCommand->getString();
+	std::string fileName;
+
+	if(NULL != pFileName)
+		fileName = pFileName;
+
+	if(fileName.empty())
+		fileName = m_configurationFile;
+
+	if(fileName.empty())
+	{
+		LOG4CXX_WARN( dqmMainLogger , "Configuration reload requested but no configuration file set" );
+		return;
+	}
+
+	this->reloadConfiguration(fileName);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMDimEudaqClient::publishSpillSummary(const DQMSpillSummary &summary)
+{
+	std::lock_guard<std::mutex> lock(m_spillMutex);
+
+	if(NULL == m_pSpillSummaryService)
+		return;
+
+	m_spillSummary = summary;
+	m_pSpillSummaryService->updateService();
+
+	LOG4CXX_DEBUG( dqmMainLogger , "Spill " << summary.m_spillNumber << " : " << summary.m_nEvents << " events, "
+			<< summary.m_nBytes << " bytes in " << summary.m_duration << " s" );
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMDimEudaqClient::acceptEventUpdate()
+{
+	if(m_settings.m_samplingFactor > 1)
+	{
+		m_nSampledEvents = (m_nSampledEvents + 1) % m_settings.m_samplingFactor;
+
+		if(0 != m_nSampledEvents)
+			return false;
+	}
+
+	if(m_settings.m_maxUpdateRate > 0.f)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::chrono::duration<float> minPeriod(1.f / m_settings.m_maxUpdateRate);
+
+		if(now - m_lastUpdateTime < minPeriod)
+			return false;
+
+		m_lastUpdateTime = now;
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMDimEudaqClient::Settings::Settings() :
+	m_samplingFactor(1),
+	m_maxUpdateRate(0.f),
+	m_minEventSize(0),
+	m_maxEventSize(0),
+	m_spillGap(0),
+	m_occupancyPeriod(1000)
+{
+	/* nop */
+}
+
+}
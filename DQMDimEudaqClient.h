@@ -32,16 +32,27 @@
 #include "dqm4hep/DQMEventCollectorImp.h"
 #include "dqm4hep/DQMStatisticsService.h"
 
+#include "DQMSpillAggregator.h"
+
 // -- xdrstream headers
 #include "xdrstream/xdrstream.h"
 
 // -- dim headers
 #include "dis.hxx"
 
+// -- std headers
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
 namespace dqm4hep
 {
 
 class DQMDimEudaqClient;
+class DQMEventJournalWriter;
+class DQMOccupancyAggregator;
 
 /** DimEventRequestRpc class
  */
@@ -64,12 +75,38 @@ private:
 //-------------------------------------------------------------------------------------------------
 //-------------------------------------------------------------------------------------------------
 
+/** DimEventUpdateService class
+ *
+ *  Event update service notifying the collector when a
+ *  client subscribes, so that a client reconnecting after
+ *  a restart can recover its previous settings
+ */
+class DimEventUpdateService : public DimService
+{
+public:
+	/** Constructor
+	 */
+	DimEventUpdateService(DQMDimEudaqClient *pCollector, void *pBuffer, int bufferSize);
+
+	/** The service handler, called on client subscription
+	 */
+	void serviceHandler();
+
+private:
+	// the collector
+	DQMDimEudaqClient        *m_pCollector;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
 /** DQMDimEudaqClient class
  */
 class DQMDimEudaqClient : public DQMEventCollectorImp, public DimServer
 {
 //	friend class DimEventReceptionRpc;
 	friend class DimEventRequestRpc;
+	friend class DimEventUpdateService;
  public:
 	/** Constructor
 	 */
@@ -99,14 +136,86 @@ class DQMDimEudaqClient : public DQMEventCollectorImp, public DimServer
 	 */
 	StatusCode stopCollector();
 
-	/** Set the event streamer to serialize/deserialize the in/out-coming events
+	/** Set the event streamer to serialize/deserialize the in/out-coming events.
+	 *  Can be called while running : the streamer is swapped between two events
+	 *  and the current de-serialized event is discarded. The streamer plugin name is
+	 *  recorded in the settings, empty if unknown (a reload naming a streamer then replaces it).
+	 *  The spill time stamps and the occupancy maps are only read from the events of the
+	 *  LCIOStreamer and BulkLCIOStreamer streamers
 	 */
-	void setEventStreamer(DQMEventStreamer *pEventStreamer);
+	void setEventStreamer(DQMEventStreamer *pEventStreamer, const std::string &streamerName = "");
 
 	/** Get the event streamer
 	 */
 	DQMEventStreamer *getEventStreamer() const;
 
+	/** Set the maximum time to wait for the dns registration on start (unit msec)
+	 */
+	void setReadinessTimeout(unsigned int timeout);
+
+	/** Set the snapshot file used for warm restart. The client settings are saved
+	 *  in this file on stop and restored on start. Empty string disables the file
+	 *  (settings are then only kept in memory across stop/start)
+	 */
+	void setSnapshotFile(const std::string &fileName);
+
+	/** Get the snapshot file used for warm restart
+	 */
+	const std::string &getSnapshotFile() const;
+
+	/** Set the configuration file read on CONFIG_RELOAD command with no argument
+	 */
+	void setConfigurationFile(const std::string &fileName);
+
+	/** Read the sampling, filter, rate and streamer settings from a configuration file
+	 *  and apply them without stopping the collector. One "key value" pair per line :
+	 *   - sampling <n> : publish one event out of n to update clients
+	 *   - max-update-rate <hz> : maximum event update rate to clients (0 : no limit)
+	 *   - min-event-size <bytes>, max-event-size <bytes> : reject received events out of range (0 : no limit)
+	 *   - streamer <plugin name> : event streamer to use, created via the plugin manager
+	 *   - spill-gap <msec> : time without event ending a spill (0 : markers only)
+	 *   - occupancy <collection> <cell id encoding> <n bins> <min> <max> : publish the occupancy
+	 *     and amplitude maps of a calorimeter hit collection (see DQMOccupancyAggregator). Repeatable,
+	 *     rejected unless the streamer is LCIOStreamer or BulkLCIOStreamer
+	 *   - occupancy-period <msec> : period of the occupancy maps publication
+	 *   - journal <directory> : record the received raw buffers (see startJournal), "off" to stop.
+	 *     The journal is left as is when the key is absent
+	 *  The occupancy maps restart from zero on each reload
+	 */
+	StatusCode reloadConfiguration(const std::string &fileName);
+
+	/** Start recording the received raw buffers in a journal in the given directory.
+	 *  The journal can be replayed with dqm4hep_replay_event_journal. Can be called
+	 *  while running, a journal open in another directory is closed first
+	 */
+	StatusCode startJournal(const std::string &directory);
+
+	/** Stop recording the received raw buffers
+	 */
+	StatusCode stopJournal();
+
+	/** Set the time without event ending a spill (unit msec), 0 to delimit
+	 *  the spills only with the SPILL_MARKER command. The gap is checked on the
+	 *  reception times and on the time stamps of the lcio events. A summary of
+	 *  each spill is published on the SPILL_SUMMARY service
+	 */
+	void setSpillGap(unsigned int spillGap);
+
+	/** Update the event service for clients that have specified an update mode.
+	 *  Called on each received event, can be called to publish the current event again
+	 */
+	void updateEventService();
+
+	/** Get the number of registered clients. The client list is handled
+	 *  by the dim thread : call it from a dim handler or while no client connects
+	 */
+	size_t getNClients() const;
+
+	/** Get the number of clients restored from the snapshot, not registered yet.
+	 *  Same thread constraint as getNClients()
+	 */
+	size_t getNRestoredClients() const;
+
 private:
 	/** Dim command handler
 	 */
@@ -125,10 +234,33 @@ private:
 	{
 	public:
 		int           m_clientId;       ///< The client id (dim client id)
+		std::string    m_clientName;    ///< The client name (dim pid@node), stable across server restarts
 		bool          m_updateMode;    ///< Whether the client uses an update mode
 		std::string    m_subEventIdentifier;   ///< The sub event identifier received from the client from
 	};
 
+	/** Settings class
+	 *
+	 *  Run time settings, reloadable while running
+	 */
+	class Settings
+	{
+	public:
+		/** Constructor
+		 */
+		Settings();
+
+		unsigned int   m_samplingFactor;    ///< Publish one event out of n to update clients
+		float          m_maxUpdateRate;     ///< Maximum update rate (Hz) to clients, 0 for no limit
+		dqm_uint       m_minEventSize;      ///< Minimum received event size, 0 for no limit
+		dqm_uint       m_maxEventSize;      ///< Maximum received event size, 0 for no limit
+		std::string    m_streamerName;      ///< The event streamer plugin name, empty to keep the current one
+		unsigned int   m_spillGap;          ///< Time without event ending a spill (msec), 0 for markers only
+		unsigned int   m_occupancyPeriod;   ///< Period of the occupancy maps publication (msec)
+		std::vector<std::string> m_occupancyMaps;   ///< The occupancy map definitions, as in the configuration file
+		std::string    m_journalDirectory;  ///< The journal directory, "off" to stop it, empty to keep the current state
+	};
+
 	/**
 	 */
 	void handleEventReception(DimCommand *pDimCommand);
@@ -141,15 +273,56 @@ private:
 	 */
 	Client &getClient(int clientId);
 
-	/** Update the event service for clients
-	 *  that have specified an update mode
-	 */
-	void updateEventService();
-
 	/** Remove a client from the map
 	 */
 	void removeClient(int clientId);
 
+	/** Handle a client subscription to the event update service
+	 */
+	void handleClientSubscription();
+
+	/** Handle the configuration reload command
+	 */
+	void handleConfigReload(DimCommand *pDimCommand);
+
+	/** Publish a spill summary on the spill summary service
+	 */
+	void publishSpillSummary(const DQMSpillSummary &summary);
+
+	/** Whether the current event has to be published according to the sampling and rate settings
+	 */
+	bool acceptEventUpdate();
+
+	/** Replace the occupancy aggregator, started if the collector is running.
+	 *  Must not be called from a dim handler while running
+	 */
+	void replaceOccupancyAggregator(DQMOccupancyAggregator *pOccupancyAggregator);
+
+	/** The occupancy thread loop : apply the occupancy aggregators of the configuration reloads
+	 */
+	void occupancyLoop();
+
+	/** Wait for the dns to publish the server services
+	 */
+	StatusCode waitForReadiness();
+
+	/** Replace the restored client list by the registered clients and save them to the snapshot file
+	 */
+	StatusCode saveSnapshot();
+
+	/** Save the snapshot file after a client change, at most once per snapshot period.
+	 *  A change inside the period is saved by the first call after the period
+	 */
+	void saveSnapshotThrottled();
+
+	/** Write the registered and the not yet restored clients to the snapshot file
+	 */
+	StatusCode writeSnapshot() const;
+
+	/** Load the restored client list from the snapshot file
+	 */
+	StatusCode loadSnapshot();
+
 	/** Configure the buffer. Allocate the ptr is needed and set
 	 *  the buffer to read only and owner of the buffer. The buffer
 	 *  is copied since event updates need to keep track of the buffer
@@ -159,16 +332,26 @@ private:
 private:
 
 	typedef std::map<int, Client> ClientMap;
+	typedef std::map<std::string, Client> RestoredClientMap;
 
 	std::string              m_collectorName;
 	bool                    m_isRunning;
 	int                     m_state;
 	int                     m_clientRegisteredId;
+	unsigned int            m_readinessTimeout;
+	std::string              m_snapshotFile;
+	std::string              m_configurationFile;
+	Settings                 m_settings;
+	unsigned int             m_nSampledEvents;
+	std::chrono::steady_clock::time_point  m_lastUpdateTime;
+	bool                     m_snapshotPending;   ///< Whether a client change is not saved yet
+	std::chrono::steady_clock::time_point  m_lastSnapshotTime;
 
 	// services
 	DimService              *m_pServerStateService;
 	DimService              *m_pClientRegisteredService;
-	DimService              *m_pEventUpdateService;
+	DimEventUpdateService   *m_pEventUpdateService;
+	DimService              *m_pSpillSummaryService;
 	DQMStatisticsService    *m_pStatisticsService;
 
 	// commands
@@ -176,6 +359,8 @@ private:
 	DimCommand              *m_pUpdateModeCommand;
 	DimCommand              *m_pSubEventIdentifierCommand;
 	DimCommand              *m_pClientRegitrationCommand;
+	DimCommand              *m_pConfigReloadCommand;
+	DimCommand              *m_pSpillMarkerCommand;
 
 	// remote procedure call
 	DimEventRequestRpc      *m_pEventRequestRpc;
@@ -185,8 +370,26 @@ private:
 
 	DQMEventStreamer        *m_pEventStreamer;
 	DQMEvent                *m_pCurrentEvent;
+	bool                     m_lcioEvents;        ///< Whether the streamer events are lcio events
+	std::mutex               m_eventMutex;        ///< Protect the streamer, the current event and the settings
+
+	DQMEventJournalWriter   *m_pJournalWriter;    ///< Allocated once, opened and closed by start/stopJournal
+	std::mutex               m_journalMutex;      ///< Serialize the journal start and stop
+	uint32_t                 m_nReceivedEvents;
+
+	DQMSpillAggregator      *m_pSpillAggregator;
+	DQMOccupancyAggregator  *m_pOccupancyAggregator;
+	DQMOccupancyAggregator  *m_pPendingOccupancyAggregator;   ///< Reloaded, waiting for the occupancy thread
+	bool                     m_occupancyPending;
+	bool                     m_occupancyThreadRunning;
+	std::mutex               m_occupancyMutex;    ///< Protect the pending occupancy aggregator
+	std::condition_variable  m_occupancyCondition;
+	std::thread              m_occupancyThread;
+	DQMSpillSummary          m_spillSummary;      ///< The published spill summary
+	std::mutex               m_spillMutex;        ///< Protect the spill summary service
 
 	ClientMap                m_clientMap;
+	RestoredClientMap        m_restoredClientMap;
 }; 
 
 } 
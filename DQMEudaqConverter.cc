@@ -0,0 +1,167 @@
+/*
+ *
+ * DQMEudaqConverter.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMEudaqConverter.h"
+#include "dqm4hep/DQMLogging.h"
+#include "dqm4hep/DQMPluginManager.h"
+
+// -- eudaq headers
+#include "eudaq/Event.hh"
+
+// -- std headers
+#include <sstream>
+
+namespace dqm4hep
+{
+
+DQMEudaqConverterRegistry::DQMEudaqConverterRegistry()
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEudaqConverterRegistry::~DQMEudaqConverterRegistry()
+{
+	this->clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEudaqConverterRegistry::addConverter(const std::string &description, DQMEudaqConverter *pConverter)
+{
+	if(NULL == pConverter)
+		return STATUS_CODE_INVALID_PTR;
+
+	if(m_converterMap.end() != m_converterMap.find(description))
+		return STATUS_CODE_ALREADY_PRESENT;
+
+	m_converterMap[description] = pConverter;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEudaqConverterRegistry::addConverter(const std::string &description, const std::string &pluginName)
+{
+	if(m_converterMap.end() != m_converterMap.find(description))
+		return STATUS_CODE_ALREADY_PRESENT;
+
+	DQMEudaqConverter *pConverter = DQMPluginManager::instance()->createPluginClass<DQMEudaqConverter>(pluginName);
+
+	if(NULL == pConverter)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Converter plugin '" << pluginName << "' not found for event description " << description );
+		return STATUS_CODE_NOT_FOUND;
+	}
+
+	return this->addConverter(description, pConverter);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEudaqConverterRegistry::configure(const std::string &converters)
+{
+	std::stringstream convertersStream(converters);
+	std::string converter;
+
+	while(std::getline(convertersStream, converter, ','))
+	{
+		if(converter.empty())
+			continue;
+
+		std::string::size_type colon = converter.find(':');
+
+		if(std::string::npos == colon || 0 == colon || converter.size()-1 == colon)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Invalid converter '" << converter << "', expected description:plugin" );
+			return STATUS_CODE_INVALID_PARAMETER;
+		}
+
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->addConverter(converter.substr(0, colon), converter.substr(colon+1)));
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEudaqConverterRegistry::clear()
+{
+	for(ConverterMap::iterator iter = m_converterMap.begin(), endIter = m_converterMap.end() ;
+			endIter != iter ; ++iter)
+		delete iter->second;
+
+	m_converterMap.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMEudaqConverterRegistry::empty() const
+{
+	return m_converterMap.empty();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEudaqConverterRegistry::convert(const eudaq::Event &event, DQMBulkLCEventWriter &writer, unsigned int &nUnconverted) const
+{
+	nUnconverted = 0;
+
+	std::vector<eudaq::EventSPC> subEvents = event.GetSubEvents();
+
+	if(subEvents.empty())
+	{
+		ConverterMap::const_iterator findIter = m_converterMap.find(event.GetDescription());
+
+		if(m_converterMap.end() == findIter)
+		{
+			nUnconverted++;
+			return STATUS_CODE_SUCCESS;
+		}
+
+		return findIter->second->convert(event, writer);
+	}
+
+	for(std::vector<eudaq::EventSPC>::const_iterator iter = subEvents.begin(), endIter = subEvents.end() ;
+			endIter != iter ; ++iter)
+	{
+		ConverterMap::const_iterator findIter = m_converterMap.find((*iter)->GetDescription());
+
+		if(m_converterMap.end() == findIter)
+		{
+			nUnconverted++;
+			continue;
+		}
+
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, findIter->second->convert(**iter, writer));
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
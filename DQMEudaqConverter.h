@@ -0,0 +1,118 @@
+/*
+ *
+ * DQMEudaqConverter.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEUDAQCONVERTER_H
+#define DQMEUDAQCONVERTER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <map>
+#include <string>
+
+namespace eudaq { class Event; }
+
+namespace dqm4hep
+{
+
+class DQMBulkLCEventWriter;
+
+/** DQMEudaqConverter class
+ *
+ *  Convert the raw data of one eudaq (sub) event type into lcio
+ *  collections. Implementations decode the raw blocks into the field
+ *  arrays of DQMXdrBulkCodec and add them to the writer, so that no lcio
+ *  object is created. Converters are plugins (DQM_PLUGIN_DECL), loaded
+ *  with the plugin manager and registered per event description in the
+ *  DQMEudaqConverterRegistry. A converter instance is only used by one
+ *  thread at a time, so it can keep its arrays from one event to the next
+ */
+class DQMEudaqConverter
+{
+public:
+	/** Destructor
+	 */
+	virtual ~DQMEudaqConverter() {}
+
+	/** Add the collections of the event to the writer
+	 */
+	virtual StatusCode convert(const eudaq::Event &event, DQMBulkLCEventWriter &writer) = 0;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMEudaqConverterRegistry class
+ *
+ *  Converters by eudaq event description (i.e "Ex0Raw"). A built
+ *  event (i.e "Ex0Tg") is converted sub event by sub event
+ */
+class DQMEudaqConverterRegistry
+{
+public:
+	/** Constructor
+	 */
+	DQMEudaqConverterRegistry();
+
+	/** Destructor. Delete the converters
+	 */
+	~DQMEudaqConverterRegistry();
+
+	/** Register a converter for an event description. The converter is owned
+	 */
+	StatusCode addConverter(const std::string &description, DQMEudaqConverter *pConverter);
+
+	/** Create a converter plugin and register it for an event description
+	 */
+	StatusCode addConverter(const std::string &description, const std::string &pluginName);
+
+	/** Register converter plugins from a "description:plugin" list separated by ','
+	 *  (i.e "Ex0Raw:Ex0RawConverter,CaliceRaw:SDHCALRawConverter")
+	 */
+	StatusCode configure(const std::string &converters);
+
+	/** Delete the converters
+	 */
+	void clear();
+
+	/** Whether no converter is registered
+	 */
+	bool empty() const;
+
+	/** Convert an event, or each of its sub events if any. The events without
+	 *  converter are skipped and counted in nUnconverted
+	 */
+	StatusCode convert(const eudaq::Event &event, DQMBulkLCEventWriter &writer, unsigned int &nUnconverted) const;
+
+private:
+	typedef std::map<std::string, DQMEudaqConverter*> ConverterMap;
+
+	ConverterMap              m_converterMap;
+};
+
+}
+
+#endif  //  DQMEUDAQCONVERTER_H
@@ -0,0 +1,276 @@
+/*
+ *
+ * DQMEventBuilder.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEVENTBUILDER_H
+#define DQMEVENTBUILDER_H
+
+// -- std headers
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace dqm4hep
+{
+
+/** DQMEventBuilder class template
+ *
+ *  Build events by trigger number from several producer connections.
+ *  Each connection has its own queue. An event is built when all the
+ *  queues hold at least one event : it gathers the queue fronts with the
+ *  lowest trigger number. A queue deeper than the max depth drops its
+ *  oldest event, so a lagging producer can not grow it forever. The
+ *  events of a connection unknown to the builder (never connected, or
+ *  disconnected and removed) are dropped.
+ *
+ *  EventT is a (smart) pointer to an event with a GetTriggerN() method,
+ *  i.e eudaq::EventSPC. ConnectionT must be ordered.
+ */
+template <typename ConnectionT, typename EventT>
+class DQMEventBuilder
+{
+public:
+	/** Constructor. A max queue depth of 0 means unbounded
+	 */
+	DQMEventBuilder(size_t maxQueueDepth = 0);
+
+	/** Set the max queue depth, 0 for unbounded
+	 */
+	void setMaxQueueDepth(size_t maxQueueDepth);
+
+	/** A producer connected : start with an empty queue
+	 */
+	void connect(const ConnectionT &connection);
+
+	/** A producer disconnected : its queue is removed once emptied. Its later events
+	 *  are then dropped, so the connection changes must be given in order with the events
+	 */
+	void disconnect(const ConnectionT &connection);
+
+	/** Queue an event received from a connection. If an event can be built,
+	 *  fill its sub events and trigger number and return true
+	 */
+	bool receive(const ConnectionT &connection, const EventT &event, std::vector<EventT> &subEvents, uint32_t &triggerNumber);
+
+	/** Get the queue size of each connection
+	 */
+	void getQueueSizes(std::vector<std::pair<ConnectionT, size_t> > &queueSizes) const;
+
+	/** Get the total number of queued events
+	 */
+	size_t getBacklog() const;
+
+	/** Get the number of events dropped on full queues or from unknown connections
+	 */
+	uint64_t getNDropped() const;
+
+	/** Remove the queued events. The connected producers keep an
+	 *  empty queue, the disconnected ones are removed
+	 */
+	void clear();
+
+private:
+	typedef std::map<ConnectionT, std::deque<EventT> > QueueMap;
+
+	mutable std::mutex          m_mutex;
+	QueueMap                    m_queues;
+	std::set<ConnectionT>       m_inactiveConnections;
+	size_t                      m_maxQueueDepth;
+	std::atomic<uint64_t>       m_nDropped;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline DQMEventBuilder<ConnectionT, EventT>::DQMEventBuilder(size_t maxQueueDepth) :
+	m_maxQueueDepth(maxQueueDepth),
+	m_nDropped(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline void DQMEventBuilder<ConnectionT, EventT>::setMaxQueueDepth(size_t maxQueueDepth)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxQueueDepth = maxQueueDepth;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline void DQMEventBuilder<ConnectionT, EventT>::connect(const ConnectionT &connection)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_queues[connection].clear();
+	m_inactiveConnections.erase(connection);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline void DQMEventBuilder<ConnectionT, EventT>::disconnect(const ConnectionT &connection)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_inactiveConnections.insert(connection);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline bool DQMEventBuilder<ConnectionT, EventT>::receive(const ConnectionT &connection, const EventT &event,
+		std::vector<EventT> &subEvents, uint32_t &triggerNumber)
+{
+	subEvents.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// a late event must not bring a removed connection back : it would block the building
+	typename QueueMap::iterator queueIter = m_queues.find(connection);
+
+	if(m_queues.end() == queueIter)
+	{
+		m_nDropped++;
+		return false;
+	}
+
+	std::deque<EventT> &queue(queueIter->second);
+	queue.push_back(event);
+
+	if(m_maxQueueDepth && queue.size() > m_maxQueueDepth)
+	{
+		queue.pop_front();
+		m_nDropped++;
+	}
+
+	// a disconnected producer with nothing left must not block the others
+	if(!m_inactiveConnections.empty())
+	{
+		for(typename std::set<ConnectionT>::iterator iter = m_inactiveConnections.begin() ; m_inactiveConnections.end() != iter ; )
+		{
+			typename QueueMap::iterator findIter = m_queues.find(*iter);
+
+			if(m_queues.end() == findIter)
+			{
+				iter = m_inactiveConnections.erase(iter);
+			}
+			else if(findIter->second.empty())
+			{
+				m_queues.erase(findIter);
+				iter = m_inactiveConnections.erase(iter);
+			}
+			else
+				++iter;
+		}
+	}
+
+	triggerNumber = static_cast<uint32_t>(-1);
+
+	for(typename QueueMap::const_iterator iter = m_queues.begin(), endIter = m_queues.end() ; endIter != iter ; ++iter)
+	{
+		if(iter->second.empty())
+			return false;
+
+		const uint32_t frontTriggerNumber = iter->second.front()->GetTriggerN();
+
+		if(frontTriggerNumber < triggerNumber)
+			triggerNumber = frontTriggerNumber;
+	}
+
+	for(typename QueueMap::iterator iter = m_queues.begin(), endIter = m_queues.end() ; endIter != iter ; ++iter)
+	{
+		if(iter->second.front()->GetTriggerN() == triggerNumber)
+		{
+			subEvents.push_back(iter->second.front());
+			iter->second.pop_front();
+		}
+	}
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline void DQMEventBuilder<ConnectionT, EventT>::getQueueSizes(std::vector<std::pair<ConnectionT, size_t> > &queueSizes) const
+{
+	queueSizes.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for(typename QueueMap::const_iterator iter = m_queues.begin(), endIter = m_queues.end() ; endIter != iter ; ++iter)
+		queueSizes.push_back(std::make_pair(iter->first, iter->second.size()));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline size_t DQMEventBuilder<ConnectionT, EventT>::getBacklog() const
+{
+	size_t backlog = 0;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for(typename QueueMap::const_iterator iter = m_queues.begin(), endIter = m_queues.end() ; endIter != iter ; ++iter)
+		backlog += iter->second.size();
+
+	return backlog;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline uint64_t DQMEventBuilder<ConnectionT, EventT>::getNDropped() const
+{
+	return m_nDropped;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename ConnectionT, typename EventT>
+inline void DQMEventBuilder<ConnectionT, EventT>::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for(typename std::set<ConnectionT>::const_iterator iter = m_inactiveConnections.begin(), endIter = m_inactiveConnections.end() ;
+			endIter != iter ; ++iter)
+		m_queues.erase(*iter);
+
+	for(typename QueueMap::iterator iter = m_queues.begin(), endIter = m_queues.end() ; endIter != iter ; ++iter)
+		iter->second.clear();
+
+	m_inactiveConnections.clear();
+}
+
+}
+
+#endif  //  DQMEVENTBUILDER_H
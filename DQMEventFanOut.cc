@@ -0,0 +1,278 @@
+/*
+ *
+ * DQMEventFanOut.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMEventFanOut.h"
+#include "DQMThreadTopology.h"
+#include "dqm4hep/DQMEvent.h"
+#include "dqm4hep/DQMEventStreamer.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- xdrstream headers
+#include "xdrstream/BufferDevice.h"
+
+// -- dim headers
+#include "dic.hxx"
+
+namespace dqm4hep
+{
+
+DQMEventFanOut::Collector::Collector(const std::string &collectorName, unsigned int queueSize) :
+	m_commandName("DQM4HEP/EventCollector/" + collectorName + "/COLLECT_RAW_EVENT"),
+	m_queue(queueSize),
+	m_nSent(0),
+	m_nFailed(0),
+	m_nDropped(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMEventFanOut::DQMEventFanOut(const std::vector<std::string> &collectorNames, DQMEventStreamer *pEventStreamer,
+		Policy policy, unsigned int queueSize) :
+	m_pEventStreamer(pEventStreamer),
+	m_policy(policy),
+	m_dropWhenFull(true),
+	m_pThreadTopology(NULL),
+	m_nextCollector(0),
+	m_pDevice(new xdrstream::BufferDevice(1024*1024)),
+	m_pPoolMutex(new std::mutex()),
+	m_pBufferPool(new std::vector<Buffer*>(), [](std::vector<Buffer*> *pBufferPool)
+	{
+		// the last owner may be a released buffer, after the fan out deletion
+		for(std::vector<Buffer*>::iterator iter = pBufferPool->begin(), endIter = pBufferPool->end() ;
+				endIter != iter ; ++iter)
+			delete *iter;
+
+		delete pBufferPool;
+	})
+{
+	for(std::vector<std::string>::const_iterator iter = collectorNames.begin(), endIter = collectorNames.end() ;
+			endIter != iter ; ++iter)
+		m_collectors.push_back(new Collector(*iter, queueSize));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEventFanOut::~DQMEventFanOut()
+{
+	this->stop();
+
+	for(std::vector<Collector*>::iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+			endIter != iter ; ++iter)
+		delete *iter;
+
+	delete m_pDevice;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventFanOut::setDropWhenFull(bool dropWhenFull)
+{
+	m_dropWhenFull = dropWhenFull;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventFanOut::setThreadTopology(const DQMThreadTopology *pThreadTopology)
+{
+	m_pThreadTopology = pThreadTopology;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventFanOut::start()
+{
+	if(m_collectors.empty())
+		return STATUS_CODE_NOT_INITIALIZED;
+
+	for(unsigned int c=0 ; c<m_collectors.size() ; c++)
+	{
+		if(!m_collectors[c]->m_thread.joinable())
+			m_collectors[c]->m_thread = std::thread(&DQMEventFanOut::sendLoop, this, m_collectors[c], c);
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventFanOut::stop()
+{
+	for(std::vector<Collector*>::iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+			endIter != iter ; ++iter)
+		(*iter)->m_queue.close();
+
+	for(std::vector<Collector*>::iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+			endIter != iter ; ++iter)
+	{
+		if((*iter)->m_thread.joinable())
+			(*iter)->m_thread.join();
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventFanOut::sendEvent(const DQMEvent *const pEvent, unsigned int eventNumber)
+{
+	if(NULL == pEvent)
+		return STATUS_CODE_INVALID_PTR;
+
+	if(NULL == m_pEventStreamer)
+		return STATUS_CODE_NOT_INITIALIZED;
+
+	// serialize once for all the collectors
+	m_pDevice->reset();
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pEventStreamer->write(pEvent, m_pDevice));
+
+	return this->sendBuffer(m_pDevice->getBuffer(), m_pDevice->getPosition(), eventNumber);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventFanOut::sendBuffer(const char *const pBuffer, unsigned int bufferSize, unsigned int eventNumber)
+{
+	if(NULL == pBuffer || 0 == bufferSize)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	if(m_collectors.empty())
+		return STATUS_CODE_NOT_INITIALIZED;
+
+	BufferPtr buffer = this->acquireBuffer();
+	buffer->assign(pBuffer, pBuffer + bufferSize);
+
+	switch(m_policy)
+	{
+	case ROUND_ROBIN:
+		this->queue(m_collectors[m_nextCollector], buffer);
+		m_nextCollector = (m_nextCollector + 1) % m_collectors.size();
+		break;
+	case EVENT_NUMBER_HASH:
+		// same event number, same collector
+		this->queue(m_collectors[eventNumber % m_collectors.size()], buffer);
+		break;
+	case DUPLICATE:
+		for(std::vector<Collector*>::iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+				endIter != iter ; ++iter)
+			this->queue(*iter, buffer);
+		break;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventFanOut::report() const
+{
+	for(std::vector<Collector*>::const_iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+			endIter != iter ; ++iter)
+	{
+		LOG4CXX_INFO( dqmMainLogger , (*iter)->m_commandName << " : " << (*iter)->m_nSent << " sent, "
+				<< (*iter)->m_nFailed << " failed, " << (*iter)->m_nDropped << " dropped" );
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMEventFanOut::getQueueSize() const
+{
+	size_t queueSize = 0;
+
+	for(std::vector<Collector*>::const_iterator iter = m_collectors.begin(), endIter = m_collectors.end() ;
+			endIter != iter ; ++iter)
+		queueSize += (*iter)->m_queue.size();
+
+	return queueSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventFanOut::sendLoop(Collector *pCollector, int threadIndex)
+{
+	if(NULL != m_pThreadTopology)
+		m_pThreadTopology->apply(DQMThreadTopology::FAN_OUT, threadIndex);
+
+	BufferPtr buffer;
+
+	while(pCollector->m_queue.pop(buffer))
+	{
+		// blocking send : the collector sets the pace of its own queue
+		if(DimClient::sendCommand(pCollector->m_commandName.c_str(), (void *) &(*buffer)[0], buffer->size()))
+			pCollector->m_nSent++;
+		else
+			pCollector->m_nFailed++;
+
+		buffer.reset();
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventFanOut::queue(Collector *pCollector, const BufferPtr &buffer)
+{
+	if(m_dropWhenFull)
+	{
+		if(!pCollector->m_queue.tryPush(buffer))
+			pCollector->m_nDropped++;
+	}
+	else if(!pCollector->m_queue.push(buffer))
+		pCollector->m_nDropped++;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEventFanOut::BufferPtr DQMEventFanOut::acquireBuffer()
+{
+	Buffer *pBuffer = NULL;
+
+	{
+		std::lock_guard<std::mutex> lock(*m_pPoolMutex);
+
+		if(!m_pBufferPool->empty())
+		{
+			pBuffer = m_pBufferPool->back();
+			m_pBufferPool->pop_back();
+		}
+	}
+
+	if(NULL == pBuffer)
+		pBuffer = new Buffer();
+
+	std::shared_ptr<std::mutex> pPoolMutex(m_pPoolMutex);
+	std::shared_ptr<std::vector<Buffer*> > pBufferPool(m_pBufferPool);
+
+	// back to the pool when the last collector queue releases it
+	return BufferPtr(pBuffer, [pPoolMutex, pBufferPool](Buffer *pReleasedBuffer)
+	{
+		std::lock_guard<std::mutex> lock(*pPoolMutex);
+		pBufferPool->push_back(pReleasedBuffer);
+	});
+}
+
+}
@@ -0,0 +1,162 @@
+/*
+ *
+ * DQMEventFanOut.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEVENTFANOUT_H
+#define DQMEVENTFANOUT_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "DQMBoundedQueue.h"
+
+// -- std headers
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace xdrstream { class BufferDevice; }
+
+namespace dqm4hep
+{
+
+class DQMEvent;
+class DQMEventStreamer;
+class DQMThreadTopology;
+
+/** DQMEventFanOut class
+ *
+ *  Send events to several event collectors. Each event is serialized
+ *  once, then queued to one collector (round robin or event number
+ *  modulo) or to all of them (duplicate). Each collector has its own
+ *  queue and sender thread. By default the events of a collector with
+ *  a full queue are dropped, so a slow collector only loses its own
+ *  events. The serialized buffers are recycled.
+ */
+class DQMEventFanOut
+{
+public:
+	enum Policy
+	{
+		ROUND_ROBIN,
+		EVENT_NUMBER_HASH,
+		DUPLICATE
+	};
+
+	/** Constructor. The streamer is not owned, and may be NULL if
+	 *  only serialized buffers are sent
+	 */
+	DQMEventFanOut(const std::vector<std::string> &collectorNames, DQMEventStreamer *pEventStreamer,
+			Policy policy, unsigned int queueSize = 16);
+
+	/** Destructor. Stop the sender threads
+	 */
+	~DQMEventFanOut();
+
+	/** Whether to drop the events for a collector with a full queue (default) instead of
+	 *  waiting. Waiting blocks the caller, hence all the collectors, on one full queue
+	 */
+	void setDropWhenFull(bool dropWhenFull);
+
+	/** Set the placement of the sender threads (fan-out role), applied when they start.
+	 *  The topology is not owned, may be NULL
+	 */
+	void setThreadTopology(const DQMThreadTopology *pThreadTopology);
+
+	/** Start the sender threads
+	 */
+	StatusCode start();
+
+	/** Send the remaining queued events and stop the sender threads
+	 */
+	StatusCode stop();
+
+	/** Serialize the event and queue it according to the policy
+	 */
+	StatusCode sendEvent(const DQMEvent *const pEvent, unsigned int eventNumber);
+
+	/** Queue an already serialized event according to the policy. The buffer is copied.
+	 *  Return STATUS_CODE_NOT_INITIALIZED when there is no collector
+	 */
+	StatusCode sendBuffer(const char *const pBuffer, unsigned int bufferSize, unsigned int eventNumber);
+
+	/** Log the per collector statistics
+	 */
+	void report() const;
+
+	/** Get the number of events waiting in the collector queues
+	 */
+	size_t getQueueSize() const;
+
+private:
+	typedef std::vector<char> Buffer;
+	typedef std::shared_ptr<Buffer> BufferPtr;
+
+	/** Collector class
+	 */
+	class Collector
+	{
+	public:
+		/** Constructor
+		 */
+		Collector(const std::string &collectorName, unsigned int queueSize);
+
+		std::string                      m_commandName;    ///< The COLLECT_RAW_EVENT command name
+		DQMBoundedQueue<BufferPtr>       m_queue;
+		std::thread                      m_thread;
+		std::atomic<unsigned int>        m_nSent;
+		std::atomic<unsigned int>        m_nFailed;
+		std::atomic<unsigned int>        m_nDropped;
+	};
+
+	/** The sender thread loop of a collector
+	 */
+	void sendLoop(Collector *pCollector, int threadIndex);
+
+	/** Queue a buffer for a collector
+	 */
+	void queue(Collector *pCollector, const BufferPtr &buffer);
+
+	/** Get a buffer from the pool, returned to the pool when released
+	 */
+	BufferPtr acquireBuffer();
+
+private:
+	std::vector<Collector*>          m_collectors;
+	DQMEventStreamer                *m_pEventStreamer;
+	Policy                           m_policy;
+	bool                             m_dropWhenFull;
+	const DQMThreadTopology         *m_pThreadTopology;
+	unsigned int                     m_nextCollector;
+	xdrstream::BufferDevice         *m_pDevice;
+
+	std::shared_ptr<std::mutex>                 m_pPoolMutex;
+	std::shared_ptr<std::vector<Buffer*> >      m_pBufferPool;
+};
+
+}
+
+#endif  //  DQMEVENTFANOUT_H
@@ -0,0 +1,573 @@
+/*
+ *
+ * DQMEventJournal.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMEventJournal.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+// -- system headers
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+namespace dqm4hep
+{
+
+DQMEventJournalWriter::DQMEventJournalWriter() :
+	m_maxSegmentSize(1024*1024*1024),
+	m_maxPendingSize(256*1024*1024),
+	m_pendingSize(0),
+	m_nDroppedBuffers(0),
+	m_stopFlag(true),
+	m_freeSize(0),
+	m_maxFreeSize(16*1024*1024),
+	m_pSegmentFile(NULL),
+	m_segmentNumber(0),
+	m_segmentSize(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEventJournalWriter::~DQMEventJournalWriter()
+{
+	this->close();
+
+	for(std::vector<Record*>::iterator iter = m_freeRecords.begin(), endIter = m_freeRecords.end() ;
+			endIter != iter ; ++iter)
+		delete *iter;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::open(const std::string &directory)
+{
+	if(this->isOpen())
+		return STATUS_CODE_ALREADY_INITIALIZED;
+
+	m_directory = directory;
+	m_segmentNumber = this->findNextSegmentNumber();
+	m_nDroppedBuffers = 0;
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->openSegment());
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = false;
+	}
+
+	m_thread = std::thread(&DQMEventJournalWriter::run, this);
+
+	LOG4CXX_INFO( dqmMainLogger , "Event journal opened in " << m_directory << " from segment " << m_segmentNumber-1 );
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::close()
+{
+	if(!this->isOpen())
+		return STATUS_CODE_SUCCESS;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopFlag = true;
+	}
+
+	m_condition.notify_one();
+	m_thread.join();
+
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->closeSegment());
+
+	LOG4CXX_INFO( dqmMainLogger , "Event journal closed (last segment " << m_segmentNumber-1 << ", "
+			<< m_nDroppedBuffers << " dropped buffer(s))" );
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMEventJournalWriter::isOpen() const
+{
+	return m_thread.joinable();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::string &DQMEventJournalWriter::getDirectory() const
+{
+	return m_directory;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventJournalWriter::setMaxSegmentSize(uint64_t maxSize)
+{
+	m_maxSegmentSize = maxSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventJournalWriter::setMaxPendingSize(uint64_t maxSize)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxPendingSize = maxSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::append(const char *pBuffer, uint32_t bufferSize, uint32_t eventNumber)
+{
+	if(NULL == pBuffer || 0 == bufferSize)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+
+	Record *pRecord = NULL;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_stopFlag)
+			return STATUS_CODE_NOT_INITIALIZED;
+
+		if(m_pendingSize + bufferSize > m_maxPendingSize)
+		{
+			m_nDroppedBuffers++;
+			return STATUS_CODE_OUT_OF_RANGE;
+		}
+
+		if(!m_freeRecords.empty())
+		{
+			pRecord = m_freeRecords.back();
+			m_freeRecords.pop_back();
+			m_freeSize -= pRecord->m_buffer.capacity();
+		}
+
+		m_pendingSize += bufferSize;
+	}
+
+	if(NULL == pRecord)
+		pRecord = new Record();
+
+	// the record buffer keeps its capacity when recycled
+	pRecord->m_header.m_size = bufferSize;
+	pRecord->m_header.m_eventNumber = eventNumber;
+	pRecord->m_header.m_timestamp = timestamp;
+	pRecord->m_buffer.assign(pBuffer, pBuffer + bufferSize);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pendingRecords.push_back(pRecord);
+	}
+
+	m_condition.notify_one();
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMEventJournalWriter::getNDroppedBuffers() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_nDroppedBuffers;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventJournalWriter::run()
+{
+	std::deque<Record*> records;
+
+	while(1)
+	{
+		{
+			// on stop, also wait for the buffers being copied by append()
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]{ return (m_stopFlag && 0 == m_pendingSize) || !m_pendingRecords.empty(); });
+
+			// stop only once everything has been written
+			if(m_pendingRecords.empty() && m_stopFlag)
+				break;
+
+			records.swap(m_pendingRecords);
+		}
+
+		for(std::deque<Record*>::iterator iter = records.begin(), endIter = records.end() ;
+				endIter != iter ; ++iter)
+		{
+			if(STATUS_CODE_SUCCESS != this->writeRecord(**iter))
+				LOG4CXX_ERROR( dqmMainLogger , "Couldn't write event " << (*iter)->m_header.m_eventNumber << " in journal" );
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			for(std::deque<Record*>::iterator iter = records.begin(), endIter = records.end() ;
+					endIter != iter ; ++iter)
+			{
+				m_pendingSize -= (*iter)->m_header.m_size;
+
+				// keep the pool bounded, a burst of large buffers must not stay allocated
+				if(m_freeSize + (*iter)->m_buffer.capacity() > m_maxFreeSize)
+					continue;
+
+				m_freeSize += (*iter)->m_buffer.capacity();
+				m_freeRecords.push_back(*iter);
+				*iter = NULL;
+			}
+		}
+
+		for(std::deque<Record*>::iterator iter = records.begin(), endIter = records.end() ;
+				endIter != iter ; ++iter)
+			delete *iter;
+
+		records.clear();
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMEventJournalWriter::findNextSegmentNumber() const
+{
+	DIR *pDirectory = opendir(m_directory.c_str());
+
+	if(NULL == pDirectory)
+		return 0;
+
+	unsigned int nextSegmentNumber = 0;
+	struct dirent *pEntry = NULL;
+
+	while(NULL != (pEntry = readdir(pDirectory)))
+	{
+		const std::string fileName(pEntry->d_name);
+
+		if(0 != fileName.find("journal_") || fileName.size() <= 13 || ".dqmj" != fileName.substr(fileName.size()-5))
+			continue;
+
+		const std::string number(fileName.substr(8, fileName.size()-13));
+
+		if(std::string::npos != number.find_first_not_of("0123456789"))
+			continue;
+
+		nextSegmentNumber = std::max(nextSegmentNumber, static_cast<unsigned int>(strtoul(number.c_str(), NULL, 10)) + 1);
+	}
+
+	closedir(pDirectory);
+
+	return nextSegmentNumber;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::openSegment()
+{
+	std::stringstream fileName;
+	fileName << m_directory << "/journal_" << std::setw(6) << std::setfill('0') << m_segmentNumber << ".dqmj";
+
+	// exclusive creation : a segment of another session is never truncated
+	m_pSegmentFile = fopen(fileName.str().c_str(), "wbx");
+
+	if(NULL == m_pSegmentFile)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Couldn't open journal segment " << fileName.str() );
+		return STATUS_CODE_FAILURE;
+	}
+
+	// large stdio buffer, the writes are small and sequential
+	setvbuf(m_pSegmentFile, NULL, _IOFBF, 4*1024*1024);
+
+	DQMJournalFileHeader header;
+	header.m_magic = DQMJournal::FILE_MAGIC;
+	header.m_version = DQMJournal::VERSION;
+
+	if(1 != fwrite(&header, sizeof(header), 1, m_pSegmentFile))
+		return STATUS_CODE_FAILURE;
+
+	m_segmentSize = sizeof(header);
+	m_segmentNumber++;
+	m_index.clear();
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::closeSegment()
+{
+	if(NULL == m_pSegmentFile)
+		return STATUS_CODE_SUCCESS;
+
+	DQMJournalIndexFooter footer;
+	footer.m_indexOffset = m_segmentSize;
+	footer.m_nEntries = m_index.size();
+	footer.m_magic = DQMJournal::INDEX_MAGIC;
+	footer.m_padding = 0;
+
+	bool success = (m_index.empty() || m_index.size() == fwrite(&m_index[0], sizeof(DQMJournalIndexEntry), m_index.size(), m_pSegmentFile))
+			&& 1 == fwrite(&footer, sizeof(footer), 1, m_pSegmentFile);
+
+	success = (0 == fclose(m_pSegmentFile)) && success;
+	m_pSegmentFile = NULL;
+
+	return success ? STATUS_CODE_SUCCESS : STATUS_CODE_FAILURE;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalWriter::writeRecord(const Record &record)
+{
+	const uint64_t recordSize = sizeof(DQMJournalRecordHeader) + record.m_header.m_size;
+
+	if(!m_index.empty() && m_segmentSize + recordSize > m_maxSegmentSize)
+	{
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->closeSegment());
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->openSegment());
+	}
+
+	if(1 != fwrite(&record.m_header, sizeof(DQMJournalRecordHeader), 1, m_pSegmentFile)
+	|| 1 != fwrite(&record.m_buffer[0], record.m_header.m_size, 1, m_pSegmentFile))
+		return STATUS_CODE_FAILURE;
+
+	DQMJournalIndexEntry entry;
+	entry.m_offset = m_segmentSize + sizeof(DQMJournalRecordHeader);
+	entry.m_size = record.m_header.m_size;
+	entry.m_eventNumber = record.m_header.m_eventNumber;
+	entry.m_timestamp = record.m_header.m_timestamp;
+	m_index.push_back(entry);
+
+	m_segmentSize += recordSize;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMEventJournalReader::DQMEventJournalReader()
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEventJournalReader::~DQMEventJournalReader()
+{
+	this->close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalReader::open(const std::string &fileName)
+{
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+
+	if(fd < 0)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Couldn't open journal segment " << fileName );
+		return STATUS_CODE_NOT_FOUND;
+	}
+
+	struct stat fileStat;
+
+	if(0 != fstat(fd, &fileStat) || static_cast<size_t>(fileStat.st_size) < sizeof(DQMJournalFileHeader))
+	{
+		::close(fd);
+		return STATUS_CODE_INVALID_PARAMETER;
+	}
+
+	size_t segmentSize = fileStat.st_size;
+	char *pSegment = static_cast<char*>(mmap(NULL, segmentSize, PROT_READ, MAP_PRIVATE, fd, 0));
+	::close(fd);
+
+	if(MAP_FAILED == pSegment)
+		return STATUS_CODE_FAILURE;
+
+	m_mappings.push_back(Mapping(pSegment, segmentSize));
+
+	const DQMJournalFileHeader *pHeader = reinterpret_cast<const DQMJournalFileHeader*>(pSegment);
+
+	if(DQMJournal::FILE_MAGIC != pHeader->m_magic || DQMJournal::VERSION != pHeader->m_version)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , fileName << " is not a journal segment" );
+		return STATUS_CODE_INVALID_PARAMETER;
+	}
+
+	const DQMJournalIndexFooter *pFooter = reinterpret_cast<const DQMJournalIndexFooter*>(pSegment + segmentSize - sizeof(DQMJournalIndexFooter));
+
+	if(segmentSize < sizeof(DQMJournalFileHeader) + sizeof(DQMJournalIndexFooter) || DQMJournal::INDEX_MAGIC != pFooter->m_magic
+	|| pFooter->m_indexOffset + pFooter->m_nEntries*sizeof(DQMJournalIndexEntry) + sizeof(DQMJournalIndexFooter) != segmentSize)
+	{
+		LOG4CXX_WARN( dqmMainLogger , "No index in journal segment " << fileName << ", recovering it" );
+		return this->recoverIndex(pSegment, segmentSize);
+	}
+
+	const DQMJournalIndexEntry *pIndex = reinterpret_cast<const DQMJournalIndexEntry*>(pSegment + pFooter->m_indexOffset);
+	m_entries.reserve(m_entries.size() + pFooter->m_nEntries);
+
+	for(uint64_t i=0 ; i<pFooter->m_nEntries ; i++)
+	{
+		Entry entry;
+		entry.m_pBuffer = pSegment + pIndex[i].m_offset;
+		entry.m_size = pIndex[i].m_size;
+		entry.m_eventNumber = pIndex[i].m_eventNumber;
+		entry.m_timestamp = pIndex[i].m_timestamp;
+		m_entries.push_back(entry);
+	}
+
+	// replay reads the segment front to back
+	madvise(pSegment, segmentSize, MADV_SEQUENTIAL);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalReader::openDirectory(const std::string &directory)
+{
+	DIR *pDirectory = opendir(directory.c_str());
+
+	if(NULL == pDirectory)
+		return STATUS_CODE_NOT_FOUND;
+
+	std::vector<std::string> fileNames;
+	struct dirent *pEntry = NULL;
+
+	while(NULL != (pEntry = readdir(pDirectory)))
+	{
+		std::string fileName(pEntry->d_name);
+
+		if(0 == fileName.find("journal_") && fileName.size() > 5 && ".dqmj" == fileName.substr(fileName.size()-5))
+			fileNames.push_back(directory + "/" + fileName);
+	}
+
+	closedir(pDirectory);
+
+	// zero padded segment numbers
+	std::sort(fileNames.begin(), fileNames.end());
+
+	for(std::vector<std::string>::iterator iter = fileNames.begin(), endIter = fileNames.end() ;
+			endIter != iter ; ++iter)
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->open(*iter));
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventJournalReader::close()
+{
+	for(std::vector<Mapping>::iterator iter = m_mappings.begin(), endIter = m_mappings.end() ;
+			endIter != iter ; ++iter)
+		munmap(iter->first, iter->second);
+
+	m_mappings.clear();
+	m_entries.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMEventJournalReader::getNEntries() const
+{
+	return m_entries.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const DQMEventJournalReader::Entry &DQMEventJournalReader::getEntry(size_t index) const
+{
+	return m_entries.at(index);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalReader::replay(size_t first, size_t last, float speedFactor, ReplayFunction function) const
+{
+	if(m_entries.empty() || first > last || last >= m_entries.size() || speedFactor < 0.f)
+		return STATUS_CODE_OUT_OF_RANGE;
+
+	const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const int64_t firstTimestamp = m_entries[first].m_timestamp;
+
+	for(size_t i=first ; i<=last ; i++)
+	{
+		const Entry &entry = m_entries[i];
+
+		// pace from the start of the replay, not from the previous entry, so that errors do not accumulate
+		if(speedFactor > 0.f)
+		{
+			std::chrono::nanoseconds offset(static_cast<int64_t>((entry.m_timestamp - firstTimestamp) / speedFactor));
+			std::this_thread::sleep_until(startTime + offset);
+		}
+
+		if(!function(entry))
+			break;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventJournalReader::recoverIndex(const char *pSegment, size_t segmentSize)
+{
+	size_t offset = sizeof(DQMJournalFileHeader);
+
+	while(offset + sizeof(DQMJournalRecordHeader) <= segmentSize)
+	{
+		const DQMJournalRecordHeader *pHeader = reinterpret_cast<const DQMJournalRecordHeader*>(pSegment + offset);
+		offset += sizeof(DQMJournalRecordHeader);
+
+		// truncated last record
+		if(0 == pHeader->m_size || offset + pHeader->m_size > segmentSize)
+			break;
+
+		Entry entry;
+		entry.m_pBuffer = pSegment + offset;
+		entry.m_size = pHeader->m_size;
+		entry.m_eventNumber = pHeader->m_eventNumber;
+		entry.m_timestamp = pHeader->m_timestamp;
+		m_entries.push_back(entry);
+
+		offset += pHeader->m_size;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
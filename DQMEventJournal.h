@@ -0,0 +1,270 @@
+/*
+ *
+ * DQMEventJournal.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEVENTJOURNAL_H
+#define DQMEVENTJOURNAL_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+
+namespace dqm4hep
+{
+
+/** Journal segment layout (all integers in host byte order) :
+ *
+ *   [file header] [record header][raw buffer] ... [index entries] [index footer]
+ *
+ *  The index is written when the segment is closed. A segment without
+ *  index (crash) is recovered by walking the record headers.
+ */
+struct DQMJournalFileHeader
+{
+	uint32_t     m_magic;          ///< DQMJournal::FILE_MAGIC
+	uint32_t     m_version;        ///< DQMJournal::VERSION
+};
+
+struct DQMJournalRecordHeader
+{
+	uint32_t     m_size;           ///< The raw buffer size
+	uint32_t     m_eventNumber;    ///< The event number (reception sequence)
+	int64_t      m_timestamp;      ///< The reception time (unit nsec, system clock)
+};
+
+struct DQMJournalIndexEntry
+{
+	uint64_t     m_offset;         ///< The raw buffer offset in the segment
+	uint32_t     m_size;           ///< The raw buffer size
+	uint32_t     m_eventNumber;    ///< The event number
+	int64_t      m_timestamp;      ///< The reception time (unit nsec)
+};
+
+struct DQMJournalIndexFooter
+{
+	uint64_t     m_indexOffset;    ///< The offset of the first index entry
+	uint64_t     m_nEntries;       ///< The number of index entries
+	uint32_t     m_magic;          ///< DQMJournal::INDEX_MAGIC
+	uint32_t     m_padding;
+};
+
+namespace DQMJournal
+{
+	static const uint32_t FILE_MAGIC  = 0x4a4d5144;   // "DQMJ"
+	static const uint32_t INDEX_MAGIC = 0x494d5144;   // "DQMI"
+	static const uint32_t VERSION     = 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMEventJournalWriter class
+ *
+ *  Append raw event buffers to segmented journal files. The buffers are
+ *  copied in the caller thread and written by a background thread, so
+ *  that the event reception never waits on the disk.
+ */
+class DQMEventJournalWriter
+{
+public:
+	/** Constructor
+	 */
+	DQMEventJournalWriter();
+
+	/** Destructor. Close the journal
+	 */
+	~DQMEventJournalWriter();
+
+	/** Open the journal in the given directory. Segments are named journal_<n>.dqmj.
+	 *  The numbering goes on after the segments already in the directory (i.e of a
+	 *  previous session), which are never overwritten
+	 */
+	StatusCode open(const std::string &directory);
+
+	/** Flush the pending buffers, write the index of the current segment and stop
+	 */
+	StatusCode close();
+
+	/** Whether the journal is open
+	 */
+	bool isOpen() const;
+
+	/** Get the directory of the journal
+	 */
+	const std::string &getDirectory() const;
+
+	/** Set the maximum segment size before switching to a new file (unit bytes)
+	 */
+	void setMaxSegmentSize(uint64_t maxSize);
+
+	/** Set the maximum size of the buffers waiting to be written (unit bytes).
+	 *  Buffers are dropped above this limit
+	 */
+	void setMaxPendingSize(uint64_t maxSize);
+
+	/** Append a raw buffer to the journal
+	 */
+	StatusCode append(const char *pBuffer, uint32_t bufferSize, uint32_t eventNumber);
+
+	/** Get the number of buffers dropped because the writer was late
+	 */
+	uint64_t getNDroppedBuffers() const;
+
+private:
+	/** Record class
+	 */
+	class Record
+	{
+	public:
+		DQMJournalRecordHeader     m_header;
+		std::vector<char>          m_buffer;
+	};
+
+	/** The background thread loop
+	 */
+	void run();
+
+	/** Find the number following the highest segment number in the journal directory
+	 */
+	unsigned int findNextSegmentNumber() const;
+
+	/** Open a new segment file
+	 */
+	StatusCode openSegment();
+
+	/** Write the index and close the current segment file
+	 */
+	StatusCode closeSegment();
+
+	/** Write a record in the current segment
+	 */
+	StatusCode writeRecord(const Record &record);
+
+private:
+	std::string                        m_directory;
+	uint64_t                           m_maxSegmentSize;
+	uint64_t                           m_maxPendingSize;
+	uint64_t                           m_pendingSize;
+	uint64_t                           m_nDroppedBuffers;
+	bool                               m_stopFlag;
+
+	mutable std::mutex                 m_mutex;
+	std::condition_variable            m_condition;
+	std::deque<Record*>                m_pendingRecords;
+	std::vector<Record*>               m_freeRecords;      ///< Recycled records, avoid allocations per event
+	uint64_t                           m_freeSize;         ///< The buffer capacity kept by the recycled records
+	uint64_t                           m_maxFreeSize;      ///< Records above this capacity are released
+	std::thread                        m_thread;
+
+	// writer thread only
+	FILE                              *m_pSegmentFile;
+	unsigned int                       m_segmentNumber;
+	uint64_t                           m_segmentSize;
+	std::vector<DQMJournalIndexEntry>  m_index;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMEventJournalReader class
+ *
+ *  Memory map journal segments and give a direct access to
+ *  the raw buffers through the segment indices
+ */
+class DQMEventJournalReader
+{
+public:
+	/** Entry class
+	 */
+	class Entry
+	{
+	public:
+		const char    *m_pBuffer;        ///< The raw buffer, in the mapped segment
+		uint32_t       m_size;           ///< The raw buffer size
+		uint32_t       m_eventNumber;    ///< The event number
+		int64_t        m_timestamp;      ///< The reception time (unit nsec)
+	};
+
+	/** Callback called for each replayed entry. Return false to stop the replay
+	 */
+	typedef std::function<bool(const Entry &)> ReplayFunction;
+
+	/** Constructor
+	 */
+	DQMEventJournalReader();
+
+	/** Destructor. Unmap the segments
+	 */
+	~DQMEventJournalReader();
+
+	/** Map a segment file and append its entries
+	 */
+	StatusCode open(const std::string &fileName);
+
+	/** Map all the segment files of a journal directory, in segment order
+	 */
+	StatusCode openDirectory(const std::string &directory);
+
+	/** Unmap all the segments
+	 */
+	void close();
+
+	/** Get the number of entries
+	 */
+	size_t getNEntries() const;
+
+	/** Get an entry
+	 */
+	const Entry &getEntry(size_t index) const;
+
+	/** Replay the entries [first, last]. With a speed factor of 1 the original
+	 *  time spacing is reproduced, n replays n times faster, 0 replays at max speed
+	 */
+	StatusCode replay(size_t first, size_t last, float speedFactor, ReplayFunction function) const;
+
+private:
+	/** Build the entries of a segment without index by walking the record headers
+	 */
+	StatusCode recoverIndex(const char *pSegment, size_t segmentSize);
+
+private:
+	typedef std::pair<char*, size_t> Mapping;
+
+	std::vector<Mapping>               m_mappings;
+	std::vector<Entry>                 m_entries;
+};
+
+}
+
+#endif  //  DQMEVENTJOURNAL_H
@@ -0,0 +1,201 @@
+/*
+ *
+ * DQMEventPacer.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMEventPacer.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <thread>
+
+namespace dqm4hep
+{
+
+DQMEventPacer::DQMEventPacer(Mode mode) :
+	m_mode(mode),
+	m_speedFactor(1.f),
+	m_targetRate(1.f),
+	m_reportPeriod(10),
+	m_maxLag(1000),
+	m_nEvents(0),
+	m_nStalls(0),
+	m_scheduleOffset(0),
+	m_lastTimeStamp(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventPacer::setSpeedFactor(float speedFactor)
+{
+	if(speedFactor <= 0.f)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	m_speedFactor = speedFactor;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEventPacer::setTargetRate(float targetRate)
+{
+	if(targetRate <= 0.f)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	m_targetRate = targetRate;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventPacer::setReportPeriod(unsigned int reportPeriod)
+{
+	m_reportPeriod = reportPeriod;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventPacer::setMaxLag(unsigned int maxLag)
+{
+	m_maxLag = std::chrono::milliseconds(maxLag);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventPacer::pace(int64_t timeStamp)
+{
+	Clock::time_point now = Clock::now();
+
+	if(0 == m_nEvents)
+	{
+		m_startTime = now;
+		m_anchorTime = now;
+		m_lastReportTime = now;
+		m_scheduleOffset = std::chrono::nanoseconds(0);
+		m_lastTimeStamp = timeStamp;
+	}
+	else if(MAX_RATE != m_mode)
+	{
+		if(ORIGINAL_TIMING == m_mode)
+		{
+			// time stamps going backward (new file, new run) : send right away
+			int64_t timeStampDifference = timeStamp > m_lastTimeStamp ? timeStamp - m_lastTimeStamp : 0;
+			m_scheduleOffset += std::chrono::nanoseconds(static_cast<int64_t>(timeStampDifference / m_speedFactor));
+			m_lastTimeStamp = timeStamp;
+		}
+		else
+			m_scheduleOffset = std::chrono::nanoseconds(static_cast<int64_t>(m_nEvents * 1e9 / m_targetRate));
+
+		Clock::time_point scheduledTime = m_anchorTime + m_scheduleOffset;
+
+		if(scheduledTime > now)
+			std::this_thread::sleep_until(scheduledTime);
+		else if(m_maxLag.count() > 0 && now - scheduledTime > m_maxLag)
+		{
+			// stall : resume the schedule from now rather than bursting
+			m_anchorTime += now - scheduledTime;
+			m_nStalls++;
+		}
+	}
+
+	m_nEvents++;
+	m_lastEventTime = Clock::now();
+
+	if(0 != m_reportPeriod && m_lastEventTime - m_lastReportTime >= std::chrono::seconds(m_reportPeriod))
+	{
+		this->report();
+		m_lastReportTime = m_lastEventTime;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEventPacer::Mode DQMEventPacer::getMode() const
+{
+	return m_mode;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMEventPacer::getNEvents() const
+{
+	return m_nEvents;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMEventPacer::getNStalls() const
+{
+	return m_nStalls;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMEventPacer::getAchievedRate() const
+{
+	if(m_nEvents < 2)
+		return 0.;
+
+	double elapsed = std::chrono::duration<double>(m_lastEventTime - m_startTime).count();
+
+	return elapsed > 0. ? (m_nEvents-1) / elapsed : 0.;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMEventPacer::getRequestedRate() const
+{
+	if(MAX_RATE == m_mode || m_nEvents < 2)
+		return 0.;
+
+	if(CONSTANT_RATE == m_mode)
+		return m_targetRate;
+
+	double scheduled = std::chrono::duration<double>(m_scheduleOffset).count();
+
+	return scheduled > 0. ? (m_nEvents-1) / scheduled : 0.;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMEventPacer::report() const
+{
+	if(MAX_RATE == m_mode)
+	{
+		LOG4CXX_INFO( dqmMainLogger , "Pacer : " << m_nEvents << " events, achieved rate " << this->getAchievedRate() << " Hz (max rate)" );
+		return;
+	}
+
+	double requestedRate = this->getRequestedRate();
+	double achievedRate = this->getAchievedRate();
+
+	LOG4CXX_INFO( dqmMainLogger , "Pacer : " << m_nEvents << " events, achieved rate " << achievedRate
+			<< " Hz, requested " << requestedRate << " Hz ("
+			<< (requestedRate > 0. ? 100. * achievedRate / requestedRate : 0.) << " %), " << m_nStalls << " stall(s)" );
+}
+
+}
@@ -0,0 +1,134 @@
+/*
+ *
+ * DQMEventPacer.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEVENTPACER_H
+#define DQMEVENTPACER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <chrono>
+#include <cstdint>
+
+namespace dqm4hep
+{
+
+/** DQMEventPacer class
+ *
+ *  Decide when the next event can be sent. Three modes :
+ *   - ORIGINAL_TIMING : reproduce the spacing of the event time stamps,
+ *     divided by a speed factor
+ *   - CONSTANT_RATE : send at a fixed rate
+ *   - MAX_RATE : no throttling
+ *
+ *  The send times are computed from the start of the replay (and not from
+ *  the previous event), so sleep jitter and send time do not accumulate.
+ *  When the sender falls behind, the events are sent as fast as possible
+ *  until the schedule is caught up. After a stall longer than the maximum
+ *  lag, the schedule is re-anchored on the current time instead, so that
+ *  the late events are not replayed back-to-back.
+ */
+class DQMEventPacer
+{
+public:
+	enum Mode
+	{
+		ORIGINAL_TIMING,
+		CONSTANT_RATE,
+		MAX_RATE
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	/** Constructor
+	 */
+	DQMEventPacer(Mode mode);
+
+	/** Set the speed factor for the original timing mode (2 : twice faster)
+	 */
+	StatusCode setSpeedFactor(float speedFactor);
+
+	/** Set the target rate for the constant rate mode (unit Hz)
+	 */
+	StatusCode setTargetRate(float targetRate);
+
+	/** Set the period between two rate reports (unit sec), 0 to disable the reports
+	 */
+	void setReportPeriod(unsigned int reportPeriod);
+
+	/** Set the maximum lag caught up after a stall (unit msec), 0 to always catch up
+	 */
+	void setMaxLag(unsigned int maxLag);
+
+	/** Wait until the event with the given time stamp can be sent (unit nsec,
+	 *  only used in original timing mode)
+	 */
+	void pace(int64_t timeStamp);
+
+	/** Get the mode
+	 */
+	Mode getMode() const;
+
+	/** Get the number of paced events
+	 */
+	uint64_t getNEvents() const;
+
+	/** Get the number of times the schedule was re-anchored after a stall
+	 */
+	uint64_t getNStalls() const;
+
+	/** Get the achieved rate since the first event (unit Hz)
+	 */
+	double getAchievedRate() const;
+
+	/** Get the requested rate since the first event (unit Hz), 0 in max rate mode
+	 */
+	double getRequestedRate() const;
+
+	/** Log the achieved vs requested rates
+	 */
+	void report() const;
+
+private:
+	Mode                       m_mode;
+	float                      m_speedFactor;
+	float                      m_targetRate;
+	unsigned int               m_reportPeriod;
+	std::chrono::milliseconds  m_maxLag;
+
+	uint64_t                   m_nEvents;
+	uint64_t                   m_nStalls;
+	Clock::time_point          m_startTime;
+	Clock::time_point          m_anchorTime;         ///< The origin of the schedule, moved forward after a stall
+	Clock::time_point          m_lastEventTime;
+	Clock::time_point          m_lastReportTime;
+	std::chrono::nanoseconds   m_scheduleOffset;     ///< The scheduled time of the last event since start
+	int64_t                    m_lastTimeStamp;
+};
+
+}
+
+#endif  //  DQMEVENTPACER_H
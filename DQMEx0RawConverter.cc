@@ -0,0 +1,117 @@
+/*
+ *
+ * DQMEx0RawConverter.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMEx0RawConverter.h"
+#include "DQMBulkLCEventWriter.h"
+#include "dqm4hep/DQMPluginManager.h"
+
+// -- lcio headers
+#include "EVENT/LCIO.h"
+#include "IMPL/LCParametersImpl.h"
+
+// -- eudaq headers
+#include "eudaq/Event.hh"
+
+namespace dqm4hep
+{
+
+static const std::string DQMEx0RawConverter_cellIdEncoding = "x:8,y:8,plane:16";
+static const uint32_t DQMEx0RawConverter_maxPlaneId = 0xffff;
+
+DQM_PLUGIN_DECL( DQMEx0RawConverter , "Ex0RawConverter" )
+
+DQMEx0RawConverter::DQMEx0RawConverter() :
+	m_pParameters(new IMPL::LCParametersImpl())
+{
+	m_pParameters->setValue(EVENT::LCIO::CellIDEncoding, DQMEx0RawConverter_cellIdEncoding);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMEx0RawConverter::~DQMEx0RawConverter()
+{
+	delete m_pParameters;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMEx0RawConverter::convert(const eudaq::Event &event, DQMBulkLCEventWriter &writer)
+{
+	size_t nHits = 0;
+
+	const std::vector<uint32_t> blockNumbers(event.GetBlockNumList());
+
+	for(std::vector<uint32_t>::const_iterator iter = blockNumbers.begin(), endIter = blockNumbers.end() ;
+			endIter != iter ; ++iter)
+	{
+		const std::vector<uint8_t> block(event.GetBlock(*iter));
+
+		if(block.size() < 2 || *iter > DQMEx0RawConverter_maxPlaneId)
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		const uint32_t nPixelsX = block[0];
+		const uint32_t nPixelsY = block[1];
+
+		if(block.size() != 2 + nPixelsX*nPixelsY)
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		// room for all the pixels of the plane, the capacity is kept from one event to the next
+		m_arrays.resize(nHits + nPixelsX*nPixelsY);
+
+		const uint8_t *pPixel = &block[2];
+
+		for(uint32_t y = 0 ; y < nPixelsY ; y++)
+		{
+			for(uint32_t x = 0 ; x < nPixelsX ; x++, pPixel++)
+			{
+				if(0 == *pPixel)
+					continue;
+
+				m_arrays.m_cellIds0[nHits] = static_cast<int32_t>(x | (y << 8) | (*iter << 16));
+				m_arrays.m_amplitudes[nHits] = *pPixel;
+				m_arrays.m_timeStamps[nHits] = 0;
+				nHits++;
+			}
+		}
+	}
+
+	m_arrays.resize(nHits);
+
+	return writer.addCollection<EVENT::RawCalorimeterHit>(this->getCollectionName(event.GetStreamN()), 0, m_pParameters, m_arrays);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::string &DQMEx0RawConverter::getCollectionName(uint32_t streamNumber)
+{
+	CollectionNameMap::iterator findIter = m_collectionNames.find(streamNumber);
+
+	if(m_collectionNames.end() != findIter)
+		return findIter->second;
+
+	return m_collectionNames.insert(CollectionNameMap::value_type(streamNumber, "Ex0RawHits_" + std::to_string(streamNumber))).first->second;
+}
+
+}
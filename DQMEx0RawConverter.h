@@ -0,0 +1,82 @@
+/*
+ *
+ * DQMEx0RawConverter.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMEX0RAWCONVERTER_H
+#define DQMEX0RAWCONVERTER_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "DQMEudaqConverter.h"
+#include "DQMXdrBulkCodec.h"
+
+// -- std headers
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace IMPL { class LCParametersImpl; }
+
+namespace dqm4hep
+{
+
+/** DQMEx0RawConverter class
+ *
+ *  Converter of the eudaq example producer events ("Ex0Raw", also as
+ *  sub events of the built "Ex0Tg" events). Each raw block is a plane,
+ *  the block number being the plane id : the number of pixels in x and
+ *  y (one byte each), then one byte per pixel, x running fastest.
+ *  The non zero pixels are written as raw calorimeter hits, the pixel
+ *  value being the amplitude, in a "Ex0RawHits_<stream number>"
+ *  collection with the cell id encoding "x:8,y:8,plane:16".
+ *  Plugin "Ex0RawConverter"
+ */
+class DQMEx0RawConverter : public DQMEudaqConverter
+{
+public:
+	/** Constructor
+	 */
+	DQMEx0RawConverter();
+
+	/** Destructor
+	 */
+	~DQMEx0RawConverter();
+
+	StatusCode convert(const eudaq::Event &event, DQMBulkLCEventWriter &writer);
+
+private:
+	/** Get the collection name of a producer stream
+	 */
+	const std::string &getCollectionName(uint32_t streamNumber);
+
+	typedef std::map<uint32_t, std::string> CollectionNameMap;
+
+	DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::Arrays     m_arrays;            ///< Kept from one event to the next
+	IMPL::LCParametersImpl                               *m_pParameters;       ///< The cell id encoding
+	CollectionNameMap                                     m_collectionNames;
+};
+
+}
+
+#endif  //  DQMEX0RAWCONVERTER_H
@@ -0,0 +1,264 @@
+/*
+ *
+ * DQMLcioStreamPipeline.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMLcioStreamPipeline.h"
+#include "DQMXdrEventSource.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <exception>
+
+// -- xdrstream headers
+#include "xdrstream/BufferDevice.h"
+
+// -- xdrlcio headers
+#include "xdrlcio/XdrLcio.h"
+
+namespace dqm4hep
+{
+
+DQMLcioStreamPipeline::DQMLcioStreamPipeline(DQMXdrEventSource *pSource, PublishFunction publishFunction, unsigned int nSlots) :
+	m_pSource(pSource),
+	m_publishFunction(publishFunction),
+	m_slots(nSlots ? nSlots : 1),
+	m_freeSlots(m_slots.size()),
+	m_readSlots(m_slots.size()),
+	m_decodedSlots(m_slots.size()),
+	m_stopFlag(false),
+	m_statusCode(STATUS_CODE_SUCCESS),
+	m_nPublishedEvents(0)
+{
+	for(std::vector<Slot>::iterator iter = m_slots.begin(), endIter = m_slots.end() ;
+			endIter != iter ; ++iter)
+	{
+		// the device only points to the source memory
+		iter->m_pDevice = new xdrstream::BufferDevice(0);
+		iter->m_pDevice->setOwner(false);
+		iter->m_pXdrLcio = new xdrlcio::XdrLcio();
+		iter->m_pLCEvent = NULL;
+
+		m_freeSlots.push(&*iter);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMLcioStreamPipeline::~DQMLcioStreamPipeline()
+{
+	for(std::vector<Slot>::iterator iter = m_slots.begin(), endIter = m_slots.end() ;
+			endIter != iter ; ++iter)
+	{
+		delete iter->m_pXdrLcio;
+		delete iter->m_pDevice;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMLcioStreamPipeline::run()
+{
+	std::thread readThread;
+	std::thread decodeThread;
+
+	try
+	{
+		readThread = std::thread(&DQMLcioStreamPipeline::readLoop, this);
+		decodeThread = std::thread(&DQMLcioStreamPipeline::decodeLoop, this);
+
+		// publish from the caller thread, the event client may not like foreign threads
+		this->publishLoop();
+	}
+	catch(...)
+	{
+		// the stage threads must be joined before leaving, whatever happened
+		this->abort(STATUS_CODE_FAILURE);
+
+		if(readThread.joinable())
+			readThread.join();
+
+		if(decodeThread.joinable())
+			decodeThread.join();
+
+		throw;
+	}
+
+	readThread.join();
+	decodeThread.join();
+
+	return static_cast<StatusCode>(m_statusCode.load());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLcioStreamPipeline::stop()
+{
+	m_stopFlag = true;
+
+	m_freeSlots.close();
+	m_readSlots.close();
+	m_decodedSlots.close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMLcioStreamPipeline::getNPublishedEvents() const
+{
+	return m_nPublishedEvents;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLcioStreamPipeline::readLoop()
+{
+	Slot *pSlot = NULL;
+
+	try
+	{
+		while(!m_stopFlag && m_freeSlots.pop(pSlot))
+		{
+			StatusCode statusCode = m_pSource->readNextRecord(pSlot->m_pDevice);
+
+			if(STATUS_CODE_OUT_OF_RANGE == statusCode)
+				break;
+
+			if(STATUS_CODE_SUCCESS != statusCode)
+			{
+				LOG4CXX_ERROR( dqmMainLogger , "Couldn't read next event record : " << statusCode );
+				this->abort(statusCode);
+				break;
+			}
+
+			if(!m_readSlots.push(pSlot))
+				break;
+		}
+	}
+	catch(std::exception &exception)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Exception caught while reading event record : " << exception.what() );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+	catch(...)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Unknown exception caught while reading event record" );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+
+	// end of source : let the next stages drain
+	m_readSlots.close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLcioStreamPipeline::decodeLoop()
+{
+	Slot *pSlot = NULL;
+
+	try
+	{
+		while(m_readSlots.pop(pSlot))
+		{
+			xdrstream::Status status = pSlot->m_pXdrLcio->readNextEvent(pSlot->m_pDevice);
+
+			if(xdrstream::XDR_SUCCESS != status)
+			{
+				LOG4CXX_ERROR( dqmMainLogger , "Couldn't decode event record" );
+				xdrstream::printStatus( status );
+				this->abort(STATUS_CODE_FAILURE);
+				break;
+			}
+
+			pSlot->m_pLCEvent = pSlot->m_pXdrLcio->getLCEvent();
+			pSlot->m_pXdrLcio->readStream();
+
+			if(!m_decodedSlots.push(pSlot))
+				break;
+		}
+	}
+	catch(std::exception &exception)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Exception caught while decoding event record : " << exception.what() );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+	catch(...)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Unknown exception caught while decoding event record" );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+
+	m_decodedSlots.close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLcioStreamPipeline::publishLoop()
+{
+	Slot *pSlot = NULL;
+
+	try
+	{
+		while(m_decodedSlots.pop(pSlot))
+		{
+			if(NULL != pSlot->m_pLCEvent)
+				m_publishFunction(pSlot->m_pLCEvent);
+
+			m_nPublishedEvents++;
+
+			// the event belongs to the slot reader, release it with the slot
+			pSlot->m_pLCEvent = NULL;
+
+			if(!m_freeSlots.push(pSlot))
+				break;
+		}
+	}
+	catch(StatusCodeException &exception)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "StatusCodeException caught while publishing event : " << exception.toString() );
+		this->abort(exception.getStatusCode());
+	}
+	catch(std::exception &exception)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Exception caught while publishing event : " << exception.what() );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+	catch(...)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Unknown exception caught while publishing event" );
+		this->abort(STATUS_CODE_FAILURE);
+	}
+
+	m_freeSlots.close();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLcioStreamPipeline::abort(StatusCode statusCode)
+{
+	int expected = STATUS_CODE_SUCCESS;
+	m_statusCode.compare_exchange_strong(expected, statusCode);
+
+	this->stop();
+}
+
+}
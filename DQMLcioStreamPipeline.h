@@ -0,0 +1,126 @@
+/*
+ *
+ * DQMLcioStreamPipeline.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMLCIOSTREAMPIPELINE_H
+#define DQMLCIOSTREAMPIPELINE_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "DQMBoundedQueue.h"
+
+// -- lcio headers
+#include "EVENT/LCEvent.h"
+
+// -- std headers
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace xdrstream { class BufferDevice; }
+namespace xdrlcio { class XdrLcio; }
+
+namespace dqm4hep
+{
+
+class DQMXdrEventSource;
+
+/** DQMLcioStreamPipeline class
+ *
+ *  Three stage pipeline for the lcio stream service :
+ *   - read : get the next raw record from the source
+ *   - decode : decode the record in a lcio event
+ *   - publish : hand the event over to the publish function
+ *
+ *  Each stage runs in its own thread. The events travel in slots
+ *  (buffer device, xdr lcio reader, event) allocated once and
+ *  recycled after publication, so the number of slots bounds the
+ *  number of events in flight and nothing is allocated per event.
+ */
+class DQMLcioStreamPipeline
+{
+public:
+	/** The publish function. The event is only valid during the call
+	 */
+	typedef std::function<void(EVENT::LCEvent *)> PublishFunction;
+
+	/** Constructor. The source is not owned
+	 */
+	DQMLcioStreamPipeline(DQMXdrEventSource *pSource, PublishFunction publishFunction, unsigned int nSlots = 8);
+
+	/** Destructor
+	 */
+	~DQMLcioStreamPipeline();
+
+	/** Run the pipeline until the end of the source, an error or a call to stop()
+	 */
+	StatusCode run();
+
+	/** Stop the pipeline. Can be called from any thread
+	 */
+	void stop();
+
+	/** Get the number of published events
+	 */
+	unsigned int getNPublishedEvents() const;
+
+private:
+	/** Slot class
+	 */
+	class Slot
+	{
+	public:
+		xdrstream::BufferDevice      *m_pDevice;
+		xdrlcio::XdrLcio             *m_pXdrLcio;
+		EVENT::LCEvent               *m_pLCEvent;
+	};
+
+	typedef DQMBoundedQueue<Slot*> SlotQueue;
+
+	void readLoop();
+	void decodeLoop();
+	void publishLoop();
+
+	/** Record the first error and stop all the stages
+	 */
+	void abort(StatusCode statusCode);
+
+private:
+	DQMXdrEventSource            *m_pSource;
+	PublishFunction               m_publishFunction;
+	std::vector<Slot>             m_slots;
+
+	SlotQueue                     m_freeSlots;
+	SlotQueue                     m_readSlots;
+	SlotQueue                     m_decodedSlots;
+
+	std::atomic<bool>             m_stopFlag;
+	std::atomic<int>              m_statusCode;
+	std::atomic<unsigned int>     m_nPublishedEvents;
+};
+
+}
+
+#endif  //  DQMLCIOSTREAMPIPELINE_H
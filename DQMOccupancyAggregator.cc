@@ -0,0 +1,433 @@
+/*
+ *
+ * DQMOccupancyAggregator.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMOccupancyAggregator.h"
+#include "dqm4hep/DQMEvent.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- lcio headers
+#include "EVENT/LCEvent.h"
+#include "EVENT/LCCollection.h"
+#include "EVENT/CalorimeterHit.h"
+#include "EVENT/LCIO.h"
+#include "Exceptions.h"
+
+// -- dim headers
+#include "dis.hxx"
+
+// -- std headers
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <chrono>
+
+namespace dqm4hep
+{
+
+/** Compute the dense cell indices from the cell ids. No branch, vectorized by the compiler.
+ *  Unused bit fields have a null mask and do not contribute
+ */
+static void DQMOccupancyAggregator_computeCellIndices(const uint32_t *pCellIds, uint32_t *pCellIndices, size_t nHits,
+		const uint32_t *pShifts, const uint32_t *pMasks, const uint32_t *pStrides)
+{
+	const uint32_t shift0 = pShifts[0], shift1 = pShifts[1], shift2 = pShifts[2];
+	const uint32_t mask0 = pMasks[0], mask1 = pMasks[1], mask2 = pMasks[2];
+	const uint32_t stride0 = pStrides[0], stride1 = pStrides[1], stride2 = pStrides[2];
+
+	for(size_t i = 0 ; i < nHits ; i++)
+	{
+		const uint32_t cellId = pCellIds[i];
+
+		pCellIndices[i] = ((cellId >> shift0) & mask0) * stride0
+				+ ((cellId >> shift1) & mask1) * stride1
+				+ ((cellId >> shift2) & mask2) * stride2;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Compute the amplitude histogram bins, under/overflows (and NaN) in the first/last bin.
+ *  No branch, vectorized by the compiler
+ */
+static void DQMOccupancyAggregator_computeBins(const float *pAmplitudes, uint32_t *pBins, size_t nHits,
+		float amplitudeMin, float inverseBinWidth, uint32_t nBins)
+{
+	const float lastBin = static_cast<float>(nBins - 1);
+
+	for(size_t i = 0 ; i < nHits ; i++)
+	{
+		float bin = (pAmplitudes[i] - amplitudeMin) * inverseBinWidth;
+		bin = !(bin >= 0.f) ? 0.f : bin;      // NaN amplitudes go to the first bin
+		bin = bin > lastBin ? lastBin : bin;
+
+		pBins[i] = static_cast<uint32_t>(bin);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMOccupancyAggregator::OccupancyMap::OccupancyMap() :
+	m_nCells(1),
+	m_nBins(1),
+	m_amplitudeMin(0.f),
+	m_amplitudeMax(1.f),
+	m_nEvents(0),
+	m_pService(NULL)
+{
+	for(unsigned int f = 0 ; f < 3 ; f++)
+	{
+		m_shifts[f] = 0;
+		m_masks[f] = 0;
+		m_strides[f] = 0;
+		m_widths[f] = 0;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::OccupancyMap::reset()
+{
+	m_nEvents = 0;
+	m_occupancy.assign(m_nCells, 0);
+	m_amplitudeSums.assign(m_nCells, 0.f);
+	m_amplitudeHistogram.assign(m_nBins, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::OccupancyMap::fillPublishBuffer()
+{
+	const uint32_t header[6] = {m_nEvents, m_nCells, m_nBins, m_widths[0], m_widths[1], m_widths[2]};
+	const float range[2] = {m_amplitudeMin, m_amplitudeMax};
+
+	char *pBuffer = &m_publishBuffer[0];
+
+	memcpy(pBuffer, header, sizeof(header));
+	pBuffer += sizeof(header);
+	memcpy(pBuffer, range, sizeof(range));
+	pBuffer += sizeof(range);
+	memcpy(pBuffer, &m_occupancy[0], m_nCells*sizeof(uint32_t));
+	pBuffer += m_nCells*sizeof(uint32_t);
+	memcpy(pBuffer, &m_amplitudeSums[0], m_nCells*sizeof(float));
+	pBuffer += m_nCells*sizeof(float);
+	memcpy(pBuffer, &m_amplitudeHistogram[0], m_nBins*sizeof(uint32_t));
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMOccupancyAggregator::DQMOccupancyAggregator() :
+	m_publishPeriod(1000),
+	m_running(false)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMOccupancyAggregator::~DQMOccupancyAggregator()
+{
+	this->stop();
+
+	for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+			endIter != iter ; ++iter)
+		delete *iter;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMOccupancyAggregator::addCollection(const std::string &collectionName, const std::string &cellIdEncoding,
+		unsigned int nAmplitudeBins, float amplitudeMin, float amplitudeMax)
+{
+	if(m_running)
+		return STATUS_CODE_NOT_ALLOWED;
+
+	if(collectionName.empty() || 0 == nAmplitudeBins || amplitudeMax <= amplitudeMin)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	OccupancyMap *pMap = new OccupancyMap();
+	pMap->m_collectionName = collectionName;
+	pMap->m_nBins = nAmplitudeBins;
+	pMap->m_amplitudeMin = amplitudeMin;
+	pMap->m_amplitudeMax = amplitudeMax;
+
+	std::stringstream encodingStream(cellIdEncoding);
+	std::string field;
+	unsigned int nFields = 0;
+	unsigned int totalWidth = 0;
+
+	while(std::getline(encodingStream, field, ','))
+	{
+		std::string::size_type firstColon = field.find(':');
+		std::string::size_type secondColon = field.find(':', firstColon+1);
+		unsigned int offset = 0, width = 0;
+
+		bool valid = nFields < 3 && std::string::npos != firstColon && std::string::npos != secondColon
+				&& 1 == sscanf(field.c_str() + firstColon + 1, "%u", &offset)
+				&& 1 == sscanf(field.c_str() + secondColon + 1, "%u", &width)
+				&& width > 0 && offset + width <= 32;
+
+		// dense maps only, 16 M cells max
+		if(valid)
+		{
+			totalWidth += width;
+			valid = totalWidth <= 24;
+		}
+
+		if(!valid)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Invalid cell id encoding '" << cellIdEncoding << "' for collection " << collectionName );
+			delete pMap;
+			return STATUS_CODE_INVALID_PARAMETER;
+		}
+
+		pMap->m_shifts[nFields] = offset;
+		pMap->m_masks[nFields] = (1u << width) - 1;
+		pMap->m_strides[nFields] = pMap->m_nCells;
+		pMap->m_widths[nFields] = width;
+		pMap->m_nCells <<= width;
+		nFields++;
+	}
+
+	if(0 == nFields)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Empty cell id encoding for collection " << collectionName );
+		delete pMap;
+		return STATUS_CODE_INVALID_PARAMETER;
+	}
+
+	std::stringstream dimFormat;
+	dimFormat << "I:6;F:2;I:" << pMap->m_nCells << ";F:" << pMap->m_nCells << ";I:" << pMap->m_nBins;
+	pMap->m_dimFormat = dimFormat.str();
+
+	pMap->m_publishBuffer.resize(6*sizeof(uint32_t) + 2*sizeof(float)
+			+ pMap->m_nCells*(sizeof(uint32_t) + sizeof(float)) + pMap->m_nBins*sizeof(uint32_t), 0);
+	pMap->reset();
+
+	m_maps.push_back(pMap);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::setPublishPeriod(unsigned int publishPeriod)
+{
+	m_publishPeriod = publishPeriod > 0 ? publishPeriod : 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMOccupancyAggregator::start(const std::string &servicePrefix)
+{
+	if(m_running)
+		return STATUS_CODE_SUCCESS;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+				endIter != iter ; ++iter)
+			(*iter)->reset();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+
+		for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+				endIter != iter ; ++iter)
+		{
+			(*iter)->fillPublishBuffer();
+			(*iter)->m_pService = new DimService((servicePrefix + "/OCCUPANCY/" + (*iter)->m_collectionName).c_str(),
+					(char *) (*iter)->m_dimFormat.c_str(), (void *) &(*iter)->m_publishBuffer[0], (*iter)->m_publishBuffer.size());
+		}
+	}
+
+	m_running = true;
+	m_thread = std::thread(&DQMOccupancyAggregator::publishLoop, this);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMOccupancyAggregator::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(!m_running)
+			return STATUS_CODE_SUCCESS;
+
+		m_running = false;
+	}
+
+	m_condition.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+
+	this->publish();
+
+	std::lock_guard<std::mutex> lock(m_publishMutex);
+
+	for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+			endIter != iter ; ++iter)
+	{
+		delete (*iter)->m_pService;
+		(*iter)->m_pService = NULL;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::processEvent(const DQMEvent *const pEvent)
+{
+	if(NULL == pEvent || m_maps.empty())
+		return;
+
+	EVENT::LCEvent *pLCEvent = pEvent->getEvent<EVENT::LCEvent>();
+
+	if(NULL == pLCEvent)
+		return;
+
+	for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+			endIter != iter ; ++iter)
+	{
+		OccupancyMap *pMap = *iter;
+		EVENT::LCCollection *pCollection = NULL;
+
+		try
+		{
+			pCollection = pLCEvent->getCollection(pMap->m_collectionName);
+		}
+		catch(EVENT::DataNotAvailableException &)
+		{
+			continue;
+		}
+
+		if(NULL == pCollection || EVENT::LCIO::CALORIMETERHIT != pCollection->getTypeName())
+			continue;
+
+		// stage the hits in flat arrays
+		const size_t nHits = pCollection->getNumberOfElements();
+
+		pMap->m_cellIds.resize(nHits);
+		pMap->m_amplitudes.resize(nHits);
+		pMap->m_cellIndices.resize(nHits);
+		pMap->m_bins.resize(nHits);
+
+		for(size_t h = 0 ; h < nHits ; h++)
+		{
+			EVENT::CalorimeterHit *pHit = static_cast<EVENT::CalorimeterHit*>(pCollection->getElementAt(h));
+			pMap->m_cellIds[h] = static_cast<uint32_t>(pHit->getCellID0());
+			pMap->m_amplitudes[h] = pHit->getEnergy();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		this->accumulate(pMap);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::accumulate(OccupancyMap *pMap)
+{
+	const size_t nHits = pMap->m_cellIds.size();
+
+	pMap->m_nEvents++;
+
+	if(0 == nHits)
+		return;
+
+	DQMOccupancyAggregator_computeCellIndices(&pMap->m_cellIds[0], &pMap->m_cellIndices[0], nHits,
+			pMap->m_shifts, pMap->m_masks, pMap->m_strides);
+
+	DQMOccupancyAggregator_computeBins(&pMap->m_amplitudes[0], &pMap->m_bins[0], nHits,
+			pMap->m_amplitudeMin, pMap->m_nBins / (pMap->m_amplitudeMax - pMap->m_amplitudeMin), pMap->m_nBins);
+
+	uint32_t *pOccupancy = &pMap->m_occupancy[0];
+	float *pAmplitudeSums = &pMap->m_amplitudeSums[0];
+	uint32_t *pAmplitudeHistogram = &pMap->m_amplitudeHistogram[0];
+
+	const uint32_t *pCellIndices = &pMap->m_cellIndices[0];
+	const uint32_t *pBins = &pMap->m_bins[0];
+	const float *pAmplitudes = &pMap->m_amplitudes[0];
+
+	for(size_t h = 0 ; h < nHits ; h++)
+	{
+		pOccupancy[pCellIndices[h]]++;
+		pAmplitudeSums[pCellIndices[h]] += pAmplitudes[h];
+		pAmplitudeHistogram[pBins[h]]++;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::publish()
+{
+	std::lock_guard<std::mutex> publishLock(m_publishMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+				endIter != iter ; ++iter)
+			(*iter)->fillPublishBuffer();
+	}
+
+	// dim copies the buffer when sending, out of the accumulation lock
+	for(std::vector<OccupancyMap*>::iterator iter = m_maps.begin(), endIter = m_maps.end() ;
+			endIter != iter ; ++iter)
+	{
+		if(NULL != (*iter)->m_pService)
+			(*iter)->m_pService->updateService();
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMOccupancyAggregator::publishLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(m_running)
+	{
+		m_condition.wait_for(lock, std::chrono::milliseconds(m_publishPeriod));
+
+		if(!m_running)
+			break;
+
+		lock.unlock();
+		this->publish();
+		lock.lock();
+	}
+}
+
+}
@@ -0,0 +1,174 @@
+/*
+ *
+ * DQMOccupancyAggregator.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMOCCUPANCYAGGREGATOR_H
+#define DQMOCCUPANCYAGGREGATOR_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DimService;
+
+namespace dqm4hep
+{
+
+class DQMEvent;
+
+/** DQMOccupancyAggregator class
+ *
+ *  Accumulate per cell occupancy and amplitude sums, plus an amplitude
+ *  histogram, for calorimeter hit collections of the received lcio events.
+ *  The maps are published periodically on one dim service per collection
+ *  (<prefix>/OCCUPANCY/<collection>), so that monitors can subscribe to
+ *  them instead of the full events.
+ *
+ *  The cell index is decoded from the cell id 0 with up to 3 bit fields.
+ *  The hits of a collection are first copied into flat arrays (structure
+ *  of arrays), then the cell indices and amplitude bins are computed by
+ *  branch free loops that the compiler vectorizes. Only the final
+ *  accumulation is a scalar scatter.
+ *
+ *  Published buffer, dim format "I:6;F:2;I:<nCells>;F:<nCells>;I:<nBins>" :
+ *   - n events, n cells, n amplitude bins, width of the 3 bit fields
+ *   - amplitude histogram min and max
+ *   - hit count per cell
+ *   - amplitude sum per cell
+ *   - amplitude histogram
+ *
+ *  The maps are accumulated from start().
+ */
+class DQMOccupancyAggregator
+{
+public:
+	/** Constructor
+	 */
+	DQMOccupancyAggregator();
+
+	/** Destructor. Stop the publication
+	 */
+	~DQMOccupancyAggregator();
+
+	/** Add a collection to aggregate. The cell id encoding is a list of up to 3
+	 *  bit fields "name:offset:width" separated by ',' (i.e "I:0:8,J:8:8,K:16:6").
+	 *  Can only be called before start()
+	 */
+	StatusCode addCollection(const std::string &collectionName, const std::string &cellIdEncoding,
+			unsigned int nAmplitudeBins, float amplitudeMin, float amplitudeMax);
+
+	/** Set the period between two publications (unit msec)
+	 */
+	void setPublishPeriod(unsigned int publishPeriod);
+
+	/** Reset the maps, create the services and start the publication thread
+	 */
+	StatusCode start(const std::string &servicePrefix);
+
+	/** Publish the maps a last time, stop the publication thread and delete the services
+	 */
+	StatusCode stop();
+
+	/** Accumulate the calorimeter hits of a received lcio event
+	 */
+	void processEvent(const DQMEvent *const pEvent);
+
+private:
+	/** OccupancyMap class
+	 */
+	class OccupancyMap
+	{
+	public:
+		/** Constructor
+		 */
+		OccupancyMap();
+
+		/** Reset the accumulated maps
+		 */
+		void reset();
+
+		/** Copy the accumulated maps in the publication buffer
+		 */
+		void fillPublishBuffer();
+
+		std::string              m_collectionName;
+		uint32_t                 m_shifts[3];
+		uint32_t                 m_masks[3];
+		uint32_t                 m_strides[3];
+		uint32_t                 m_widths[3];
+		uint32_t                 m_nCells;
+		uint32_t                 m_nBins;
+		float                    m_amplitudeMin;
+		float                    m_amplitudeMax;
+		uint32_t                 m_nEvents;
+
+		// per event hits, structure of arrays
+		std::vector<uint32_t>    m_cellIds;
+		std::vector<float>       m_amplitudes;
+		std::vector<uint32_t>    m_cellIndices;
+		std::vector<uint32_t>    m_bins;
+
+		// accumulated maps
+		std::vector<uint32_t>    m_occupancy;
+		std::vector<float>       m_amplitudeSums;
+		std::vector<uint32_t>    m_amplitudeHistogram;
+
+		std::vector<char>        m_publishBuffer;
+		std::string              m_dimFormat;
+		DimService              *m_pService;
+	};
+
+	/** Accumulate the staged hits of a map. Lock must be held
+	 */
+	void accumulate(OccupancyMap *pMap);
+
+	/** Copy the maps in the publication buffers and update the services
+	 */
+	void publish();
+
+	/** The publication thread loop
+	 */
+	void publishLoop();
+
+private:
+	std::vector<OccupancyMap*>        m_maps;
+	unsigned int                      m_publishPeriod;
+
+	std::mutex                        m_mutex;           ///< Protect the accumulated maps
+	std::mutex                        m_publishMutex;    ///< Protect the publication buffers and services
+	std::condition_variable           m_condition;
+	std::thread                       m_thread;
+	bool                              m_running;
+};
+
+}
+
+#endif  //  DQMOCCUPANCYAGGREGATOR_H
@@ -0,0 +1,283 @@
+/*
+ *
+ * DQMSpillAggregator.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMSpillAggregator.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <cstring>
+#include <limits>
+
+namespace dqm4hep
+{
+
+const char *const DQMSpillSummary::m_dimFormat = "X:1;D:3;I:6";
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMSpillAggregator::DQMSpillAggregator(const SummaryFunction &summaryFunction) :
+	m_summaryFunction(summaryFunction),
+	m_spillGap(0),
+	m_running(false),
+	m_spillOpen(false),
+	m_nextSpillNumber(0),
+	m_lastTimeStamp(0)
+{
+	memset(&m_summary, 0, sizeof(DQMSpillSummary));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMSpillAggregator::~DQMSpillAggregator()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+
+	m_condition.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::setSpillGap(unsigned int spillGap)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_spillGap = std::chrono::milliseconds(spillGap);
+	}
+
+	m_condition.notify_all();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMSpillAggregator::getSpillGap() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_spillGap.count();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if(m_running)
+		return;
+
+	m_running = true;
+	m_spillOpen = false;
+	m_nextSpillNumber = 0;
+
+	if(m_thread.joinable())
+		m_thread.join();
+
+	m_thread = std::thread(&DQMSpillAggregator::watchdogLoop, this);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::stop()
+{
+	DQMSpillSummary summary;
+	bool publish = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_spillOpen)
+		{
+			this->closeSpill(DQMSpillSummary::STOP, summary);
+			publish = true;
+		}
+
+		m_running = false;
+	}
+
+	m_condition.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+
+	if(publish)
+		m_summaryFunction(summary);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::processEvent(uint32_t eventSize, bool filtered, int64_t timeStamp)
+{
+	Clock::time_point now = Clock::now();
+	DQMSpillSummary summary;
+	bool publish = false;
+	bool wakeUp = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// time stamps going backward (new run) do not end a spill
+		if(m_spillOpen && 0 != timeStamp && 0 != m_lastTimeStamp && 0 != m_spillGap.count()
+		&& timeStamp - m_lastTimeStamp > std::chrono::duration_cast<std::chrono::nanoseconds>(m_spillGap).count())
+		{
+			this->closeSpill(DQMSpillSummary::TIME_STAMP_GAP, summary);
+			publish = true;
+		}
+
+		if(!m_spillOpen)
+		{
+			this->openSpill(now);
+			wakeUp = true;
+		}
+
+		if(0 != timeStamp)
+			m_lastTimeStamp = timeStamp;
+
+		if(0 == m_summary.m_nEvents)
+			m_firstEventTime = now;
+
+		m_lastEventTime = now;
+
+		m_summary.m_nEvents++;
+		m_summary.m_nBytes += eventSize;
+
+		if(filtered)
+			m_summary.m_nFilteredEvents++;
+
+		if(eventSize < m_summary.m_minEventSize)
+			m_summary.m_minEventSize = eventSize;
+
+		if(eventSize > m_summary.m_maxEventSize)
+			m_summary.m_maxEventSize = eventSize;
+	}
+
+	// the watchdog sleeps while no spill is open
+	if(wakeUp)
+		m_condition.notify_all();
+
+	if(publish)
+		m_summaryFunction(summary);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::processMarker(bool spillStart)
+{
+	DQMSpillSummary summary;
+	bool publish = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_spillOpen)
+		{
+			this->closeSpill(DQMSpillSummary::MARKER, summary);
+			publish = true;
+		}
+
+		if(spillStart)
+			this->openSpill(Clock::now());
+	}
+
+	m_condition.notify_all();
+
+	if(publish)
+		m_summaryFunction(summary);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::openSpill(const Clock::time_point &now)
+{
+	memset(&m_summary, 0, sizeof(DQMSpillSummary));
+	m_summary.m_spillNumber = m_nextSpillNumber++;
+	m_summary.m_minEventSize = std::numeric_limits<uint32_t>::max();
+
+	m_firstEventTime = now;
+	m_lastEventTime = now;
+	m_lastTimeStamp = 0;
+	m_spillOpen = true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::closeSpill(DQMSpillSummary::EndReason endReason, DQMSpillSummary &summary)
+{
+	m_spillOpen = false;
+
+	summary = m_summary;
+	summary.m_endReason = endReason;
+
+	if(0 == summary.m_nEvents)
+		summary.m_minEventSize = 0;
+
+	summary.m_duration = std::chrono::duration<double>(m_lastEventTime - m_firstEventTime).count();
+
+	if(summary.m_duration > 0.)
+	{
+		// n events span n-1 intervals
+		summary.m_eventRate = (summary.m_nEvents - 1) / summary.m_duration;
+		summary.m_byteRate = summary.m_nBytes / summary.m_duration;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMSpillAggregator::watchdogLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(m_running)
+	{
+		if(!m_spillOpen || 0 == m_spillGap.count())
+		{
+			m_condition.wait(lock);
+			continue;
+		}
+
+		Clock::time_point spillEndTime = m_lastEventTime + m_spillGap;
+
+		if(Clock::now() < spillEndTime)
+		{
+			m_condition.wait_until(lock, spillEndTime);
+			continue;
+		}
+
+		DQMSpillSummary summary;
+		this->closeSpill(DQMSpillSummary::TIME_GAP, summary);
+
+		lock.unlock();
+		m_summaryFunction(summary);
+		lock.lock();
+	}
+}
+
+}
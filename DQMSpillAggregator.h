@@ -0,0 +1,163 @@
+/*
+ *
+ * DQMSpillAggregator.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMSPILLAGGREGATOR_H
+#define DQMSPILLAGGREGATOR_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace dqm4hep
+{
+
+/** DQMSpillSummary struct
+ *
+ *  Aggregates of one spill, published as is on a dim service
+ *  (format DQMSpillSummary::m_dimFormat). 64 bits fields first,
+ *  so that the layout has no padding
+ */
+struct DQMSpillSummary
+{
+	enum EndReason
+	{
+		TIME_GAP = 0,
+		MARKER = 1,
+		STOP = 2,
+		TIME_STAMP_GAP = 3
+	};
+
+	uint64_t       m_nBytes;            ///< The total received bytes
+	double         m_duration;          ///< From the first to the last event (unit sec)
+	double         m_eventRate;         ///< Events per second over the spill duration
+	double         m_byteRate;          ///< Bytes per second over the spill duration
+	uint32_t       m_spillNumber;       ///< The spill number, starting at 0 on collector start
+	uint32_t       m_nEvents;           ///< The number of received events
+	uint32_t       m_nFilteredEvents;   ///< The number of events rejected by the size filter
+	uint32_t       m_minEventSize;      ///< The minimum event size
+	uint32_t       m_maxEventSize;      ///< The maximum event size
+	uint32_t       m_endReason;         ///< How the end of spill was detected (EndReason)
+
+	static const char *const m_dimFormat;
+};
+
+/** DQMSpillAggregator class
+ *
+ *  Accumulate per spill aggregates of the received events and
+ *  call a function with the summary at the end of each spill.
+ *  The end of a spill is detected either :
+ *   - by a gap without event longer than the spill gap (checked
+ *     by a watchdog thread, so the summary does not wait for the
+ *     next spill)
+ *   - by a gap between the time stamps of two consecutive events
+ *     longer than the spill gap, when the events have a time stamp.
+ *     This works with replayed or buffered data, where the reception
+ *     times do not show the spill structure
+ *   - by an explicit spill marker
+ *
+ *  The event processing only updates a few counters under a lock.
+ */
+class DQMSpillAggregator
+{
+public:
+	typedef std::function<void(const DQMSpillSummary &)> SummaryFunction;
+
+	/** Constructor. The function is called without any internal lock held
+	 */
+	DQMSpillAggregator(const SummaryFunction &summaryFunction);
+
+	/** Destructor. Stop the watchdog thread, the current spill is not published
+	 */
+	~DQMSpillAggregator();
+
+	/** Set the time without event ending a spill (unit msec). 0 disables the
+	 *  gap detection, the spills are then only delimited by markers
+	 */
+	void setSpillGap(unsigned int spillGap);
+
+	/** Get the time without event ending a spill (unit msec)
+	 */
+	unsigned int getSpillGap() const;
+
+	/** Start the watchdog thread and reset the spill number
+	 */
+	void start();
+
+	/** Publish the current spill, if any, and stop the watchdog thread
+	 */
+	void stop();
+
+	/** Add a received event to the current spill. Open a spill if needed.
+	 *  The time stamp is the event time (unit nsec), 0 if unknown
+	 */
+	void processEvent(uint32_t eventSize, bool filtered, int64_t timeStamp = 0);
+
+	/** Explicit spill marker. A start marker publishes the current spill, if any,
+	 *  and opens a new one. An end marker publishes the current spill
+	 */
+	void processMarker(bool spillStart);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	/** Open a new spill. Lock must be held
+	 */
+	void openSpill(const Clock::time_point &now);
+
+	/** Close the current spill and fill the summary. Lock must be held
+	 */
+	void closeSpill(DQMSpillSummary::EndReason endReason, DQMSpillSummary &summary);
+
+	/** The watchdog thread loop
+	 */
+	void watchdogLoop();
+
+private:
+	SummaryFunction                   m_summaryFunction;
+	std::chrono::milliseconds         m_spillGap;
+
+	mutable std::mutex                m_mutex;
+	std::condition_variable           m_condition;
+	std::thread                       m_thread;
+	bool                              m_running;
+
+	bool                              m_spillOpen;
+	uint32_t                          m_nextSpillNumber;
+	DQMSpillSummary                   m_summary;            ///< Aggregates of the current spill
+	Clock::time_point                 m_firstEventTime;
+	Clock::time_point                 m_lastEventTime;
+	int64_t                           m_lastTimeStamp;      ///< The time stamp of the last event of the spill, 0 if none
+};
+
+}
+
+#endif  //  DQMSPILLAGGREGATOR_H
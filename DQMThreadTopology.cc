@@ -0,0 +1,270 @@
+/*
+ *
+ * DQMThreadTopology.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMThreadTopology.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+// -- unix headers
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace dqm4hep
+{
+
+DQMThreadTopology::DQMThreadTopology()
+{
+	for(unsigned int r=0 ; r<N_ROLES ; r++)
+		m_settings[r].m_priority = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMThreadTopology::setCpus(Role role, const std::string &cpuList)
+{
+	if(role >= N_ROLES)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	std::vector<int> cpus;
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, DQMThreadTopology::parseCpuList(cpuList, cpus));
+
+	const long nCpus = sysconf(_SC_NPROCESSORS_CONF);
+
+	for(std::vector<int>::const_iterator iter = cpus.begin(), endIter = cpus.end() ; endIter != iter ; ++iter)
+	{
+		if(*iter >= CPU_SETSIZE || (nCpus > 0 && *iter >= nCpus))
+			return STATUS_CODE_OUT_OF_RANGE;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_settings[role].m_cpus = cpus;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMThreadTopology::setPriority(Role role, int priority)
+{
+	if(role >= N_ROLES)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	if(0 != priority && (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)))
+		return STATUS_CODE_OUT_OF_RANGE;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_settings[role].m_priority = priority;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::vector<int> DQMThreadTopology::getCpus(Role role) const
+{
+	if(role >= N_ROLES)
+		return std::vector<int>();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_settings[role].m_cpus;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int DQMThreadTopology::getPriority(Role role) const
+{
+	if(role >= N_ROLES)
+		return 0;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_settings[role].m_priority;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMThreadTopology::apply(Role role, int index) const
+{
+	if(role >= N_ROLES)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	Settings settings;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		settings = m_settings[role];
+	}
+
+	StatusCode statusCode(STATUS_CODE_SUCCESS);
+	const pthread_t thread(pthread_self());
+
+	// thread names are limited to 15 characters
+	std::stringstream threadName;
+	threadName << "dqm-" << DQMThreadTopology::getRoleName(role);
+
+	if(index >= 0)
+		threadName << "-" << index;
+
+	pthread_setname_np(thread, threadName.str().substr(0, 15).c_str());
+
+	// an unconfigured setting leaves the thread as it is (i.e the affinity inherited from
+	// its creator), unless a previous call on this thread changed it : the placement saved
+	// before that change is then restored
+	static thread_local bool isPinned(false);
+	static thread_local bool isRealTime(false);
+	static thread_local cpu_set_t originalCpuSet;
+	static thread_local int originalPolicy(SCHED_OTHER);
+	static thread_local sched_param originalSchedulingParameters;
+
+	if(!settings.m_cpus.empty() && !isPinned)
+	{
+		const int error = pthread_getaffinity_np(thread, sizeof(cpu_set_t), &originalCpuSet);
+
+		if(0 != error)
+		{
+			// it could not be restored
+			LOG4CXX_WARN( dqmMainLogger , "Couldn't get the cpu affinity of thread " << threadName.str() << " : " << strerror(error) );
+			settings.m_cpus.clear();
+			statusCode = STATUS_CODE_FAILURE;
+		}
+	}
+
+	if(!settings.m_cpus.empty() || isPinned)
+	{
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+
+		if(settings.m_cpus.empty())
+			cpuSet = originalCpuSet;
+		else
+		{
+			for(std::vector<int>::const_iterator iter = settings.m_cpus.begin(), endIter = settings.m_cpus.end() ; endIter != iter ; ++iter)
+				CPU_SET(*iter, &cpuSet);
+		}
+
+		const int error = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuSet);
+
+		if(0 != error)
+		{
+			LOG4CXX_WARN( dqmMainLogger , "Couldn't set the cpu affinity of thread " << threadName.str() << " : " << strerror(error) );
+			statusCode = STATUS_CODE_FAILURE;
+		}
+		else
+			isPinned = !settings.m_cpus.empty();
+	}
+
+	if(0 != settings.m_priority && !isRealTime)
+	{
+		const int error = pthread_getschedparam(thread, &originalPolicy, &originalSchedulingParameters);
+
+		if(0 != error)
+		{
+			LOG4CXX_WARN( dqmMainLogger , "Couldn't get the scheduling of thread " << threadName.str() << " : " << strerror(error) );
+			settings.m_priority = 0;
+			statusCode = STATUS_CODE_FAILURE;
+		}
+	}
+
+	if(0 != settings.m_priority || isRealTime)
+	{
+		// real time scheduling needs CAP_SYS_NICE (or a rtprio limit)
+		int policy(originalPolicy);
+		sched_param schedulingParameters(originalSchedulingParameters);
+
+		if(0 != settings.m_priority)
+		{
+			memset(&schedulingParameters, 0, sizeof(sched_param));
+			schedulingParameters.sched_priority = settings.m_priority;
+			policy = SCHED_FIFO;
+		}
+
+		const int error = pthread_setschedparam(thread, policy, &schedulingParameters);
+
+		if(0 != error)
+		{
+			LOG4CXX_WARN( dqmMainLogger , "Couldn't set the priority " << settings.m_priority << " of thread " << threadName.str()
+					<< " : " << strerror(error) );
+			statusCode = STATUS_CODE_FAILURE;
+		}
+		else
+			isRealTime = 0 != settings.m_priority;
+	}
+
+	return statusCode;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::string DQMThreadTopology::getRoleName(Role role)
+{
+	switch(role)
+	{
+	case RECEPTION: return "recv";
+	case BUILDING: return "build";
+	case CONVERSION: return "conv";
+	case FAN_OUT: return "fanout";
+	default: return "unknown";
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMThreadTopology::parseCpuList(const std::string &cpuList, std::vector<int> &cpus)
+{
+	cpus.clear();
+
+	std::vector<std::string> ranges;
+	DQM4HEP::tokenize(cpuList, ranges, ",");
+
+	for(std::vector<std::string>::const_iterator iter = ranges.begin(), endIter = ranges.end() ; endIter != iter ; ++iter)
+	{
+		const std::string::size_type dashPosition = iter->find('-');
+		const std::string first(iter->substr(0, dashPosition));
+		const std::string last(std::string::npos == dashPosition ? first : iter->substr(dashPosition+1));
+
+		if(first.empty() || last.empty()
+		|| std::string::npos != first.find_first_not_of("0123456789 ")
+		|| std::string::npos != last.find_first_not_of("0123456789 "))
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		const int firstCpu = atoi(first.c_str());
+		const int lastCpu = atoi(last.c_str());
+
+		if(lastCpu < firstCpu || lastCpu >= CPU_SETSIZE)
+			return STATUS_CODE_OUT_OF_RANGE;
+
+		for(int cpu=firstCpu ; cpu<=lastCpu ; cpu++)
+			cpus.push_back(cpu);
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
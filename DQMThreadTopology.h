@@ -0,0 +1,116 @@
+/*
+ *
+ * DQMThreadTopology.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+#ifndef DQMTHREADTOPOLOGY_H
+#define DQMTHREADTOPOLOGY_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dqm4hep
+{
+
+/** DQMThreadTopology class
+ *
+ *  Placement of the data path threads. For each role, a set of cpus
+ *  (empty : not placed) and a real time priority (SCHED_FIFO, 0 : not
+ *  changed). A thread applies the settings of its role to
+ *  itself when it starts, and takes the role name (i.e "dqm-build",
+ *  shown by top -H). Memory first touched by a pinned thread is placed
+ *  by the kernel on the numa node of its cpus, so the threads allocate
+ *  their own buffers after apply().
+ *
+ *  The settings can be changed while the threads run : they are applied
+ *  again on the next call to apply().
+ */
+class DQMThreadTopology
+{
+public:
+	enum Role
+	{
+		RECEPTION,
+		BUILDING,
+		CONVERSION,
+		FAN_OUT,
+		N_ROLES
+	};
+
+	/** Constructor. No placement : the threads keep their affinity and scheduling
+	 */
+	DQMThreadTopology();
+
+	/** Set the cpus of a role from a list, i.e "2-3,6". Empty to leave the affinity alone
+	 */
+	StatusCode setCpus(Role role, const std::string &cpuList);
+
+	/** Set the real time priority of a role, 1 to 99, 0 to leave the scheduling alone
+	 */
+	StatusCode setPriority(Role role, int priority);
+
+	/** Get the cpus of a role
+	 */
+	std::vector<int> getCpus(Role role) const;
+
+	/** Get the real time priority of a role
+	 */
+	int getPriority(Role role) const;
+
+	/** Apply the settings of a role to the calling thread and name it after the role,
+	 *  with the index if there are several threads for the role (i.e "dqm-fanout-1").
+	 *  The unconfigured settings are left alone, unless this thread was placed by a
+	 *  previous call : it then gets back the affinity and scheduling it had before.
+	 *  All the settings are tried, failing if one of them could not be applied
+	 */
+	StatusCode apply(Role role, int index = -1) const;
+
+	/** Get the short name of a role, i.e "build"
+	 */
+	static std::string getRoleName(Role role);
+
+	/** Parse a cpu list, i.e "0-3,8"
+	 */
+	static StatusCode parseCpuList(const std::string &cpuList, std::vector<int> &cpus);
+
+private:
+	/** Settings class
+	 */
+	class Settings
+	{
+	public:
+		std::vector<int>      m_cpus;
+		int                   m_priority;
+	};
+
+	mutable std::mutex        m_mutex;
+	Settings                  m_settings[N_ROLES];
+};
+
+}
+
+#endif  //  DQMTHREADTOPOLOGY_H
@@ -0,0 +1,651 @@
+/*
+ *
+ * DQMXdrBulkCodec.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+// -- dqm4hep headers
+#include "DQMXdrBulkCodec.h"
+
+// -- lcio headers
+#include "EVENT/LCIO.h"
+#include "EVENT/LCParameters.h"
+#include "IMPL/LCCollectionVec.h"
+#include "IMPL/CalorimeterHitImpl.h"
+#include "IMPL/RawCalorimeterHitImpl.h"
+
+namespace dqm4hep
+{
+
+DQMXdrBulkWriter::DQMXdrBulkWriter(std::vector<char> &buffer) :
+	m_buffer(buffer)
+{
+	m_buffer.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint32_t *DQMXdrBulkWriter::grow(size_t nWords)
+{
+	const size_t position = m_buffer.size();
+	m_buffer.resize(position + nWords*sizeof(uint32_t));
+
+	return reinterpret_cast<uint32_t *>(&m_buffer[position]);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeUInt(uint32_t value)
+{
+	this->writeUInts(&value, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeFloat(float value)
+{
+	this->writeFloats(&value, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeString(const std::string &value)
+{
+	this->writeUInt(value.size());
+
+	// xdr opaque data, padded to 4 bytes
+	const size_t nWords = (value.size() + 3) / 4;
+
+	if(0 == nWords)
+		return;
+
+	char *pData = reinterpret_cast<char *>(this->grow(nWords));
+	memset(pData, 0, nWords*sizeof(uint32_t));
+	memcpy(pData, value.data(), value.size());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeUInts(const uint32_t *pValues, size_t nValues)
+{
+	if(0 == nValues)
+		return;
+
+	DQMXdrBulkSwap32(pValues, this->grow(nValues), nValues);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeInts(const int32_t *pValues, size_t nValues)
+{
+	this->writeUInts(reinterpret_cast<const uint32_t *>(pValues), nValues);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkWriter::writeFloats(const float *pValues, size_t nValues)
+{
+	// ieee 754 floats, same byte order as 32 bits integers
+	this->writeUInts(reinterpret_cast<const uint32_t *>(pValues), nValues);
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrBulkReader::DQMXdrBulkReader(const char *pBuffer, size_t bufferSize) :
+	m_pBuffer(pBuffer),
+	m_bufferSize(bufferSize),
+	m_position(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const uint32_t *DQMXdrBulkReader::consume(size_t nWords)
+{
+	if(nWords > (m_bufferSize - m_position) / sizeof(uint32_t))
+		return NULL;
+
+	const uint32_t *pWords = reinterpret_cast<const uint32_t *>(m_pBuffer + m_position);
+	m_position += nWords*sizeof(uint32_t);
+
+	return pWords;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readUInt(uint32_t &value)
+{
+	return this->readUInts(&value, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readFloat(float &value)
+{
+	return this->readFloats(&value, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readString(std::string &value)
+{
+	uint32_t size = 0;
+
+	if(!this->readUInt(size))
+		return false;
+
+	const uint32_t *pWords = this->consume((static_cast<size_t>(size) + 3) / 4);
+
+	if(NULL == pWords)
+		return false;
+
+	value.assign(reinterpret_cast<const char *>(pWords), size);
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readUInts(uint32_t *pValues, size_t nValues)
+{
+	const uint32_t *pWords = this->consume(nValues);
+
+	if(NULL == pWords)
+		return false;
+
+	if(0 == nValues)
+		return true;
+
+	// the buffer may not be aligned, copy before swapping in place
+	memcpy(pValues, pWords, nValues*sizeof(uint32_t));
+	DQMXdrBulkSwap32(pValues, pValues, nValues);
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readInts(int32_t *pValues, size_t nValues)
+{
+	return this->readUInts(reinterpret_cast<uint32_t *>(pValues), nValues);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::readFloats(float *pValues, size_t nValues)
+{
+	return this->readUInts(reinterpret_cast<uint32_t *>(pValues), nValues);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMXdrBulkReader::isAtEnd() const
+{
+	return m_position == m_bufferSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** Write the collection flag, parameters and number of elements
+ */
+static void DQMXdrBulkCodec_encodeHeader(int flag, const EVENT::LCParameters *const pParameters, size_t nElements,
+		DQMXdrBulkWriter &writer)
+{
+	EVENT::StringVec keys;
+
+	writer.writeUInt(flag);
+
+	if(NULL != pParameters)
+		pParameters->getIntKeys(keys);
+
+	writer.writeUInt(keys.size());
+
+	for(EVENT::StringVec::const_iterator iter = keys.begin(), endIter = keys.end() ; endIter != iter ; ++iter)
+	{
+		EVENT::IntVec values;
+		pParameters->getIntVals(*iter, values);
+
+		writer.writeString(*iter);
+		writer.writeUInt(values.size());
+		writer.writeInts(values.empty() ? NULL : &values[0], values.size());
+	}
+
+	keys.clear();
+
+	if(NULL != pParameters)
+		pParameters->getFloatKeys(keys);
+
+	writer.writeUInt(keys.size());
+
+	for(EVENT::StringVec::const_iterator iter = keys.begin(), endIter = keys.end() ; endIter != iter ; ++iter)
+	{
+		EVENT::FloatVec values;
+		pParameters->getFloatVals(*iter, values);
+
+		writer.writeString(*iter);
+		writer.writeUInt(values.size());
+		writer.writeFloats(values.empty() ? NULL : &values[0], values.size());
+	}
+
+	keys.clear();
+
+	if(NULL != pParameters)
+		pParameters->getStringKeys(keys);
+
+	writer.writeUInt(keys.size());
+
+	for(EVENT::StringVec::const_iterator iter = keys.begin(), endIter = keys.end() ; endIter != iter ; ++iter)
+	{
+		EVENT::StringVec values;
+		pParameters->getStringVals(*iter, values);
+
+		writer.writeString(*iter);
+		writer.writeUInt(values.size());
+
+		for(EVENT::StringVec::const_iterator valueIter = values.begin(), valueEndIter = values.end() ; valueEndIter != valueIter ; ++valueIter)
+			writer.writeString(*valueIter);
+	}
+
+	writer.writeUInt(nElements);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+/** Read the collection flag, parameters and number of elements. Return NULL on error
+ */
+static IMPL::LCCollectionVec *DQMXdrBulkCodec_decodeHeader(DQMXdrBulkReader &reader, const std::string &typeName,
+		uint32_t &nElements)
+{
+	IMPL::LCCollectionVec *pCollection = new IMPL::LCCollectionVec(typeName);
+	uint32_t flag = 0, nKeys = 0, nValues = 0;
+	std::string key;
+
+	bool valid = reader.readUInt(flag);
+	pCollection->setFlag(flag);
+
+	valid = valid && reader.readUInt(nKeys);
+
+	for(uint32_t k = 0 ; valid && k < nKeys ; k++)
+	{
+		valid = reader.readString(key) && reader.readUInt(nValues);
+
+		// values are at least 4 bytes each, bound before allocating
+		EVENT::IntVec values(valid && nValues < (1u << 24) ? nValues : 0);
+		valid = valid && values.size() == nValues && reader.readInts(values.empty() ? NULL : &values[0], nValues);
+
+		if(valid)
+			pCollection->parameters().setValues(key, values);
+	}
+
+	valid = valid && reader.readUInt(nKeys);
+
+	for(uint32_t k = 0 ; valid && k < nKeys ; k++)
+	{
+		valid = reader.readString(key) && reader.readUInt(nValues);
+
+		EVENT::FloatVec values(valid && nValues < (1u << 24) ? nValues : 0);
+		valid = valid && values.size() == nValues && reader.readFloats(values.empty() ? NULL : &values[0], nValues);
+
+		if(valid)
+			pCollection->parameters().setValues(key, values);
+	}
+
+	valid = valid && reader.readUInt(nKeys);
+
+	for(uint32_t k = 0 ; valid && k < nKeys ; k++)
+	{
+		valid = reader.readString(key) && reader.readUInt(nValues);
+
+		EVENT::StringVec values;
+
+		for(uint32_t v = 0 ; valid && v < nValues ; v++)
+		{
+			std::string value;
+			valid = reader.readString(value);
+			values.push_back(value);
+		}
+
+		if(valid)
+			pCollection->parameters().setValues(key, values);
+	}
+
+	valid = valid && reader.readUInt(nElements);
+
+	if(!valid)
+	{
+		delete pCollection;
+		return NULL;
+	}
+
+	return pCollection;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkCodec<EVENT::CalorimeterHit>::Arrays::resize(size_t nHits)
+{
+	m_cellIds0.resize(nHits);
+	m_cellIds1.resize(nHits);
+	m_energies.resize(nHits);
+	m_energyErrors.resize(nHits);
+	m_times.resize(nHits);
+	m_positions.resize(3*nHits);
+	m_types.resize(nHits);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::string &DQMXdrBulkCodec<EVENT::CalorimeterHit>::getTypeName()
+{
+	static const std::string typeName(EVENT::LCIO::CALORIMETERHIT);
+	return typeName;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::CalorimeterHit>::encode(const EVENT::LCCollection *const pCollection, DQMXdrBulkWriter &writer)
+{
+	const int flag = pCollection->getFlag();
+	const size_t nHits = pCollection->getNumberOfElements();
+
+	const bool hasCellId1 = flag & (1 << EVENT::LCIO::CHBIT_ID1);
+	const bool hasPosition = flag & (1 << EVENT::LCIO::CHBIT_LONG);
+	const bool hasEnergyError = flag & (1 << EVENT::LCIO::RCHBIT_ENERGY_ERROR);
+	const bool hasTime = flag & (1 << EVENT::LCIO::RCHBIT_TIME);
+
+	// one array per field, reused between events
+	static thread_local Arrays arrays;
+	arrays.resize(nHits);
+
+	for(size_t h = 0 ; h < nHits ; h++)
+	{
+		const EVENT::CalorimeterHit *const pHit = static_cast<const EVENT::CalorimeterHit *>(pCollection->getElementAt(h));
+
+		arrays.m_cellIds0[h] = pHit->getCellID0();
+		arrays.m_energies[h] = pHit->getEnergy();
+		arrays.m_types[h] = pHit->getType();
+
+		if(hasCellId1)
+			arrays.m_cellIds1[h] = pHit->getCellID1();
+
+		if(hasEnergyError)
+			arrays.m_energyErrors[h] = pHit->getEnergyError();
+
+		if(hasTime)
+			arrays.m_times[h] = pHit->getTime();
+
+		if(hasPosition)
+			memcpy(&arrays.m_positions[3*h], pHit->getPosition(), 3*sizeof(float));
+	}
+
+	return encode(flag, &pCollection->getParameters(), arrays, writer);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::CalorimeterHit>::encode(int flag, const EVENT::LCParameters *const pParameters,
+		const Arrays &arrays, DQMXdrBulkWriter &writer)
+{
+	const size_t nHits = arrays.m_cellIds0.size();
+
+	const bool hasCellId1 = flag & (1 << EVENT::LCIO::CHBIT_ID1);
+	const bool hasPosition = flag & (1 << EVENT::LCIO::CHBIT_LONG);
+	const bool hasEnergyError = flag & (1 << EVENT::LCIO::RCHBIT_ENERGY_ERROR);
+	const bool hasTime = flag & (1 << EVENT::LCIO::RCHBIT_TIME);
+
+	if(arrays.m_energies.size() < nHits || arrays.m_types.size() < nHits
+	|| (hasCellId1 && arrays.m_cellIds1.size() < nHits)
+	|| (hasEnergyError && arrays.m_energyErrors.size() < nHits)
+	|| (hasTime && arrays.m_times.size() < nHits)
+	|| (hasPosition && arrays.m_positions.size() < 3*nHits))
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	DQMXdrBulkCodec_encodeHeader(flag, pParameters, nHits, writer);
+
+	if(0 == nHits)
+		return STATUS_CODE_SUCCESS;
+
+	writer.writeInts(&arrays.m_cellIds0[0], nHits);
+
+	if(hasCellId1)
+		writer.writeInts(&arrays.m_cellIds1[0], nHits);
+
+	writer.writeFloats(&arrays.m_energies[0], nHits);
+
+	if(hasEnergyError)
+		writer.writeFloats(&arrays.m_energyErrors[0], nHits);
+
+	if(hasTime)
+		writer.writeFloats(&arrays.m_times[0], nHits);
+
+	if(hasPosition)
+		writer.writeFloats(&arrays.m_positions[0], 3*nHits);
+
+	writer.writeInts(&arrays.m_types[0], nHits);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::CalorimeterHit>::decode(DQMXdrBulkReader &reader, EVENT::LCCollection *&pCollection)
+{
+	uint32_t nHits = 0;
+	IMPL::LCCollectionVec *pCollectionVec = DQMXdrBulkCodec_decodeHeader(reader, getTypeName(), nHits);
+
+	if(NULL == pCollectionVec)
+		return STATUS_CODE_FAILURE;
+
+	const int flag = pCollectionVec->getFlag();
+
+	const bool hasCellId1 = flag & (1 << EVENT::LCIO::CHBIT_ID1);
+	const bool hasPosition = flag & (1 << EVENT::LCIO::CHBIT_LONG);
+	const bool hasEnergyError = flag & (1 << EVENT::LCIO::RCHBIT_ENERGY_ERROR);
+	const bool hasTime = flag & (1 << EVENT::LCIO::RCHBIT_TIME);
+
+	// reused between events, the decoding is the hot path
+	static thread_local Arrays arrays;
+
+	// at least 3 words per hit, bound before allocating
+	bool valid = nHits < (1u << 26);
+
+	if(valid && nHits > 0)
+	{
+		arrays.resize(nHits);
+
+		valid = reader.readInts(&arrays.m_cellIds0[0], nHits)
+			&& (!hasCellId1 || reader.readInts(&arrays.m_cellIds1[0], nHits))
+			&& reader.readFloats(&arrays.m_energies[0], nHits)
+			&& (!hasEnergyError || reader.readFloats(&arrays.m_energyErrors[0], nHits))
+			&& (!hasTime || reader.readFloats(&arrays.m_times[0], nHits))
+			&& (!hasPosition || reader.readFloats(&arrays.m_positions[0], 3*nHits))
+			&& reader.readInts(&arrays.m_types[0], nHits);
+	}
+
+	if(!valid)
+	{
+		delete pCollectionVec;
+		return STATUS_CODE_FAILURE;
+	}
+
+	pCollectionVec->reserve(nHits);
+
+	for(uint32_t h = 0 ; h < nHits ; h++)
+	{
+		IMPL::CalorimeterHitImpl *pHit = new IMPL::CalorimeterHitImpl();
+
+		pHit->setCellID0(arrays.m_cellIds0[h]);
+		pHit->setEnergy(arrays.m_energies[h]);
+		pHit->setType(arrays.m_types[h]);
+
+		if(hasCellId1)
+			pHit->setCellID1(arrays.m_cellIds1[h]);
+
+		if(hasEnergyError)
+			pHit->setEnergyError(arrays.m_energyErrors[h]);
+
+		if(hasTime)
+			pHit->setTime(arrays.m_times[h]);
+
+		if(hasPosition)
+			pHit->setPosition(&arrays.m_positions[3*h]);
+
+		pCollectionVec->push_back(pHit);
+	}
+
+	pCollection = pCollectionVec;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+void DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::Arrays::resize(size_t nHits)
+{
+	m_cellIds0.resize(nHits);
+	m_cellIds1.resize(nHits);
+	m_amplitudes.resize(nHits);
+	m_timeStamps.resize(nHits);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::string &DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::getTypeName()
+{
+	static const std::string typeName(EVENT::LCIO::RAWCALORIMETERHIT);
+	return typeName;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::encode(const EVENT::LCCollection *const pCollection, DQMXdrBulkWriter &writer)
+{
+	const int flag = pCollection->getFlag();
+	const size_t nHits = pCollection->getNumberOfElements();
+
+	const bool hasCellId1 = flag & (1 << EVENT::LCIO::RCHBIT_ID1);
+
+	static thread_local Arrays arrays;
+	arrays.resize(nHits);
+
+	for(size_t h = 0 ; h < nHits ; h++)
+	{
+		const EVENT::RawCalorimeterHit *const pHit = static_cast<const EVENT::RawCalorimeterHit *>(pCollection->getElementAt(h));
+
+		arrays.m_cellIds0[h] = pHit->getCellID0();
+		arrays.m_amplitudes[h] = pHit->getAmplitude();
+		arrays.m_timeStamps[h] = pHit->getTimeStamp();
+
+		if(hasCellId1)
+			arrays.m_cellIds1[h] = pHit->getCellID1();
+	}
+
+	return encode(flag, &pCollection->getParameters(), arrays, writer);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::encode(int flag, const EVENT::LCParameters *const pParameters,
+		const Arrays &arrays, DQMXdrBulkWriter &writer)
+{
+	const size_t nHits = arrays.m_cellIds0.size();
+	const bool hasCellId1 = flag & (1 << EVENT::LCIO::RCHBIT_ID1);
+
+	if(arrays.m_amplitudes.size() < nHits || arrays.m_timeStamps.size() < nHits
+	|| (hasCellId1 && arrays.m_cellIds1.size() < nHits))
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	DQMXdrBulkCodec_encodeHeader(flag, pParameters, nHits, writer);
+
+	if(0 == nHits)
+		return STATUS_CODE_SUCCESS;
+
+	writer.writeInts(&arrays.m_cellIds0[0], nHits);
+
+	if(hasCellId1)
+		writer.writeInts(&arrays.m_cellIds1[0], nHits);
+
+	writer.writeInts(&arrays.m_amplitudes[0], nHits);
+	writer.writeInts(&arrays.m_timeStamps[0], nHits);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBulkCodec<EVENT::RawCalorimeterHit>::decode(DQMXdrBulkReader &reader, EVENT::LCCollection *&pCollection)
+{
+	uint32_t nHits = 0;
+	IMPL::LCCollectionVec *pCollectionVec = DQMXdrBulkCodec_decodeHeader(reader, getTypeName(), nHits);
+
+	if(NULL == pCollectionVec)
+		return STATUS_CODE_FAILURE;
+
+	const bool hasCellId1 = pCollectionVec->getFlag() & (1 << EVENT::LCIO::RCHBIT_ID1);
+
+	static thread_local Arrays arrays;
+
+	bool valid = nHits < (1u << 26);
+
+	if(valid && nHits > 0)
+	{
+		arrays.resize(nHits);
+
+		valid = reader.readInts(&arrays.m_cellIds0[0], nHits)
+			&& (!hasCellId1 || reader.readInts(&arrays.m_cellIds1[0], nHits))
+			&& reader.readInts(&arrays.m_amplitudes[0], nHits)
+			&& reader.readInts(&arrays.m_timeStamps[0], nHits);
+	}
+
+	if(!valid)
+	{
+		delete pCollectionVec;
+		return STATUS_CODE_FAILURE;
+	}
+
+	pCollectionVec->reserve(nHits);
+
+	for(uint32_t h = 0 ; h < nHits ; h++)
+	{
+		IMPL::RawCalorimeterHitImpl *pHit = new IMPL::RawCalorimeterHitImpl();
+
+		pHit->setCellID0(arrays.m_cellIds0[h]);
+		pHit->setAmplitude(arrays.m_amplitudes[h]);
+		pHit->setTimeStamp(arrays.m_timeStamps[h]);
+
+		if(hasCellId1)
+			pHit->setCellID1(arrays.m_cellIds1[h]);
+
+		pCollectionVec->push_back(pHit);
+	}
+
+	pCollection = pCollectionVec;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
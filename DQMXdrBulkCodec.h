@@ -0,0 +1,278 @@
+/*
+ *
+ * DQMXdrBulkCodec.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMXDRBULKCODEC_H
+#define DQMXDRBULKCODEC_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- lcio headers
+#include "EVENT/LCCollection.h"
+#include "EVENT/CalorimeterHit.h"
+#include "EVENT/RawCalorimeterHit.h"
+#include "EVENT/LCParameters.h"
+
+// -- std headers
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace dqm4hep
+{
+
+/** Convert an array of 32 bits words between host and xdr (big endian) byte order.
+ *  A single loop over the whole array, vectorized by the compiler
+ */
+inline void DQMXdrBulkSwap32(const uint32_t *pIn, uint32_t *pOut, size_t nWords)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if(pIn != pOut)
+		memcpy(pOut, pIn, nWords*sizeof(uint32_t));
+#else
+	for(size_t i = 0 ; i < nWords ; i++)
+		pOut[i] = __builtin_bswap32(pIn[i]);
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrBulkWriter class
+ *
+ *  Append xdr encoded values to a byte buffer. Arrays are
+ *  converted in one go
+ */
+class DQMXdrBulkWriter
+{
+public:
+	/** Constructor. The buffer is cleared
+	 */
+	DQMXdrBulkWriter(std::vector<char> &buffer);
+
+	void writeUInt(uint32_t value);
+	void writeFloat(float value);
+	void writeString(const std::string &value);
+	void writeUInts(const uint32_t *pValues, size_t nValues);
+	void writeInts(const int32_t *pValues, size_t nValues);
+	void writeFloats(const float *pValues, size_t nValues);
+
+private:
+	/** Grow the buffer and return the position of the new words
+	 */
+	uint32_t *grow(size_t nWords);
+
+	std::vector<char>          &m_buffer;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrBulkReader class
+ *
+ *  Read xdr encoded values from a byte buffer. All the read
+ *  functions return false on buffer overrun
+ */
+class DQMXdrBulkReader
+{
+public:
+	/** Constructor. The buffer is not owned
+	 */
+	DQMXdrBulkReader(const char *pBuffer, size_t bufferSize);
+
+	bool readUInt(uint32_t &value);
+	bool readFloat(float &value);
+	bool readString(std::string &value);
+	bool readUInts(uint32_t *pValues, size_t nValues);
+	bool readInts(int32_t *pValues, size_t nValues);
+	bool readFloats(float *pValues, size_t nValues);
+
+	/** Whether the whole buffer has been read
+	 */
+	bool isAtEnd() const;
+
+private:
+	/** Return the position of the next words and move forward, NULL on overrun
+	 */
+	const uint32_t *consume(size_t nWords);
+
+	const char                 *m_pBuffer;
+	size_t                      m_bufferSize;
+	size_t                      m_position;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrBulkCodec class
+ *
+ *  Bulk xdr codec for the elements of an lcio collection type. Each field
+ *  is stored as one contiguous array (structure of arrays) converted in a
+ *  single pass, instead of one element and one field at a time.
+ *  Only specialized for the hot collection types, the primary template
+ *  is not defined.
+ *
+ *  Encoding is possible from a collection or directly from the field
+ *  arrays, so that a producer can write a collection without creating
+ *  lcio objects
+ */
+template <typename T>
+class DQMXdrBulkCodec;
+
+/** Bulk codec for CalorimeterHit collections. The contributions
+ *  (raw hit links) are not encoded
+ */
+template <>
+class DQMXdrBulkCodec<EVENT::CalorimeterHit>
+{
+public:
+	/** Arrays class
+	 *
+	 *  The fields of the hits of a collection. The optional fields
+	 *  are only read if the collection flag has the matching bit
+	 */
+	class Arrays
+	{
+	public:
+		/** Resize all the arrays for the given number of hits
+		 */
+		void resize(size_t nHits);
+
+		std::vector<int32_t>    m_cellIds0;
+		std::vector<int32_t>    m_cellIds1;        ///< Optional, LCIO::CHBIT_ID1
+		std::vector<float>      m_energies;
+		std::vector<float>      m_energyErrors;    ///< Optional, LCIO::RCHBIT_ENERGY_ERROR
+		std::vector<float>      m_times;           ///< Optional, LCIO::RCHBIT_TIME
+		std::vector<float>      m_positions;       ///< Optional, LCIO::CHBIT_LONG, x y z per hit
+		std::vector<int32_t>    m_types;
+	};
+
+	static const std::string &getTypeName();
+	static StatusCode encode(const EVENT::LCCollection *const pCollection, DQMXdrBulkWriter &writer);
+	static StatusCode encode(int flag, const EVENT::LCParameters *const pParameters, const Arrays &arrays, DQMXdrBulkWriter &writer);
+	static StatusCode decode(DQMXdrBulkReader &reader, EVENT::LCCollection *&pCollection);
+};
+
+/** Bulk codec for RawCalorimeterHit collections
+ */
+template <>
+class DQMXdrBulkCodec<EVENT::RawCalorimeterHit>
+{
+public:
+	/** Arrays class
+	 *
+	 *  The fields of the hits of a collection. The optional fields
+	 *  are only read if the collection flag has the matching bit
+	 */
+	class Arrays
+	{
+	public:
+		/** Resize all the arrays for the given number of hits
+		 */
+		void resize(size_t nHits);
+
+		std::vector<int32_t>    m_cellIds0;
+		std::vector<int32_t>    m_cellIds1;        ///< Optional, LCIO::RCHBIT_ID1
+		std::vector<int32_t>    m_amplitudes;
+		std::vector<int32_t>    m_timeStamps;
+	};
+
+	static const std::string &getTypeName();
+	static StatusCode encode(const EVENT::LCCollection *const pCollection, DQMXdrBulkWriter &writer);
+	static StatusCode encode(int flag, const EVENT::LCParameters *const pParameters, const Arrays &arrays, DQMXdrBulkWriter &writer);
+	static StatusCode decode(DQMXdrBulkReader &reader, EVENT::LCCollection *&pCollection);
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrBulkCodecList class
+ *
+ *  Compile time list of bulk codecs. The codec is selected from the
+ *  collection type name, the per type code is resolved at compile time
+ */
+template <typename... Types>
+class DQMXdrBulkCodecList;
+
+template <>
+class DQMXdrBulkCodecList<>
+{
+public:
+	static bool isSupported(const std::string &)
+	{
+		return false;
+	}
+
+	static StatusCode encode(const EVENT::LCCollection *const, DQMXdrBulkWriter &)
+	{
+		return STATUS_CODE_NOT_FOUND;
+	}
+
+	static StatusCode decode(const std::string &, DQMXdrBulkReader &, EVENT::LCCollection *&)
+	{
+		return STATUS_CODE_NOT_FOUND;
+	}
+};
+
+template <typename T, typename... Types>
+class DQMXdrBulkCodecList<T, Types...>
+{
+public:
+	/** Whether a collection type has a bulk codec
+	 */
+	static bool isSupported(const std::string &typeName)
+	{
+		return DQMXdrBulkCodec<T>::getTypeName() == typeName || DQMXdrBulkCodecList<Types...>::isSupported(typeName);
+	}
+
+	/** Encode a collection with the codec of its type
+	 */
+	static StatusCode encode(const EVENT::LCCollection *const pCollection, DQMXdrBulkWriter &writer)
+	{
+		if(DQMXdrBulkCodec<T>::getTypeName() == pCollection->getTypeName())
+			return DQMXdrBulkCodec<T>::encode(pCollection, writer);
+
+		return DQMXdrBulkCodecList<Types...>::encode(pCollection, writer);
+	}
+
+	/** Decode a collection with the codec of the given type
+	 */
+	static StatusCode decode(const std::string &typeName, DQMXdrBulkReader &reader, EVENT::LCCollection *&pCollection)
+	{
+		if(DQMXdrBulkCodec<T>::getTypeName() == typeName)
+			return DQMXdrBulkCodec<T>::decode(reader, pCollection);
+
+		return DQMXdrBulkCodecList<Types...>::decode(typeName, reader, pCollection);
+	}
+};
+
+/** The collection types encoded in bulk by DQMBulkLCEventStreamer
+ */
+typedef DQMXdrBulkCodecList<EVENT::CalorimeterHit, EVENT::RawCalorimeterHit> DQMLCBulkCodecs;
+
+}
+
+#endif  //  DQMXDRBULKCODEC_H
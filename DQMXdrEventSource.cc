@@ -0,0 +1,438 @@
+/*
+ *
+ * DQMXdrEventSource.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMXdrEventSource.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- std headers
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// -- system headers
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dqm4hep
+{
+
+DQMXdrBufferEventSource::DQMXdrBufferEventSource(xdrstream::BufferDevice *pInDevice) :
+	m_pInDevice(pInDevice),
+	m_position(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrBufferEventSource::~DQMXdrBufferEventSource()
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrBufferEventSource::readNextRecord(xdrstream::BufferDevice *pDevice)
+{
+	const xdrstream::xdr_size_t bufferSize = m_pInDevice->getBufferSize();
+
+	if(m_position >= bufferSize)
+		return STATUS_CODE_OUT_OF_RANGE;
+
+	uint32_t recordSize = 0;
+
+	if(bufferSize - m_position < sizeof(recordSize))
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Truncated record size at offset " << m_position );
+		return STATUS_CODE_FAILURE;
+	}
+
+	memcpy(&recordSize, m_pInDevice->getBuffer() + m_position, sizeof(recordSize));
+	recordSize = ntohl(recordSize);
+
+	const xdrstream::xdr_size_t recordPosition = m_position + sizeof(recordSize);
+
+	if(0 == recordSize || bufferSize - recordPosition < recordSize)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Invalid record size " << recordSize << " at offset " << m_position );
+		return STATUS_CODE_FAILURE;
+	}
+
+	// no copy, the record is read in place by the next stages
+	pDevice->setBuffer(m_pInDevice->getBuffer() + recordPosition, recordSize, false);
+	pDevice->setOwner(false);
+	m_position = recordPosition + recordSize;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrStreamEventSource::DQMXdrStreamEventSource(std::istream &inputStream) :
+	m_inputStream(inputStream),
+	m_nRecords(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrStreamEventSource::~DQMXdrStreamEventSource()
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrStreamEventSource::readNextRecord(xdrstream::BufferDevice *pDevice)
+{
+	uint32_t recordSize = 0;
+
+	// blocks until the producer writes the next record or closes the stream
+	m_inputStream.read(reinterpret_cast<char *>(&recordSize), sizeof(recordSize));
+
+	if(0 == m_inputStream.gcount() && m_inputStream.eof())
+		return STATUS_CODE_OUT_OF_RANGE;
+
+	if(sizeof(recordSize) != static_cast<size_t>(m_inputStream.gcount()))
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Truncated record size after record " << m_nRecords );
+		return STATUS_CODE_FAILURE;
+	}
+
+	recordSize = ntohl(recordSize);
+
+	if(0 == recordSize)
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Invalid record size " << recordSize << " after record " << m_nRecords );
+		return STATUS_CODE_FAILURE;
+	}
+
+	// the previous record of this device has been published, its buffer can be reused
+	std::vector<char> &recordBuffer(m_recordBuffers[pDevice]);
+
+	if(recordBuffer.size() < recordSize)
+		recordBuffer.resize(recordSize);
+
+	m_inputStream.read(&recordBuffer[0], recordSize);
+
+	if(recordSize != static_cast<size_t>(m_inputStream.gcount()))
+	{
+		LOG4CXX_ERROR( dqmMainLogger , "Truncated record " << m_nRecords << " : read " << m_inputStream.gcount() << " bytes out of " << recordSize );
+		return STATUS_CODE_FAILURE;
+	}
+
+	pDevice->setBuffer(&recordBuffer[0], recordSize, false);
+	pDevice->setOwner(false);
+	++m_nRecords;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMXdrStreamEventSource::getNRecords() const
+{
+	return m_nRecords;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** Index file layout : header followed by the record offsets
+ */
+struct DQMXdrIndexHeader
+{
+	uint32_t     m_magic;
+	uint32_t     m_version;
+	uint64_t     m_fileSize;           ///< The indexed file size, to detect a changed file
+	int64_t      m_modificationTime;   ///< The indexed file modification time
+	uint64_t     m_nOffsets;
+};
+
+static const uint32_t DQMXdrIndex_magic = 0x58444d44;    // "DMDX"
+static const uint32_t DQMXdrIndex_version = 1;
+static const uint64_t DQMXdrFile_readAheadSize = 16*1024*1024;
+
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrFileEventSource::DQMXdrFileEventSource(const std::vector<std::string> &fileNames) :
+	m_fileNames(fileNames),
+	m_currentFile(0),
+	m_currentRecord(0),
+	m_readAheadOffset(0)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMXdrFileEventSource::~DQMXdrFileEventSource()
+{
+	for(std::vector<File>::iterator iter = m_files.begin(), endIter = m_files.end() ;
+			endIter != iter ; ++iter)
+		munmap(iter->m_pData, iter->m_size);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::open()
+{
+	for(std::vector<std::string>::const_iterator iter = m_fileNames.begin(), endIter = m_fileNames.end() ;
+			endIter != iter ; ++iter)
+	{
+		int fd = ::open(iter->c_str(), O_RDONLY);
+
+		if(fd < 0)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Couldn't open file " << *iter );
+			return STATUS_CODE_NOT_FOUND;
+		}
+
+		struct stat fileStat;
+
+		if(0 != fstat(fd, &fileStat) || 0 == fileStat.st_size)
+		{
+			::close(fd);
+			LOG4CXX_WARN( dqmMainLogger , "Empty or unreadable file " << *iter << ", skipped" );
+			continue;
+		}
+
+		File file;
+		file.m_fileName = *iter;
+		file.m_size = fileStat.st_size;
+		file.m_modificationTime = fileStat.st_mtime;
+		file.m_pData = static_cast<char*>(mmap(NULL, file.m_size, PROT_READ, MAP_PRIVATE, fd, 0));
+		::close(fd);
+
+		if(MAP_FAILED == file.m_pData)
+		{
+			LOG4CXX_ERROR( dqmMainLogger , "Couldn't map file " << *iter );
+			return STATUS_CODE_FAILURE;
+		}
+
+		m_files.push_back(file);
+		File &mappedFile = m_files.back();
+
+		if(STATUS_CODE_SUCCESS != this->loadIndex(mappedFile))
+		{
+			RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->buildIndex(mappedFile));
+
+			// read only directory is not an error, the index is just rebuilt next time
+			if(STATUS_CODE_SUCCESS != this->saveIndex(mappedFile))
+				LOG4CXX_WARN( dqmMainLogger , "Couldn't save index of file " << *iter );
+		}
+
+		LOG4CXX_INFO( dqmMainLogger , "File " << *iter << " : " << mappedFile.m_offsets.size()-1 << " events" );
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMXdrFileEventSource::getNEvents() const
+{
+	size_t nEvents = 0;
+
+	for(std::vector<File>::const_iterator iter = m_files.begin(), endIter = m_files.end() ;
+			endIter != iter ; ++iter)
+		nEvents += iter->m_offsets.size()-1;
+
+	return nEvents;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::skipNEvents(size_t nEvents)
+{
+	// only walk the files, never the records
+	while(nEvents > 0 && m_currentFile < m_files.size())
+	{
+		const size_t nRemaining = m_files[m_currentFile].m_offsets.size()-1 - m_currentRecord;
+
+		if(nEvents < nRemaining)
+		{
+			m_currentRecord += nEvents;
+			nEvents = 0;
+			break;
+		}
+
+		nEvents -= nRemaining;
+		m_currentFile++;
+		m_currentRecord = 0;
+	}
+
+	m_readAheadOffset = 0;
+
+	return 0 == nEvents ? STATUS_CODE_SUCCESS : STATUS_CODE_OUT_OF_RANGE;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::readNextRecord(xdrstream::BufferDevice *pDevice)
+{
+	while(m_currentFile < m_files.size() && m_currentRecord+1 >= m_files[m_currentFile].m_offsets.size())
+	{
+		m_currentFile++;
+		m_currentRecord = 0;
+		m_readAheadOffset = 0;
+	}
+
+	if(m_currentFile >= m_files.size())
+		return STATUS_CODE_OUT_OF_RANGE;
+
+	const File &file = m_files[m_currentFile];
+	const uint64_t startOffset = file.m_offsets[m_currentRecord];
+	const uint64_t endOffset = file.m_offsets[m_currentRecord+1];
+
+	// keep the kernel one window ahead of the reader
+	if(endOffset + DQMXdrFile_readAheadSize/2 > m_readAheadOffset && m_readAheadOffset < file.m_size)
+	{
+		static const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+		const uint64_t adviceStart = (std::max(m_readAheadOffset, startOffset) / pageSize) * pageSize;
+		const uint64_t adviceEnd = std::min<uint64_t>(adviceStart + DQMXdrFile_readAheadSize, file.m_size);
+
+		madvise(file.m_pData + adviceStart, adviceEnd - adviceStart, MADV_WILLNEED);
+		m_readAheadOffset = adviceEnd;
+	}
+
+	pDevice->setBuffer(file.m_pData + startOffset, endOffset - startOffset, false);
+	pDevice->setOwner(false);
+
+	m_currentRecord++;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::loadIndex(File &file) const
+{
+	FILE *pIndexFile = fopen((file.m_fileName + ".dqmidx").c_str(), "rb");
+
+	if(NULL == pIndexFile)
+		return STATUS_CODE_NOT_FOUND;
+
+	DQMXdrIndexHeader header;
+	StatusCode statusCode = STATUS_CODE_SUCCESS;
+
+	if(1 != fread(&header, sizeof(header), 1, pIndexFile)
+	|| DQMXdrIndex_magic != header.m_magic || DQMXdrIndex_version != header.m_version
+	|| file.m_size != header.m_fileSize || file.m_modificationTime != header.m_modificationTime
+	|| 0 == header.m_nOffsets)
+	{
+		// stale index, the file has changed
+		statusCode = STATUS_CODE_INVALID_PARAMETER;
+	}
+	else
+	{
+		file.m_offsets.resize(header.m_nOffsets);
+
+		if(header.m_nOffsets != fread(&file.m_offsets[0], sizeof(uint64_t), header.m_nOffsets, pIndexFile)
+		|| file.m_offsets.back() > file.m_size)
+		{
+			file.m_offsets.clear();
+			statusCode = STATUS_CODE_FAILURE;
+		}
+	}
+
+	fclose(pIndexFile);
+
+	return statusCode;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::buildIndex(File &file) const
+{
+	LOG4CXX_INFO( dqmMainLogger , "Building event index of file " << file.m_fileName << " ..." );
+
+	// single sequential pass
+	madvise(file.m_pData, file.m_size, MADV_SEQUENTIAL);
+	madvise(file.m_pData, std::min<uint64_t>(file.m_size, DQMXdrFile_readAheadSize), MADV_WILLNEED);
+
+	xdrstream::BufferDevice device(file.m_pData, file.m_size, false);
+	device.setOwner(false);
+	xdrlcio::XdrLcio xdrLcio;
+
+	file.m_offsets.clear();
+	file.m_offsets.push_back(0);
+
+	while(device.getPosition() < file.m_size)
+	{
+		if(xdrstream::XDR_SUCCESS != xdrLcio.readNextEvent(&device))
+		{
+			LOG4CXX_WARN( dqmMainLogger , "Truncated or corrupted record at offset " << file.m_offsets.back()
+					<< " in file " << file.m_fileName << ", ignoring the rest of the file" );
+			break;
+		}
+
+		file.m_offsets.push_back(device.getPosition());
+	}
+
+	// back to random access for the replay, read ahead is done by hand
+	madvise(file.m_pData, file.m_size, MADV_NORMAL);
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMXdrFileEventSource::saveIndex(const File &file) const
+{
+	const std::string indexFileName(file.m_fileName + ".dqmidx");
+	const std::string tmpFileName(indexFileName + ".tmp");
+	FILE *pIndexFile = fopen(tmpFileName.c_str(), "wb");
+
+	if(NULL == pIndexFile)
+		return STATUS_CODE_FAILURE;
+
+	DQMXdrIndexHeader header;
+	header.m_magic = DQMXdrIndex_magic;
+	header.m_version = DQMXdrIndex_version;
+	header.m_fileSize = file.m_size;
+	header.m_modificationTime = file.m_modificationTime;
+	header.m_nOffsets = file.m_offsets.size();
+
+	bool success = (1 == fwrite(&header, sizeof(header), 1, pIndexFile))
+			&& (file.m_offsets.size() == fwrite(&file.m_offsets[0], sizeof(uint64_t), file.m_offsets.size(), pIndexFile));
+
+	success = (0 == fclose(pIndexFile)) && success;
+
+	if(!success || 0 != std::rename(tmpFileName.c_str(), indexFileName.c_str()))
+	{
+		std::remove(tmpFileName.c_str());
+		return STATUS_CODE_FAILURE;
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
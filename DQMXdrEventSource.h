@@ -0,0 +1,202 @@
+/*
+ *
+ * DQMXdrEventSource.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMXDREVENTSOURCE_H
+#define DQMXDREVENTSOURCE_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- xdrstream headers
+#include "xdrstream/BufferDevice.h"
+
+// -- xdrlcio headers
+#include "xdrlcio/XdrLcio.h"
+
+// -- std headers
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
+#include <cstdint>
+
+namespace dqm4hep
+{
+
+/** DQMXdrEventSource class
+ *
+ *  Source of raw xdr lcio event records, as read by the first
+ *  stage of the stream service pipeline
+ */
+class DQMXdrEventSource
+{
+public:
+	/** Destructor
+	 */
+	virtual ~DQMXdrEventSource() {}
+
+	/** Point the device on the next event record. The record memory belongs to
+	 *  the source and stays valid until the next record is read in the same
+	 *  device or the source is destroyed.
+	 *  Return STATUS_CODE_OUT_OF_RANGE at the end of the source
+	 */
+	virtual StatusCode readNextRecord(xdrstream::BufferDevice *pDevice) = 0;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrBufferEventSource class
+ *
+ *  Read length framed event records from an in-memory buffer device :
+ *  each record is preceded by its size, as a 32 bits xdr (big endian)
+ *  unsigned integer. The records are handed out in place, without
+ *  decoding them to find their end
+ */
+class DQMXdrBufferEventSource : public DQMXdrEventSource
+{
+public:
+	/** Constructor. The device is not owned
+	 */
+	DQMXdrBufferEventSource(xdrstream::BufferDevice *pInDevice);
+
+	/** Destructor
+	 */
+	~DQMXdrBufferEventSource();
+
+	StatusCode readNextRecord(xdrstream::BufferDevice *pDevice);
+
+private:
+	xdrstream::BufferDevice      *m_pInDevice;
+	xdrstream::xdr_size_t         m_position;     ///< The offset of the next record size in the input buffer
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrStreamEventSource class
+ *
+ *  Read length framed event records (same framing as DQMXdrBufferEventSource)
+ *  from an input stream, typically the standard input, one record at a
+ *  time as the pipeline asks for it. Each device gets its own record
+ *  buffer, reused for the next records read in it
+ */
+class DQMXdrStreamEventSource : public DQMXdrEventSource
+{
+public:
+	/** Constructor. The stream is not owned
+	 */
+	DQMXdrStreamEventSource(std::istream &inputStream);
+
+	/** Destructor
+	 */
+	~DQMXdrStreamEventSource();
+
+	StatusCode readNextRecord(xdrstream::BufferDevice *pDevice);
+
+	/** Get the number of records read so far
+	 */
+	size_t getNRecords() const;
+
+private:
+	typedef std::map<const xdrstream::BufferDevice *, std::vector<char> > RecordBufferMap;
+
+	std::istream                 &m_inputStream;
+	RecordBufferMap               m_recordBuffers;
+	size_t                        m_nRecords;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMXdrFileEventSource class
+ *
+ *  Read event records from memory mapped xdr lcio files. On first
+ *  use, the record offsets of each file are found by reading the file
+ *  once and saved next to it (<file>.dqmidx), so that later runs and
+ *  event skipping do not need to read the file again. The kernel is
+ *  told to read ahead of the current record.
+ */
+class DQMXdrFileEventSource : public DQMXdrEventSource
+{
+public:
+	/** Constructor
+	 */
+	DQMXdrFileEventSource(const std::vector<std::string> &fileNames);
+
+	/** Destructor. Unmap the files
+	 */
+	~DQMXdrFileEventSource();
+
+	/** Map the files and load or build their indices
+	 */
+	StatusCode open();
+
+	/** Get the total number of events in the files
+	 */
+	size_t getNEvents() const;
+
+	/** Skip n events from the current position
+	 */
+	StatusCode skipNEvents(size_t nEvents);
+
+	StatusCode readNextRecord(xdrstream::BufferDevice *pDevice);
+
+private:
+	/** File class
+	 */
+	class File
+	{
+	public:
+		std::string              m_fileName;
+		char                    *m_pData;
+		size_t                   m_size;
+		int64_t                  m_modificationTime;
+		std::vector<uint64_t>    m_offsets;     ///< Record start offsets, plus the end of the last record
+	};
+
+	/** Load the index of a file from its index file
+	 */
+	StatusCode loadIndex(File &file) const;
+
+	/** Build the index of a file by reading all its records
+	 */
+	StatusCode buildIndex(File &file) const;
+
+	/** Save the index of a file in its index file
+	 */
+	StatusCode saveIndex(const File &file) const;
+
+private:
+	std::vector<std::string>         m_fileNames;
+	std::vector<File>                m_files;
+	size_t                           m_currentFile;
+	size_t                           m_currentRecord;
+	uint64_t                         m_readAheadOffset;    ///< The file offset up to which a read ahead was requested
+};
+
+}
+
+#endif  //  DQMXDREVENTSOURCE_H
@@ -0,0 +1,573 @@
+/*
+ *
+ * DQMBenchmarkTools.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMBenchmarkTools.h"
+#include "dqm4hep/DQMEventStreamer.h"
+
+// -- dqm4ilc headers
+#include "dqm4ilc/DQMLCEvent.h"
+
+// -- lcio headers
+#include "EVENT/LCIO.h"
+#include "IMPL/CalorimeterHitImpl.h"
+#include "IMPL/LCCollectionVec.h"
+#include "IMPL/LCEventImpl.h"
+#include "IMPL/LCFlagImpl.h"
+#include "IMPL/RawCalorimeterHitImpl.h"
+
+// -- xdrstream headers
+#include "xdrstream/BufferDevice.h"
+
+// -- std headers
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+// -- unix headers
+#include <unistd.h>
+
+namespace
+{
+
+// relaxed : only the totals matter, not the ordering with other memory operations
+std::atomic<uint64_t> nAllocations(0);
+std::atomic<uint64_t> nAllocatedBytes(0);
+std::atomic<uint64_t> nDeallocations(0);
+
+void *countedAllocate(std::size_t size)
+{
+	nAllocations.fetch_add(1, std::memory_order_relaxed);
+	nAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+	return std::malloc(size ? size : 1);
+}
+
+void countedDeallocate(void *pointer)
+{
+	if(NULL == pointer)
+		return;
+
+	nDeallocations.fetch_add(1, std::memory_order_relaxed);
+	std::free(pointer);
+}
+
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void *operator new(std::size_t size)
+{
+	void *pointer = countedAllocate(size);
+
+	if(NULL == pointer)
+		throw std::bad_alloc();
+
+	return pointer;
+}
+
+void *operator new[](std::size_t size)
+{
+	void *pointer = countedAllocate(size);
+
+	if(NULL == pointer)
+		throw std::bad_alloc();
+
+	return pointer;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return countedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return countedAllocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+	countedDeallocate(pointer);
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+namespace dqm4hep
+{
+
+uint64_t DQMAllocationCounter::getNAllocations()
+{
+	return nAllocations.load(std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMAllocationCounter::getNAllocatedBytes()
+{
+	return nAllocatedBytes.load(std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMAllocationCounter::getNDeallocations()
+{
+	return nDeallocations.load(std::memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int64_t DQMAllocationCounter::getNLiveAllocations()
+{
+	return static_cast<int64_t>(getNAllocations()) - static_cast<int64_t>(getNDeallocations());
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMLatencyRecorder::DQMLatencyRecorder() :
+	m_sorted(true)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLatencyRecorder::reserve(size_t n)
+{
+	m_latencies.reserve(n);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLatencyRecorder::record(const Clock::time_point &start, const Clock::time_point &end)
+{
+	m_latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	m_sorted = false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMLatencyRecorder::getN() const
+{
+	return m_latencies.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMLatencyRecorder::getPercentile(double percentile)
+{
+	if(m_latencies.empty())
+		return 0.;
+
+	if(!m_sorted)
+	{
+		std::sort(m_latencies.begin(), m_latencies.end());
+		m_sorted = true;
+	}
+
+	// nearest rank
+	percentile = std::min(100., std::max(0., percentile));
+	size_t rank = static_cast<size_t>(percentile / 100. * (m_latencies.size() - 1) + 0.5);
+
+	return m_latencies[rank] / 1000.;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMLatencyRecorder::getMean() const
+{
+	if(m_latencies.empty())
+		return 0.;
+
+	double sum = 0.;
+
+	for(std::vector<uint64_t>::const_iterator iter = m_latencies.begin(), endIter = m_latencies.end() ;
+			endIter != iter ; ++iter)
+		sum += *iter;
+
+	return sum / m_latencies.size() / 1000.;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMLatencyRecorder::clear()
+{
+	m_latencies.clear();
+	m_sorted = true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMMemoryMonitor::getResidentSize()
+{
+	// size and resident, in pages
+	std::ifstream statm("/proc/self/statm");
+	uint64_t size = 0, residentPages = 0;
+
+	if(!(statm >> size >> residentPages))
+		return 0;
+
+	return residentPages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMMemoryMonitor::DQMMemoryMonitor() :
+	m_startTime(std::chrono::steady_clock::now())
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const DQMMemoryMonitor::Sample &DQMMemoryMonitor::sample(uint64_t nEvents, uint64_t queueDepth)
+{
+	Sample sample;
+	sample.m_nEvents = nEvents;
+	sample.m_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+	sample.m_residentSize = getResidentSize();
+	sample.m_nLiveAllocations = DQMAllocationCounter::getNLiveAllocations();
+	sample.m_queueDepth = queueDepth;
+
+	m_samples.push_back(sample);
+
+	return m_samples.back();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::vector<DQMMemoryMonitor::Sample> &DQMMemoryMonitor::getSamples() const
+{
+	return m_samples;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMMemoryMonitor::getResidentSizeDrift(float skipFraction) const
+{
+	return this->fitSlope(skipFraction, &Sample::m_residentSize);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMMemoryMonitor::getLiveAllocationDrift(float skipFraction) const
+{
+	return this->fitSlope(skipFraction, &Sample::m_nLiveAllocations);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint64_t DQMMemoryMonitor::getMaxQueueDepth(float skipFraction) const
+{
+	if(m_samples.empty())
+		return 0;
+
+	const double firstEvent = skipFraction * m_samples.back().m_nEvents;
+	uint64_t maxQueueDepth = 0;
+
+	for(std::vector<Sample>::const_iterator iter = m_samples.begin(), endIter = m_samples.end() ; endIter != iter ; ++iter)
+	{
+		if(iter->m_nEvents >= firstEvent)
+			maxQueueDepth = std::max(maxQueueDepth, iter->m_queueDepth);
+	}
+
+	return maxQueueDepth;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+template <typename T>
+double DQMMemoryMonitor::fitSlope(float skipFraction, T Sample::*pQuantity) const
+{
+	if(m_samples.empty())
+		return 0.;
+
+	const double firstEvent = skipFraction * m_samples.back().m_nEvents;
+	double n = 0., sumX = 0., sumY = 0., sumXX = 0., sumXY = 0.;
+
+	for(std::vector<Sample>::const_iterator iter = m_samples.begin(), endIter = m_samples.end() ; endIter != iter ; ++iter)
+	{
+		if(iter->m_nEvents < firstEvent)
+			continue;
+
+		const double x = static_cast<double>(iter->m_nEvents);
+		const double y = static_cast<double>((*iter).*pQuantity);
+
+		n += 1.;
+		sumX += x;
+		sumY += y;
+		sumXX += x*x;
+		sumXY += x*y;
+	}
+
+	const double denominator = n*sumXX - sumX*sumX;
+
+	if(n < 2. || 0. == denominator)
+		return 0.;
+
+	return (n*sumXY - sumX*sumY) / denominator;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMSyntheticEventGenerator::DQMSyntheticEventGenerator(unsigned int seed) :
+	m_generator(seed),
+	m_eventSize(64*1024),
+	m_spread(0.f)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMSyntheticEventGenerator::setEventSize(unsigned int eventSize, float spread)
+{
+	if(0 == eventSize || spread < 0.f || spread >= 1.f)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	m_eventSize = eventSize;
+	m_spread = spread;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMSyntheticEventGenerator::setCollectionMix(const std::string &collectionMix)
+{
+	std::vector<Collection> collections;
+	std::vector<std::string> entries;
+	DQM4HEP::tokenize(collectionMix, entries, ",");
+
+	for(std::vector<std::string>::const_iterator iter = entries.begin(), endIter = entries.end() ;
+			endIter != iter ; ++iter)
+	{
+		std::vector<std::string> fields;
+		DQM4HEP::tokenize(*iter, fields, ":");
+		Collection collection;
+
+		if(3 != fields.size())
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		collection.m_name = fields[0];
+		collection.m_type = fields[1];
+		collection.m_nElements = std::strtoul(fields[2].c_str(), NULL, 10);
+
+		if(collection.m_name.empty() || 0 == collection.m_nElements
+		|| (EVENT::LCIO::CALORIMETERHIT != collection.m_type && EVENT::LCIO::RAWCALORIMETERHIT != collection.m_type))
+			return STATUS_CODE_INVALID_PARAMETER;
+
+		collections.push_back(collection);
+	}
+
+	m_collections = collections;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMSyntheticEventGenerator::generate(unsigned int nEvents, DQMEventStreamer *pEventStreamer)
+{
+	if(0 == nEvents)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	if(this->isLCIO() && NULL == pEventStreamer)
+		return STATUS_CODE_INVALID_PTR;
+
+	m_events.clear();
+	m_events.resize(nEvents);
+	std::uniform_int_distribution<int> byteDistribution(0, 255);
+
+	for(unsigned int e=0 ; e<nEvents ; e++)
+	{
+		if(this->isLCIO())
+		{
+			RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->generateLCIO(e, pEventStreamer, m_events[e]));
+			continue;
+		}
+
+		m_events[e].resize(this->spread(m_eventSize));
+
+		for(std::vector<char>::iterator iter = m_events[e].begin(), endIter = m_events[e].end() ;
+				endIter != iter ; ++iter)
+			*iter = static_cast<char>(byteDistribution(m_generator));
+	}
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMSyntheticEventGenerator::isLCIO() const
+{
+	return !m_collections.empty();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMSyntheticEventGenerator::getNEvents() const
+{
+	return m_events.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::vector<char> &DQMSyntheticEventGenerator::getEvent(uint64_t i) const
+{
+	return m_events[i % m_events.size()];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+double DQMSyntheticEventGenerator::getMeanEventSize() const
+{
+	if(m_events.empty())
+		return 0.;
+
+	double size = 0.;
+
+	for(std::vector<std::vector<char> >::const_iterator iter = m_events.begin(), endIter = m_events.end() ;
+			endIter != iter ; ++iter)
+		size += iter->size();
+
+	return size / m_events.size();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::string DQMSyntheticEventGenerator::getFirstCollectionName() const
+{
+	return m_collections.empty() ? std::string() : m_collections.front().m_name;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMSyntheticEventGenerator::spread(unsigned int value)
+{
+	if(0.f == m_spread)
+		return value;
+
+	std::uniform_real_distribution<float> distribution(1.f - m_spread, 1.f + m_spread);
+
+	return std::max(1u, static_cast<unsigned int>(value * distribution(m_generator)));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMSyntheticEventGenerator::generateLCIO(int eventNumber, DQMEventStreamer *pEventStreamer, std::vector<char> &buffer)
+{
+	std::uniform_int_distribution<int> cellDistribution(0, 0xFFFFFF);
+	std::uniform_real_distribution<float> amplitudeDistribution(0.f, 100.f);
+	std::uniform_real_distribution<float> positionDistribution(-1000.f, 1000.f);
+
+	IMPL::LCEventImpl *pLCEvent = new IMPL::LCEventImpl();
+	pLCEvent->setRunNumber(0);
+	pLCEvent->setEventNumber(eventNumber);
+	pLCEvent->setDetectorName("SYNTHETIC");
+
+	for(std::vector<Collection>::const_iterator iter = m_collections.begin(), endIter = m_collections.end() ;
+			endIter != iter ; ++iter)
+	{
+		IMPL::LCCollectionVec *pCollection = new IMPL::LCCollectionVec(iter->m_type);
+		const unsigned int nElements = this->spread(iter->m_nElements);
+
+		if(EVENT::LCIO::CALORIMETERHIT == iter->m_type)
+		{
+			IMPL::LCFlagImpl flag;
+			flag.setBit(EVENT::LCIO::CHBIT_LONG);
+			pCollection->setFlag(flag.getFlag());
+
+			for(unsigned int h=0 ; h<nElements ; h++)
+			{
+				IMPL::CalorimeterHitImpl *pHit = new IMPL::CalorimeterHitImpl();
+				float position[3] = {positionDistribution(m_generator), positionDistribution(m_generator), positionDistribution(m_generator)};
+				pHit->setCellID0(cellDistribution(m_generator));
+				pHit->setCellID1(h);
+				pHit->setEnergy(amplitudeDistribution(m_generator));
+				pHit->setTime(h);
+				pHit->setPosition(position);
+				pCollection->addElement(pHit);
+			}
+		}
+		else
+		{
+			for(unsigned int h=0 ; h<nElements ; h++)
+			{
+				IMPL::RawCalorimeterHitImpl *pHit = new IMPL::RawCalorimeterHitImpl();
+				pHit->setCellID0(cellDistribution(m_generator));
+				pHit->setCellID1(h);
+				pHit->setAmplitude(static_cast<int>(amplitudeDistribution(m_generator)));
+				pHit->setTimeStamp(h);
+				pCollection->addElement(pHit);
+			}
+		}
+
+		pLCEvent->addCollection(pCollection, iter->m_name);
+	}
+
+	// the dqm event owns the lcio event
+	DQMLCEvent event;
+	event.setEvent<EVENT::LCEvent>(pLCEvent, true);
+
+	xdrstream::BufferDevice device(1024*1024);
+	RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, pEventStreamer->write(&event, &device));
+
+	buffer.assign(device.getBuffer(), device.getBuffer() + device.getPosition());
+
+	return STATUS_CODE_SUCCESS;
+}
+
+}
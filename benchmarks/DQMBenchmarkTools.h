@@ -0,0 +1,263 @@
+/*
+ *
+ * DQMBenchmarkTools.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMBENCHMARKTOOLS_H
+#define DQMBENCHMARKTOOLS_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+
+// -- std headers
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dqm4hep
+{
+
+class DQMEventStreamer;
+
+/** DQMAllocationCounter class
+ *
+ *  Count the heap allocations of the whole process. Linking
+ *  DQMBenchmarkTools.cc replaces the global operator new/delete
+ */
+class DQMAllocationCounter
+{
+public:
+	/** Get the number of allocations since the process start
+	 */
+	static uint64_t getNAllocations();
+
+	/** Get the number of allocated bytes since the process start
+	 */
+	static uint64_t getNAllocatedBytes();
+
+	/** Get the number of deallocations since the process start
+	 */
+	static uint64_t getNDeallocations();
+
+	/** Get the number of allocations not released yet
+	 */
+	static int64_t getNLiveAllocations();
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMLatencyRecorder class
+ *
+ *  Record latencies and compute their percentiles. Reserve
+ *  before recording so that the recording does not allocate
+ */
+class DQMLatencyRecorder
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	/** Constructor
+	 */
+	DQMLatencyRecorder();
+
+	/** Reserve room for n latencies
+	 */
+	void reserve(size_t n);
+
+	/** Record a latency between two time points
+	 */
+	void record(const Clock::time_point &start, const Clock::time_point &end);
+
+	/** Get the number of recorded latencies
+	 */
+	size_t getN() const;
+
+	/** Get the percentile (0 to 100) of the recorded latencies (unit usec)
+	 */
+	double getPercentile(double percentile);
+
+	/** Get the mean of the recorded latencies (unit usec)
+	 */
+	double getMean() const;
+
+	/** Remove the recorded latencies
+	 */
+	void clear();
+
+private:
+	std::vector<uint64_t>      m_latencies;    ///< The latencies (unit nsec)
+	bool                       m_sorted;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMMemoryMonitor class
+ *
+ *  Sample the resident memory, the live allocations and a queue depth
+ *  along a long run, and measure their drift per event by a linear fit
+ *  of the samples, skipping the warm up part of the run
+ */
+class DQMMemoryMonitor
+{
+public:
+	/** Sample class
+	 */
+	class Sample
+	{
+	public:
+		uint64_t       m_nEvents;           ///< The number of processed events
+		double         m_time;              ///< The time since the first sample (unit sec)
+		uint64_t       m_residentSize;      ///< The resident memory (unit bytes)
+		int64_t        m_nLiveAllocations;  ///< The number of allocations not released yet
+		uint64_t       m_queueDepth;        ///< The number of queued events
+	};
+
+	/** Get the resident memory of the process (unit bytes), 0 if not available
+	 */
+	static uint64_t getResidentSize();
+
+	/** Constructor
+	 */
+	DQMMemoryMonitor();
+
+	/** Take a sample
+	 */
+	const Sample &sample(uint64_t nEvents, uint64_t queueDepth);
+
+	/** Get the samples
+	 */
+	const std::vector<Sample> &getSamples() const;
+
+	/** Get the resident memory drift (unit bytes per event), fitted
+	 *  on the samples after the given fraction of the events
+	 */
+	double getResidentSizeDrift(float skipFraction) const;
+
+	/** Get the live allocation drift (unit allocations per event), fitted
+	 *  on the samples after the given fraction of the events
+	 */
+	double getLiveAllocationDrift(float skipFraction) const;
+
+	/** Get the max queue depth after the given fraction of the events
+	 */
+	uint64_t getMaxQueueDepth(float skipFraction) const;
+
+private:
+	/** Least square slope of a sample quantity against the number of events
+	 */
+	template <typename T>
+	double fitSlope(float skipFraction, T Sample::*pQuantity) const;
+
+	std::vector<Sample>              m_samples;
+	std::chrono::steady_clock::time_point   m_startTime;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMSyntheticEventGenerator class
+ *
+ *  Generate serialized events for the benchmarks. Two kinds of events :
+ *   - raw buffers of random bytes, with a configurable size
+ *   - lcio events with a configurable collection mix, serialized by
+ *     an event streamer (DQMLCEventStreamer, DQMBulkLCEventStreamer)
+ *
+ *  A pool of distinct events is generated once, and cycled over while
+ *  sending, so that the generation cost is not measured.
+ */
+class DQMSyntheticEventGenerator
+{
+public:
+	/** Constructor
+	 */
+	DQMSyntheticEventGenerator(unsigned int seed = 42);
+
+	/** Set the raw event size (unit bytes) and its relative spread (0.1 : +/- 10 %).
+	 *  The spread also applies to the number of elements per collection
+	 */
+	StatusCode setEventSize(unsigned int eventSize, float spread = 0.f);
+
+	/** Set the collection mix of the lcio events, comma separated
+	 *  "name:type:nElements" entries. Supported types : CalorimeterHit,
+	 *  RawCalorimeterHit. An empty mix generates raw events
+	 */
+	StatusCode setCollectionMix(const std::string &collectionMix);
+
+	/** Generate a pool of n events. The streamer is used for the lcio
+	 *  events only, and is not owned
+	 */
+	StatusCode generate(unsigned int nEvents, DQMEventStreamer *pEventStreamer);
+
+	/** Whether the events are lcio events
+	 */
+	bool isLCIO() const;
+
+	/** Get the number of generated events
+	 */
+	unsigned int getNEvents() const;
+
+	/** Get the i-th generated event, cycling over the pool
+	 */
+	const std::vector<char> &getEvent(uint64_t i) const;
+
+	/** Get the mean generated event size (unit bytes)
+	 */
+	double getMeanEventSize() const;
+
+	/** Get the name of the first collection of the mix, empty for raw events
+	 */
+	std::string getFirstCollectionName() const;
+
+private:
+	/** Collection class
+	 */
+	class Collection
+	{
+	public:
+		std::string      m_name;
+		std::string      m_type;
+		unsigned int     m_nElements;
+	};
+
+	/** Get a size spread around a mean value
+	 */
+	unsigned int spread(unsigned int value);
+
+	/** Generate an lcio event and serialize it in a buffer
+	 */
+	StatusCode generateLCIO(int eventNumber, DQMEventStreamer *pEventStreamer, std::vector<char> &buffer);
+
+	std::mt19937                        m_generator;
+	unsigned int                        m_eventSize;
+	float                               m_spread;
+	std::vector<Collection>             m_collections;
+	std::vector<std::vector<char> >     m_events;
+};
+
+}
+
+#endif  //  DQMBENCHMARKTOOLS_H
@@ -0,0 +1,367 @@
+/*
+ *
+ * DQMCollectorBenchmark.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dqm4hep headers
+#include "DQMCollectorBenchmark.h"
+#include "DQMDimEudaqClient.h"
+
+// -- dim stand-in headers
+#include "dis.hxx"
+
+// -- std headers
+#include <algorithm>
+#include <sstream>
+
+namespace dqm4hep
+{
+
+DQMCollectorBenchmark::DQMCollectorBenchmark(const std::string &collectorName) :
+	m_collectorName(collectorName),
+	m_commandPrefix("DQM4HEP/EventCollector/" + collectorName + "/"),
+	m_collectCommandName(m_commandPrefix + "COLLECT_RAW_EVENT"),
+	m_requestRpcName(m_commandPrefix + "EVENT_RAW_REQUEST"),
+	m_pCollector(NULL)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMCollectorBenchmark::~DQMCollectorBenchmark()
+{
+	this->deleteCollector();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::startCollector(DQMEventStreamer *pEventStreamer, const std::string &streamerName)
+{
+	if(NULL == m_pCollector)
+	{
+		m_pCollector = new DQMDimEudaqClient();
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, m_pCollector->setCollectorName(m_collectorName));
+	}
+
+	if(NULL != pEventStreamer)
+		m_pCollector->setEventStreamer(pEventStreamer, streamerName);
+
+	return m_pCollector->startCollector();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::stopCollector()
+{
+	if(NULL == m_pCollector)
+		return STATUS_CODE_NOT_INITIALIZED;
+
+	return m_pCollector->stopCollector();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMCollectorBenchmark::deleteCollector()
+{
+	if(NULL == m_pCollector)
+		return;
+
+	m_pCollector->stopCollector();
+	delete m_pCollector;
+	m_pCollector = NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::connectClient(int clientId, bool updateMode, const std::string &subEventIdentifier)
+{
+	if(NULL == m_pCollector)
+		return STATUS_CODE_NOT_INITIALIZED;
+
+	if(clientId <= 0)
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	DimStandIn::setClient(clientId, getClientName(clientId));
+
+	int registerClient = 1;
+	int updateModeValue = updateMode ? 1 : 0;
+
+	if(!DimStandIn::sendCommand((m_commandPrefix + "CLIENT_REGISTRATION").c_str(), &registerClient, sizeof(int))
+	|| !DimStandIn::subscribe((m_commandPrefix + "EVENT_RAW_UPDATE").c_str())
+	|| !DimStandIn::sendCommand((m_commandPrefix + "UPDATE_MODE").c_str(), &updateModeValue, sizeof(int)))
+		return STATUS_CODE_FAILURE;
+
+	if(!subEventIdentifier.empty()
+	&& !DimStandIn::sendCommand((m_commandPrefix + "SUB_EVENT_IDENTIFIER").c_str(), subEventIdentifier.c_str(), subEventIdentifier.size()+1))
+		return STATUS_CODE_FAILURE;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::connectClients(unsigned int nClients, unsigned int nSubEventClients, const std::string &subEventIdentifier)
+{
+	for(unsigned int c=1 ; c<=nClients ; c++)
+		RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, this->connectClient(c, true, c <= nSubEventClients ? subEventIdentifier : std::string()));
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMCollectorBenchmark::disconnectClient(int clientId)
+{
+	DimStandIn::exitClient(clientId, getClientName(clientId));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::sendEvent(const std::vector<char> &event)
+{
+	if(event.empty())
+		return STATUS_CODE_INVALID_PARAMETER;
+
+	// as received from a producer : dim gives no client id for commands of unregistered clients
+	DimStandIn::setClient(0, "");
+
+	if(!DimStandIn::sendCommand(m_collectCommandName.c_str(), &event[0], event.size()))
+		return STATUS_CODE_FAILURE;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMCollectorBenchmark::updateEventService()
+{
+	if(NULL != m_pCollector)
+		m_pCollector->updateEventService();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode DQMCollectorBenchmark::requestEvent(const std::string &subEventIdentifier, int &eventSize)
+{
+	const void *pEventBuffer = NULL;
+	eventSize = 0;
+
+	if(!DimStandIn::callRpc(m_requestRpcName.c_str(), subEventIdentifier.c_str(), subEventIdentifier.size()+1, pEventBuffer, eventSize))
+		return STATUS_CODE_FAILURE;
+
+	return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMCollectorBenchmark::getNClients() const
+{
+	return NULL == m_pCollector ? 0 : m_pCollector->getNClients();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DQMCollectorBenchmark::getNRestoredClients() const
+{
+	return NULL == m_pCollector ? 0 : m_pCollector->getNRestoredClients();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMDimEudaqClient *DQMCollectorBenchmark::getCollector() const
+{
+	return m_pCollector;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::string DQMCollectorBenchmark::getClientName(int clientId)
+{
+	std::stringstream clientName;
+	clientName << clientId << "@benchmark";
+
+	return clientName.str();
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMSyntheticTriggerEvent::DQMSyntheticTriggerEvent(uint32_t triggerNumber) :
+	m_triggerNumber(triggerNumber)
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+uint32_t DQMSyntheticTriggerEvent::GetTriggerN() const
+{
+	return m_triggerNumber;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DQMBuilderBenchmark::DQMBuilderBenchmark(unsigned int nProducers, unsigned int maxSkew, size_t maxQueueDepth, unsigned int seed) :
+	m_builder(maxQueueDepth),
+	m_maxSkew(maxSkew),
+	m_nextTriggerNumbers(nProducers, 0),
+	m_connected(nProducers, false),
+	m_generator(seed)
+{
+	m_candidates.reserve(nProducers);
+	m_subEvents.reserve(nProducers);
+
+	for(unsigned int p=0 ; p<nProducers ; p++)
+		this->connect(p);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMBuilderBenchmark::connect(unsigned int producer)
+{
+	if(this->connectProducer(producer))
+		m_builder.connect(producer);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMBuilderBenchmark::disconnect(unsigned int producer)
+{
+	if(this->disconnectProducer(producer))
+		m_builder.disconnect(producer);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMBuilderBenchmark::connectProducer(unsigned int producer)
+{
+	if(producer >= m_connected.size() || m_connected[producer])
+		return false;
+
+	// restart from the slowest connected producer
+	uint32_t minTriggerNumber = static_cast<uint32_t>(-1);
+
+	for(unsigned int p=0 ; p<m_connected.size() ; p++)
+	{
+		if(m_connected[p])
+			minTriggerNumber = std::min(minTriggerNumber, m_nextTriggerNumbers[p]);
+	}
+
+	if(static_cast<uint32_t>(-1) != minTriggerNumber)
+		m_nextTriggerNumbers[producer] = minTriggerNumber;
+
+	m_connected[producer] = true;
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMBuilderBenchmark::disconnectProducer(unsigned int producer)
+{
+	if(producer >= m_connected.size() || !m_connected[producer])
+		return false;
+
+	m_connected[producer] = false;
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DQMBuilderBenchmark::startRun()
+{
+	std::fill(m_nextTriggerNumbers.begin(), m_nextTriggerNumbers.end(), 0);
+	m_builder.clear();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMBuilderBenchmark::isConnected(unsigned int producer) const
+{
+	return producer < m_connected.size() && m_connected[producer];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMBuilderBenchmark::nextEvent(unsigned int &producer, DQMSyntheticTriggerEventPtr &event)
+{
+	uint32_t minTriggerNumber = static_cast<uint32_t>(-1);
+
+	for(unsigned int p=0 ; p<m_connected.size() ; p++)
+	{
+		if(m_connected[p])
+			minTriggerNumber = std::min(minTriggerNumber, m_nextTriggerNumbers[p]);
+	}
+
+	if(static_cast<uint32_t>(-1) == minTriggerNumber)
+		return false;
+
+	m_candidates.clear();
+
+	for(unsigned int p=0 ; p<m_connected.size() ; p++)
+	{
+		if(m_connected[p] && m_nextTriggerNumbers[p] <= minTriggerNumber + m_maxSkew)
+			m_candidates.push_back(p);
+	}
+
+	std::uniform_int_distribution<size_t> distribution(0, m_candidates.size()-1);
+	producer = m_candidates[distribution(m_generator)];
+	event = std::make_shared<const DQMSyntheticTriggerEvent>(m_nextTriggerNumbers[producer]);
+	m_nextTriggerNumbers[producer]++;
+
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DQMBuilderBenchmark::receive(unsigned int producer, const DQMSyntheticTriggerEventPtr &event)
+{
+	uint32_t triggerNumber = 0;
+
+	return m_builder.receive(producer, event, m_subEvents, triggerNumber);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+const std::vector<DQMSyntheticTriggerEventPtr> &DQMBuilderBenchmark::getSubEvents() const
+{
+	return m_subEvents;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DQMBuilderBenchmark::Builder &DQMBuilderBenchmark::getBuilder()
+{
+	return m_builder;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+unsigned int DQMBuilderBenchmark::getNProducers() const
+{
+	return m_connected.size();
+}
+
+}
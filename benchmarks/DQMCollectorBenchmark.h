@@ -0,0 +1,228 @@
+/*
+ *
+ * DQMCollectorBenchmark.h
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DQMCOLLECTORBENCHMARK_H
+#define DQMCOLLECTORBENCHMARK_H
+
+// -- dqm4hep headers
+#include "dqm4hep/DQM4HEP.h"
+#include "DQMEventBuilder.h"
+
+// -- std headers
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace dqm4hep
+{
+
+class DQMDimEudaqClient;
+class DQMEventStreamer;
+
+/** DQMCollectorBenchmark class
+ *
+ *  Drive a DQMDimEudaqClient through the dim stand-in : raw events are
+ *  received on the COLLECT_RAW_EVENT command, published to the update
+ *  clients and requested with the EVENT_RAW_REQUEST rpc, as remote
+ *  producers and clients would do
+ */
+class DQMCollectorBenchmark
+{
+public:
+	/** Constructor
+	 */
+	DQMCollectorBenchmark(const std::string &collectorName);
+
+	/** Destructor
+	 */
+	~DQMCollectorBenchmark();
+
+	/** Create and start the collector. The streamer is owned by the collector, may be NULL.
+	 *  The streamer plugin name tells the collector whether the events are lcio events
+	 */
+	StatusCode startCollector(DQMEventStreamer *pEventStreamer, const std::string &streamerName = "");
+
+	/** Stop the collector, keep it for the next start
+	 */
+	StatusCode stopCollector();
+
+	/** Stop and delete the collector
+	 */
+	void deleteCollector();
+
+	/** Register a client, in update mode or not, optionally on a sub event.
+	 *  Client ids start at 1 (dim ids)
+	 */
+	StatusCode connectClient(int clientId, bool updateMode, const std::string &subEventIdentifier);
+
+	/** Register n clients with ids 1 to n, the first nSubEventClients ones on the sub event
+	 */
+	StatusCode connectClients(unsigned int nClients, unsigned int nSubEventClients, const std::string &subEventIdentifier);
+
+	/** A client exits (dim client exit handler)
+	 */
+	void disconnectClient(int clientId);
+
+	/** Send a raw event to the collector : reception and update of the clients
+	 */
+	StatusCode sendEvent(const std::vector<char> &event);
+
+	/** Publish the current event to the update clients again
+	 */
+	void updateEventService();
+
+	/** Request the current event (sub event if not empty), get the returned size
+	 */
+	StatusCode requestEvent(const std::string &subEventIdentifier, int &eventSize);
+
+	/** Get the number of clients registered in the collector
+	 */
+	size_t getNClients() const;
+
+	/** Get the number of clients of the previous runs kept to be restored
+	 */
+	size_t getNRestoredClients() const;
+
+	/** Get the collector
+	 */
+	DQMDimEudaqClient *getCollector() const;
+
+private:
+	/** Get the name of a client from its id
+	 */
+	static std::string getClientName(int clientId);
+
+	std::string                 m_collectorName;
+	std::string                 m_commandPrefix;
+	std::string                 m_collectCommandName;    ///< Built once, not to allocate on each event
+	std::string                 m_requestRpcName;
+	DQMDimEudaqClient          *m_pCollector;
+};
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMSyntheticTriggerEvent class
+ *
+ *  Stand-in for a eudaq event in the builder : a trigger number
+ */
+class DQMSyntheticTriggerEvent
+{
+public:
+	/** Constructor
+	 */
+	DQMSyntheticTriggerEvent(uint32_t triggerNumber);
+
+	/** Get the trigger number (same name as eudaq::Event)
+	 */
+	uint32_t GetTriggerN() const;
+
+private:
+	uint32_t       m_triggerNumber;
+};
+
+typedef std::shared_ptr<const DQMSyntheticTriggerEvent> DQMSyntheticTriggerEventPtr;
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+/** DQMBuilderBenchmark class
+ *
+ *  Drive the DQMDataCollector event builder with a stand-in for the eudaq
+ *  transport : each producer sends increasing trigger numbers, and the
+ *  producers are interleaved at random, a producer being ahead of the
+ *  slowest one by at most a given skew
+ */
+class DQMBuilderBenchmark
+{
+public:
+	typedef DQMEventBuilder<unsigned int, DQMSyntheticTriggerEventPtr> Builder;
+
+	/** Constructor
+	 */
+	DQMBuilderBenchmark(unsigned int nProducers, unsigned int maxSkew, size_t maxQueueDepth, unsigned int seed = 42);
+
+	/** Connect a producer : it restarts from the trigger number of the slowest producer
+	 */
+	void connect(unsigned int producer);
+
+	/** Disconnect a producer
+	 */
+	void disconnect(unsigned int producer);
+
+	/** Connect a producer on the transport stand-in only : the caller gives the connection
+	 *  to the builder, i.e through a pipeline. Return false if the producer is already connected
+	 */
+	bool connectProducer(unsigned int producer);
+
+	/** Disconnect a producer on the transport stand-in only. Return false if not connected
+	 */
+	bool disconnectProducer(unsigned int producer);
+
+	/** A new run, as DQMDataCollector::DoStartRun : the trigger numbers
+	 *  restart from 0 and the builder queues are cleared
+	 */
+	void startRun();
+
+	/** Whether a producer is connected
+	 */
+	bool isConnected(unsigned int producer) const;
+
+	/** Stand-in for the transport : choose the producer of the next event and create it.
+	 *  Return false if no producer is connected
+	 */
+	bool nextEvent(unsigned int &producer, DQMSyntheticTriggerEventPtr &event);
+
+	/** Give an event to the builder, as DQMDataCollector::DoReceive. Return whether an event was built
+	 */
+	bool receive(unsigned int producer, const DQMSyntheticTriggerEventPtr &event);
+
+	/** Get the sub events of the last built event
+	 */
+	const std::vector<DQMSyntheticTriggerEventPtr> &getSubEvents() const;
+
+	/** Get the builder
+	 */
+	Builder &getBuilder();
+
+	/** Get the number of producers
+	 */
+	unsigned int getNProducers() const;
+
+private:
+	Builder                                     m_builder;
+	unsigned int                                m_maxSkew;
+	std::vector<uint32_t>                       m_nextTriggerNumbers;
+	std::vector<bool>                           m_connected;
+	std::vector<unsigned int>                   m_candidates;
+	std::vector<DQMSyntheticTriggerEventPtr>    m_subEvents;
+	std::mt19937                                m_generator;
+};
+
+}
+
+#endif  //  DQMCOLLECTORBENCHMARK_H
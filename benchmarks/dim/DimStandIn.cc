@@ -0,0 +1,578 @@
+/*
+ *
+ * DimStandIn.cc
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+// -- dim stand-in headers
+#include "dis.hxx"
+#include "dic.hxx"
+
+// -- std headers
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace
+{
+
+/** The registered dim objects and the dispatch state
+ */
+class Registry
+{
+public:
+	std::mutex                                  m_mutex;          ///< Protect the maps
+	std::recursive_mutex                        m_dispatchMutex;  ///< Serialize the handlers, as the dim server thread
+	std::map<std::string, DimService*>           m_services;
+	std::map<std::string, DimCommand*>           m_commands;
+	std::map<std::string, DimRpc*>               m_rpcs;
+	std::map<DimService*, std::set<int> >        m_subscribers;
+	std::vector<DimClientExitHandler*>           m_exitHandlers;
+
+	int                                         m_clientId = 0;   ///< The client of the handler being called
+	std::string                                 m_clientName;
+	std::vector<char>                           m_clientNameBuffer;
+
+	std::atomic<uint64_t>                       m_nUpdates{0};
+	std::atomic<uint64_t>                       m_nClientUpdates{0};
+	std::atomic<uint64_t>                       m_nClientBytes{0};
+	std::atomic<uint64_t>                       m_nCommands{0};
+	std::atomic<uint64_t>                       m_nRpcs{0};
+};
+
+Registry &registry()
+{
+	static Registry *pRegistry = new Registry();
+	return *pRegistry;
+}
+
+// the client of the calling thread, copied to the registry on dispatch
+thread_local int         callerClientId = 0;
+thread_local std::string callerClientName;
+
+/** Set the dispatch client from the calling thread, under the dispatch lock
+ */
+void setDispatchClient(Registry &reg, int clientId, const std::string &clientName)
+{
+	reg.m_clientId = clientId;
+	reg.m_clientName = clientName;
+	reg.m_clientNameBuffer.assign(clientName.begin(), clientName.end());
+	reg.m_clientNameBuffer.push_back('\0');
+}
+
+/** Match a name against a pattern with '*' wildcards
+ */
+bool matchPattern(const char *pPattern, const char *pName)
+{
+	if('\0' == *pPattern)
+		return '\0' == *pName;
+
+	if('*' == *pPattern)
+		return matchPattern(pPattern+1, pName) || ('\0' != *pName && matchPattern(pPattern, pName+1));
+
+	return *pPattern == *pName && matchPattern(pPattern+1, pName+1);
+}
+
+/** Find a registered object. The key string is reused, so that
+ *  a lookup does not allocate once the key capacity is reached
+ */
+template <typename T>
+T *findObject(std::map<std::string, T*> &objects, const char *name)
+{
+	static thread_local std::string key;
+	key.assign(name);
+
+	typename std::map<std::string, T*>::iterator findIter = objects.find(key);
+
+	return objects.end() == findIter ? 0 : findIter->second;
+}
+
+template <typename T>
+void registerObject(std::map<std::string, T*> &objects, const std::string &name, T *pObject)
+{
+	std::lock_guard<std::mutex> lock(registry().m_mutex);
+	objects[name] = pObject;
+}
+
+template <typename T>
+void unregisterObject(std::map<std::string, T*> &objects, const std::string &name, T *pObject)
+{
+	std::lock_guard<std::mutex> lock(registry().m_mutex);
+	typename std::map<std::string, T*>::iterator findIter = objects.find(name);
+
+	if(objects.end() != findIter && findIter->second == pObject)
+		objects.erase(findIter);
+}
+
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DimCommandHandler::DimCommandHandler() :
+	itsCommand(0)
+{
+	/* nop */
+}
+
+DimCommandHandler::~DimCommandHandler()
+{
+	/* nop */
+}
+
+DimCommand *DimCommandHandler::getCommand()
+{
+	return itsCommand;
+}
+
+DimClientExitHandler::~DimClientExitHandler()
+{
+	/* nop */
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DimServer::~DimServer()
+{
+	Registry &reg(registry());
+	std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+	for(std::vector<DimClientExitHandler*>::iterator iter = reg.m_exitHandlers.begin() ; reg.m_exitHandlers.end() != iter ; )
+	{
+		if(*iter == static_cast<DimClientExitHandler*>(this))
+			iter = reg.m_exitHandlers.erase(iter);
+		else
+			++iter;
+	}
+}
+
+void DimServer::start(const char */*name*/)
+{
+	/* nop : no dns */
+}
+
+void DimServer::stop()
+{
+	/* nop : no dns */
+}
+
+int DimServer::getClientId()
+{
+	return registry().m_clientId;
+}
+
+char *DimServer::getClientName()
+{
+	Registry &reg(registry());
+	return reg.m_clientNameBuffer.empty() ? 0 : &reg.m_clientNameBuffer[0];
+}
+
+void DimServer::addClientExitHandler(DimClientExitHandler *pHandler)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::mutex> lock(reg.m_mutex);
+	reg.m_exitHandlers.push_back(pHandler);
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DimService::DimService(const char *name, int &value) :
+	m_name(name),
+	m_pData(&value),
+	m_size(sizeof(int))
+{
+	registerObject(registry().m_services, m_name, this);
+}
+
+DimService::DimService(const char *name, const char */*format*/, void *structure, int size) :
+	m_name(name),
+	m_pData(structure),
+	m_size(size)
+{
+	registerObject(registry().m_services, m_name, this);
+}
+
+DimService::~DimService()
+{
+	unregisterObject(registry().m_services, m_name, this);
+
+	std::lock_guard<std::mutex> lock(registry().m_mutex);
+	registry().m_subscribers.erase(this);
+}
+
+int DimService::updateService()
+{
+	return this->publish(m_pData, m_size, 0);
+}
+
+int DimService::updateService(int &value)
+{
+	m_pData = &value;
+	m_size = sizeof(int);
+	return this->publish(m_pData, m_size, 0);
+}
+
+int DimService::updateService(void *structure, int size)
+{
+	m_pData = structure;
+	m_size = size;
+	return this->publish(m_pData, m_size, 0);
+}
+
+int DimService::selectiveUpdateService(int *cids)
+{
+	return this->publish(m_pData, m_size, cids);
+}
+
+int DimService::selectiveUpdateService(int &value, int *cids)
+{
+	return this->publish(&value, sizeof(int), cids);
+}
+
+int DimService::selectiveUpdateService(void *structure, int size, int *cids)
+{
+	return this->publish(structure, size, cids);
+}
+
+char *DimService::getName()
+{
+	return &m_name[0];
+}
+
+int DimService::publish(const void *pData, int size, int *cids)
+{
+	Registry &reg(registry());
+	uint64_t nClients = 0;
+
+	if(0 != cids)
+	{
+		// 0 terminated list
+		while(0 != cids[nClients])
+			nClients++;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(reg.m_mutex);
+		std::map<DimService*, std::set<int> >::const_iterator findIter = reg.m_subscribers.find(this);
+		nClients = reg.m_subscribers.end() == findIter ? 0 : findIter->second.size();
+	}
+
+	// dim copies the data once to build the message
+	if(0 != pData && size > 0)
+		m_sendBuffer.assign(static_cast<const char*>(pData), static_cast<const char*>(pData) + size);
+
+	reg.m_nUpdates++;
+	reg.m_nClientUpdates += nClients;
+	reg.m_nClientBytes += nClients * static_cast<uint64_t>(size > 0 ? size : 0);
+
+	return static_cast<int>(nClients);
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DimCommand::DimCommand(const char *name, const char */*format*/, DimCommandHandler *pHandler) :
+	m_name(name),
+	m_pHandler(pHandler),
+	m_pData(0),
+	m_size(0)
+{
+	registerObject(registry().m_commands, m_name, this);
+}
+
+DimCommand::~DimCommand()
+{
+	unregisterObject(registry().m_commands, m_name, this);
+}
+
+void *DimCommand::getData()
+{
+	return m_pData;
+}
+
+int DimCommand::getSize()
+{
+	return m_size;
+}
+
+int DimCommand::getInt()
+{
+	int value = 0;
+
+	if(0 != m_pData && m_size >= static_cast<int>(sizeof(int)))
+		memcpy(&value, m_pData, sizeof(int));
+
+	return value;
+}
+
+char *DimCommand::getString()
+{
+	return static_cast<char*>(m_pData);
+}
+
+char *DimCommand::getName()
+{
+	return &m_name[0];
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+DimRpc::DimRpc(const char *name, const char */*formatIn*/, const char */*formatOut*/) :
+	m_name(name),
+	m_pData(0),
+	m_size(0),
+	m_pOutData(0),
+	m_outSize(0)
+{
+	registerObject(registry().m_rpcs, m_name, this);
+}
+
+DimRpc::~DimRpc()
+{
+	unregisterObject(registry().m_rpcs, m_name, this);
+}
+
+void *DimRpc::getData()
+{
+	return m_pData;
+}
+
+int DimRpc::getSize()
+{
+	return m_size;
+}
+
+int DimRpc::getInt()
+{
+	int value = 0;
+
+	if(0 != m_pData && m_size >= static_cast<int>(sizeof(int)))
+		memcpy(&value, m_pData, sizeof(int));
+
+	return value;
+}
+
+char *DimRpc::getString()
+{
+	return static_cast<char*>(m_pData);
+}
+
+void DimRpc::setData(void *pData, int size)
+{
+	m_pOutData = pData;
+	m_outSize = size;
+}
+
+char *DimRpc::getName()
+{
+	return &m_name[0];
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+void DimStandIn::setClient(int clientId, const std::string &clientName)
+{
+	callerClientId = clientId;
+	callerClientName = clientName;
+}
+
+int DimStandIn::sendCommand(const char *name, const void *pData, int size)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::recursive_mutex> dispatchLock(reg.m_dispatchMutex);
+	DimCommand *pCommand = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+		if(0 == (pCommand = findObject(reg.m_commands, name)))
+			return 0;
+	}
+
+	setDispatchClient(reg, callerClientId, callerClientName);
+
+	pCommand->m_pData = const_cast<void*>(pData);
+	pCommand->m_size = size;
+
+	if(0 != pCommand->m_pHandler)
+	{
+		pCommand->m_pHandler->itsCommand = pCommand;
+		pCommand->m_pHandler->commandHandler();
+	}
+
+	reg.m_nCommands++;
+
+	return 1;
+}
+
+int DimStandIn::callRpc(const char *name, const void *pData, int size, const void *&pOutData, int &outSize)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::recursive_mutex> dispatchLock(reg.m_dispatchMutex);
+	DimRpc *pRpc = 0;
+
+	pOutData = 0;
+	outSize = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+		if(0 == (pRpc = findObject(reg.m_rpcs, name)))
+			return 0;
+	}
+
+	setDispatchClient(reg, callerClientId, callerClientName);
+
+	pRpc->m_pData = const_cast<void*>(pData);
+	pRpc->m_size = size;
+	pRpc->m_pOutData = 0;
+	pRpc->m_outSize = 0;
+	pRpc->rpcHandler();
+
+	pOutData = pRpc->m_pOutData;
+	outSize = pRpc->m_outSize;
+	reg.m_nRpcs++;
+
+	return 1;
+}
+
+int DimStandIn::subscribe(const char *name)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::recursive_mutex> dispatchLock(reg.m_dispatchMutex);
+	DimService *pService = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+		if(0 == (pService = findObject(reg.m_services, name)))
+			return 0;
+
+		reg.m_subscribers[pService].insert(callerClientId);
+	}
+
+	setDispatchClient(reg, callerClientId, callerClientName);
+	pService->serviceHandler();
+
+	return 1;
+}
+
+void DimStandIn::exitClient(int clientId, const std::string &clientName)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::recursive_mutex> dispatchLock(reg.m_dispatchMutex);
+	std::vector<DimClientExitHandler*> exitHandlers;
+
+	{
+		std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+		for(std::map<DimService*, std::set<int> >::iterator iter = reg.m_subscribers.begin(), endIter = reg.m_subscribers.end() ;
+				endIter != iter ; ++iter)
+			iter->second.erase(clientId);
+
+		exitHandlers = reg.m_exitHandlers;
+	}
+
+	setDispatchClient(reg, clientId, clientName);
+
+	for(std::vector<DimClientExitHandler*>::iterator iter = exitHandlers.begin(), endIter = exitHandlers.end() ;
+			endIter != iter ; ++iter)
+		(*iter)->clientExitHandler();
+}
+
+int DimStandIn::getNServices(const char *pattern)
+{
+	Registry &reg(registry());
+	std::lock_guard<std::mutex> lock(reg.m_mutex);
+	int nServices = 0;
+
+	for(std::map<std::string, DimService*>::const_iterator iter = reg.m_services.begin(), endIter = reg.m_services.end() ;
+			endIter != iter ; ++iter)
+	{
+		if(matchPattern(pattern, iter->first.c_str()))
+			nServices++;
+	}
+
+	return nServices;
+}
+
+size_t DimStandIn::getNRegistered()
+{
+	Registry &reg(registry());
+	std::lock_guard<std::mutex> lock(reg.m_mutex);
+
+	return reg.m_services.size() + reg.m_commands.size() + reg.m_rpcs.size();
+}
+
+DimStandIn::Counters DimStandIn::getCounters()
+{
+	Registry &reg(registry());
+	Counters counters;
+
+	counters.m_nUpdates = reg.m_nUpdates;
+	counters.m_nClientUpdates = reg.m_nClientUpdates;
+	counters.m_nClientBytes = reg.m_nClientBytes;
+	counters.m_nCommands = reg.m_nCommands;
+	counters.m_nRpcs = reg.m_nRpcs;
+
+	return counters;
+}
+
+void DimStandIn::resetCounters()
+{
+	Registry &reg(registry());
+
+	reg.m_nUpdates = 0;
+	reg.m_nClientUpdates = 0;
+	reg.m_nClientBytes = 0;
+	reg.m_nCommands = 0;
+	reg.m_nRpcs = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+
+int DimClient::sendCommand(const char *name, void *pData, int size)
+{
+	return DimStandIn::sendCommand(name, pData, size);
+}
+
+int DimClient::sendCommand(const char *name, int value)
+{
+	return DimStandIn::sendCommand(name, &value, sizeof(int));
+}
+
+int DimClient::sendCommand(const char *name, const char *value)
+{
+	return DimStandIn::sendCommand(name, value, static_cast<int>(strlen(value)) + 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int DimBrowser::getServices(const char *serviceName)
+{
+	return DimStandIn::getNServices(serviceName);
+}
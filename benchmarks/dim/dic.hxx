@@ -0,0 +1,53 @@
+/*
+ *
+ * dic.hxx
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DIM_STANDIN_DIC_HXX
+#define DIM_STANDIN_DIC_HXX
+
+// In-process stand-in for the DIM client API, see dis.hxx
+
+#include "dis.hxx"
+
+/** DimClient class
+ */
+class DimClient
+{
+public:
+	static int sendCommand(const char *name, void *pData, int size);
+	static int sendCommand(const char *name, int value);
+	static int sendCommand(const char *name, const char *value);
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimBrowser class
+ */
+class DimBrowser
+{
+public:
+	int getServices(const char *serviceName);
+};
+
+#endif  //  DIM_STANDIN_DIC_HXX
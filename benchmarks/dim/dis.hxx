@@ -0,0 +1,222 @@
+/*
+ *
+ * dis.hxx
+ *
+ * This file is part of DQM4HEP libraries.
+ *
+ * DQM4HEP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * based upon these libraries are permitted. Any copy of these libraries
+ * must include this copyright notice.
+ *
+ * DQM4HEP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DQM4HEP.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @copyright CNRS , IPNL
+ */
+
+
+#ifndef DIM_STANDIN_DIS_HXX
+#define DIM_STANDIN_DIS_HXX
+
+// In-process stand-in for the DIM server API, used by the benchmarks in
+// place of the dim library : no dns, no network, the commands, rpcs and
+// subscriptions are dispatched by DimStandIn from the calling thread,
+// serialized as the dim server thread would do. Only the part of the API
+// used by the collectors is provided.
+
+// -- std headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class DimCommand;
+class DimService;
+class DimRpc;
+
+/** DimCommandHandler class
+ */
+class DimCommandHandler
+{
+public:
+	DimCommandHandler();
+	virtual ~DimCommandHandler();
+	virtual void commandHandler() = 0;
+	DimCommand *getCommand();
+
+	DimCommand    *itsCommand;
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimClientExitHandler class
+ */
+class DimClientExitHandler
+{
+public:
+	virtual ~DimClientExitHandler();
+	virtual void clientExitHandler() = 0;
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimServer class
+ */
+class DimServer : public DimCommandHandler, public DimClientExitHandler
+{
+public:
+	virtual ~DimServer();
+	static void start(const char *name);
+	static void stop();
+	static int getClientId();
+	static char *getClientName();
+	static void addClientExitHandler(DimClientExitHandler *pHandler);
+	virtual void commandHandler() {}
+	virtual void clientExitHandler() {}
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimService class
+ */
+class DimService
+{
+public:
+	DimService(const char *name, int &value);
+	DimService(const char *name, const char *format, void *structure, int size);
+	virtual ~DimService();
+	virtual void serviceHandler() {}
+	int updateService();
+	int updateService(int &value);
+	int updateService(void *structure, int size);
+	int selectiveUpdateService(int *cids = 0);
+	int selectiveUpdateService(int &value, int *cids = 0);
+	int selectiveUpdateService(void *structure, int size, int *cids = 0);
+	char *getName();
+
+private:
+	int publish(const void *pData, int size, int *cids);
+
+	std::string        m_name;
+	const void        *m_pData;
+	int                m_size;
+	std::vector<char>  m_sendBuffer;      ///< Emulate the dim copy of the published data
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimCommand class
+ */
+class DimCommand
+{
+	friend class DimStandIn;
+public:
+	DimCommand(const char *name, const char *format, DimCommandHandler *pHandler);
+	virtual ~DimCommand();
+	void *getData();
+	int getSize();
+	int getInt();
+	char *getString();
+	char *getName();
+
+private:
+	std::string         m_name;
+	DimCommandHandler  *m_pHandler;
+	void               *m_pData;
+	int                 m_size;
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimRpc class
+ */
+class DimRpc
+{
+	friend class DimStandIn;
+public:
+	DimRpc(const char *name, const char *formatIn, const char *formatOut);
+	virtual ~DimRpc();
+	virtual void rpcHandler() = 0;
+	void *getData();
+	int getSize();
+	int getInt();
+	char *getString();
+	void setData(void *pData, int size);
+	char *getName();
+
+private:
+	std::string         m_name;
+	void               *m_pData;
+	int                 m_size;
+	const void         *m_pOutData;
+	int                 m_outSize;
+};
+
+//-------------------------------------------------------------------------------------------------
+
+/** DimStandIn class
+ *
+ *  Play the dim server thread and the remote clients : dispatch the
+ *  commands, rpcs, subscriptions and client exits to the registered
+ *  handlers, and count what the services publish
+ */
+class DimStandIn
+{
+public:
+	/** Counters class
+	 */
+	class Counters
+	{
+	public:
+		uint64_t    m_nUpdates;          ///< Number of service updates
+		uint64_t    m_nClientUpdates;    ///< Number of updates received by clients
+		uint64_t    m_nClientBytes;      ///< Number of bytes received by clients
+		uint64_t    m_nCommands;         ///< Number of dispatched commands
+		uint64_t    m_nRpcs;             ///< Number of dispatched rpcs
+	};
+
+	/** Set the client sending the next commands (dim client id and pid@node name)
+	 */
+	static void setClient(int clientId, const std::string &clientName);
+
+	/** Dispatch a command to its handler. Return 0 if the command doesn't exist
+	 */
+	static int sendCommand(const char *name, const void *pData, int size);
+
+	/** Dispatch an rpc to its handler and get the returned data, valid until the next rpc call
+	 */
+	static int callRpc(const char *name, const void *pData, int size, const void *&pOutData, int &outSize);
+
+	/** The current client subscribes to a service
+	 */
+	static int subscribe(const char *name);
+
+	/** A client exits
+	 */
+	static void exitClient(int clientId, const std::string &clientName);
+
+	/** Get the number of services matching a name, '*' as wildcard
+	 */
+	static int getNServices(const char *pattern);
+
+	/** Get the number of registered services, commands and rpcs
+	 */
+	static size_t getNRegistered();
+
+	/** Get the counters since the last reset
+	 */
+	static Counters getCounters();
+
+	/** Reset the counters
+	 */
+	static void resetCounters();
+};
+
+#endif  //  DIM_STANDIN_DIS_HXX
@@ -0,0 +1,436 @@
+// Synthetic load benchmark of the DQMDimEudaqClient collector and of the
+// DQMDataCollector event builder.
+//
+// The collector runs against the in-process dim stand-in of benchmarks/dim,
+// so the benchmark is built with benchmarks/dim first in the include path and
+// benchmarks/dim/DimStandIn.cc linked instead of the dim library, i.e :
+//
+//   g++ -O2 -std=c++11 -I benchmarks/dim -I benchmarks -I . <dqm4hep, lcio, xdrstream, tclap flags>
+//       benchmarks/dqm4hep_collector_benchmark.cc benchmarks/DQMCollectorBenchmark.cc
+//       benchmarks/DQMBenchmarkTools.cc benchmarks/dim/DimStandIn.cc
+//       DQMDimEudaqClient.cc DQMSpillAggregator.cc DQMOccupancyAggregator.cc DQMEventJournal.cc
+//       DQMAsyncLogger.cc DQMEventPacer.cc DQMBulkLCEventStreamer.cc DQMXdrBulkCodec.cc
+//       <dqm4hep, dqm4ilc, lcio, log4cxx libraries>
+//
+// The dqm4hep core library must not pull the real dim library in the same
+// process. DQMBenchmarkTools.cc replaces the global operator new to count
+// the allocations.
+
+// -- std headers
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+
+// -- dqm4hep
+#include "dqm4hep/DQM4HEP.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- dqm4ilc headers
+#include "dqm4ilc/DQMLCEventStreamer.h"
+
+// -- tclap headers
+#include "tclap/CmdLine.h"
+#include "tclap/Arg.h"
+
+// -- dim stand-in headers
+#include "dis.hxx"
+
+#include "DQMBenchmarkTools.h"
+#include "DQMCollectorBenchmark.h"
+#include "DQMBulkLCEventStreamer.h"
+#include "DQMEventPacer.h"
+
+using namespace std;
+using namespace dqm4hep;
+
+// the streamer of the generated events, a new instance for each collector
+DQMEventStreamer *createEventStreamer(const std::string &format)
+{
+  if("lcio" == format)
+    return new DQMLCEventStreamer();
+
+  if("bulk" == format)
+    return new DQMBulkLCEventStreamer();
+
+  return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+// the plugin name of the streamer, as known by the collector
+std::string getStreamerName(const std::string &format)
+{
+  return "bulk" == format ? "BulkLCIOStreamer" : "LCIOStreamer";
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode runCollectorBenchmark(const DQMSyntheticEventGenerator &generator, const std::string &format,
+				 unsigned int nClients, unsigned int nSubEventClients, unsigned int nEvents,
+				 float rate, unsigned int requestPeriod)
+{
+  const std::string subEventIdentifier(generator.getFirstCollectionName());
+  DQMCollectorBenchmark benchmark("BENCHMARK");
+
+  RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, benchmark.startCollector(createEventStreamer(format), getStreamerName(format)));
+  RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, benchmark.connectClients(nClients, subEventIdentifier.empty() ? 0 : nSubEventClients, subEventIdentifier));
+
+  // warm up : the buffers reach their steady state size
+  for(unsigned int e=0 ; e<std::min(nEvents, 1000u) ; e++)
+    RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, benchmark.sendEvent(generator.getEvent(e)));
+
+  DQMLatencyRecorder receptionLatencies, requestLatencies, updateLatencies;
+  receptionLatencies.reserve(nEvents);
+  requestLatencies.reserve(requestPeriod ? nEvents/requestPeriod+1 : 0);
+  updateLatencies.reserve(nEvents/10+1);
+
+  DQMEventPacer pacer(rate > 0.f ? DQMEventPacer::CONSTANT_RATE : DQMEventPacer::MAX_RATE);
+  pacer.setReportPeriod(0);
+
+  if(rate > 0.f)
+    RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, pacer.setTargetRate(rate));
+
+  DimStandIn::resetCounters();
+  const uint64_t nAllocations = DQMAllocationCounter::getNAllocations();
+  const uint64_t nAllocatedBytes = DQMAllocationCounter::getNAllocatedBytes();
+  uint64_t nBytes = 0;
+  int eventSize = 0;
+
+  DQMLatencyRecorder::Clock::time_point startTime = DQMLatencyRecorder::Clock::now();
+
+  for(unsigned int e=0 ; e<nEvents ; e++)
+    {
+      const std::vector<char> &event(generator.getEvent(e));
+      pacer.pace(0);
+
+      // reception, de-serialization and update of the clients
+      DQMLatencyRecorder::Clock::time_point start = DQMLatencyRecorder::Clock::now();
+      RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, benchmark.sendEvent(event));
+      receptionLatencies.record(start, DQMLatencyRecorder::Clock::now());
+      nBytes += event.size();
+
+      if(requestPeriod && 0 == e % requestPeriod)
+	{
+	  start = DQMLatencyRecorder::Clock::now();
+	  RETURN_RESULT_IF(STATUS_CODE_SUCCESS, !=, benchmark.requestEvent(subEventIdentifier, eventSize));
+	  requestLatencies.record(start, DQMLatencyRecorder::Clock::now());
+	}
+    }
+
+  const double elapsed = std::chrono::duration<double>(DQMLatencyRecorder::Clock::now() - startTime).count();
+  const double allocationsPerEvent = (DQMAllocationCounter::getNAllocations() - nAllocations) / static_cast<double>(nEvents);
+  const double allocatedBytesPerEvent = (DQMAllocationCounter::getNAllocatedBytes() - nAllocatedBytes) / static_cast<double>(nEvents);
+  const DimStandIn::Counters counters(DimStandIn::getCounters());
+
+  // the publication alone, on the last received event
+  for(unsigned int u=0 ; u<nEvents/10+1 ; u++)
+    {
+      DQMLatencyRecorder::Clock::time_point start = DQMLatencyRecorder::Clock::now();
+      benchmark.updateEventService();
+      updateLatencies.record(start, DQMLatencyRecorder::Clock::now());
+    }
+
+  benchmark.deleteCollector();
+
+  cout << setw(8) << nClients
+       << setw(6) << (subEventIdentifier.empty() ? 0 : std::min(nSubEventClients, nClients))
+       << setw(11) << fixed << setprecision(0) << (elapsed > 0. ? nEvents / elapsed : 0.)
+       << setw(9) << setprecision(1) << (elapsed > 0. ? nBytes / elapsed / (1024.*1024.) : 0.)
+       << setw(9) << setprecision(1) << receptionLatencies.getPercentile(50.)
+       << setw(9) << receptionLatencies.getPercentile(90.)
+       << setw(9) << receptionLatencies.getPercentile(99.)
+       << setw(10) << receptionLatencies.getPercentile(100.)
+       << setw(9) << updateLatencies.getPercentile(50.)
+       << setw(9) << updateLatencies.getPercentile(99.)
+       << setw(9) << requestLatencies.getPercentile(50.)
+       << setw(9) << requestLatencies.getPercentile(99.)
+       << setw(9) << setprecision(2) << allocationsPerEvent
+       << setw(11) << setprecision(1) << allocatedBytesPerEvent / 1024.
+       << setw(11) << setprecision(1) << (elapsed > 0. ? counters.m_nClientBytes / elapsed / (1024.*1024.) : 0.)
+       << endl;
+
+  return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+StatusCode runBuilderBenchmark(unsigned int nProducers, unsigned int maxSkew, size_t maxQueueDepth, unsigned int nEvents)
+{
+  DQMBuilderBenchmark benchmark(nProducers, maxSkew, maxQueueDepth);
+  unsigned int producer = 0;
+  DQMSyntheticTriggerEventPtr event;
+
+  // warm up : the queues reach their steady state size
+  for(unsigned int e=0 ; e<std::min(nEvents, 1000u)*nProducers ; e++)
+    {
+      benchmark.nextEvent(producer, event);
+      benchmark.receive(producer, event);
+    }
+
+  const uint64_t nReceived = static_cast<uint64_t>(nEvents) * nProducers;
+  DQMLatencyRecorder receiveLatencies;
+  receiveLatencies.reserve(nReceived);
+  uint64_t nBuilt = 0, nAllocations = 0;
+  size_t maxBacklog = 0;
+  const uint64_t nDropped = benchmark.getBuilder().getNDropped();
+
+  for(uint64_t e=0 ; e<nReceived ; e++)
+    {
+      // the event creation is the transport part, not measured
+      benchmark.nextEvent(producer, event);
+
+      const uint64_t nStartAllocations = DQMAllocationCounter::getNAllocations();
+      DQMLatencyRecorder::Clock::time_point start = DQMLatencyRecorder::Clock::now();
+
+      if(benchmark.receive(producer, event))
+	nBuilt++;
+
+      receiveLatencies.record(start, DQMLatencyRecorder::Clock::now());
+      nAllocations += DQMAllocationCounter::getNAllocations() - nStartAllocations;
+
+      if(0 == e % 1024)
+	maxBacklog = std::max(maxBacklog, benchmark.getBuilder().getBacklog());
+    }
+
+  // builder time only
+  const double elapsed = receiveLatencies.getMean() * receiveLatencies.getN() / 1e6;
+
+  cout << setw(10) << nProducers
+       << setw(6) << maxSkew
+       << setw(11) << fixed << setprecision(0) << (elapsed > 0. ? nBuilt / elapsed : 0.)
+       << setw(9) << setprecision(2) << receiveLatencies.getPercentile(50.)
+       << setw(9) << receiveLatencies.getPercentile(90.)
+       << setw(9) << receiveLatencies.getPercentile(99.)
+       << setw(10) << receiveLatencies.getPercentile(100.)
+       << setw(9) << (nBuilt ? nAllocations / static_cast<double>(nBuilt) : 0.)
+       << setw(9) << maxBacklog
+       << setw(9) << benchmark.getBuilder().getNDropped() - nDropped
+       << endl;
+
+  return STATUS_CODE_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+  std::string cmdLineFooter = "Please report bug to <rete@ipnl.in2p3.fr>";
+  TCLAP::CmdLine *pCommandLine = new TCLAP::CmdLine(cmdLineFooter, ' ', DQM4HEP_VERSION_STR);
+  std::string log4cxx_file = std::string(DQMCore_DIR) + "/conf/defaultLoggerConfig.xml";
+
+  TCLAP::ValueArg<unsigned int> nEventsArg(
+					   "n"
+					   , "n-events"
+					   , "The number of events sent for each client count"
+					   , false
+					   , 100000
+					   , "unsigned int");
+  pCommandLine->add(nEventsArg);
+
+  TCLAP::ValueArg<std::string> clientCountsArg(
+					       "c"
+					       , "clients"
+					       , "The update client counts to benchmark, separated by ':'"
+					       , false
+					       , "0:1:4:16:64"
+					       , "string");
+  pCommandLine->add(clientCountsArg);
+
+  TCLAP::ValueArg<unsigned int> nSubEventClientsArg(
+						    "e"
+						    , "sub-event-clients"
+						    , "The number of update clients asking for the first collection of the mix only"
+						    , false
+						    , 0
+						    , "unsigned int");
+  pCommandLine->add(nSubEventClientsArg);
+
+  TCLAP::ValueArg<unsigned int> eventSizeArg(
+					     "s"
+					     , "event-size"
+					     , "The raw event size (unit bytes), when no collection mix is given"
+					     , false
+					     , 64*1024
+					     , "unsigned int");
+  pCommandLine->add(eventSizeArg);
+
+  TCLAP::ValueArg<float> sizeSpreadArg(
+				       "z"
+				       , "size-spread"
+				       , "The relative spread of the event size and of the collection sizes"
+				       , false
+				       , 0.1f
+				       , "float");
+  pCommandLine->add(sizeSpreadArg);
+
+  TCLAP::ValueArg<std::string> collectionMixArg(
+						"x"
+						, "collection-mix"
+						, "The lcio collections of the events, i.e 'EcalHits:CalorimeterHit:2000,SdhcalHits:RawCalorimeterHit:5000'"
+						, false
+						, ""
+						, "string");
+  pCommandLine->add(collectionMixArg);
+
+  TCLAP::SwitchArg bulkFormatArg(
+				 "b"
+				 , "bulk"
+				 , "Serialize the lcio events with the BulkLCIOStreamer instead of the LCIOStreamer"
+				 , false);
+  pCommandLine->add(bulkFormatArg);
+
+  TCLAP::ValueArg<float> rateArg(
+				 "r"
+				 , "rate"
+				 , "The event rate (unit Hz), 0 for max rate"
+				 , false
+				 , 0.f
+				 , "float");
+  pCommandLine->add(rateArg);
+
+  TCLAP::ValueArg<unsigned int> requestPeriodArg(
+						 "q"
+						 , "request-period"
+						 , "Request the current event every n events, 0 for no request"
+						 , false
+						 , 10
+						 , "unsigned int");
+  pCommandLine->add(requestPeriodArg);
+
+  TCLAP::ValueArg<std::string> producerCountsArg(
+						 "p"
+						 , "producers"
+						 , "The producer counts of the event builder benchmark, separated by ':'. Empty to skip"
+						 , false
+						 , "1:2:4:8"
+						 , "string");
+  pCommandLine->add(producerCountsArg);
+
+  TCLAP::ValueArg<unsigned int> maxSkewArg(
+					   "k"
+					   , "max-skew"
+					   , "The max trigger number advance of a producer over the slowest one"
+					   , false
+					   , 16
+					   , "unsigned int");
+  pCommandLine->add(maxSkewArg);
+
+  TCLAP::ValueArg<unsigned int> maxQueueDepthArg(
+						 "d"
+						 , "max-queue-depth"
+						 , "The builder max queue depth (DQM_MAX_QUEUE_DEPTH), 0 for unbounded"
+						 , false
+						 , 0
+						 , "unsigned int");
+  pCommandLine->add(maxQueueDepthArg);
+
+  TCLAP::ValueArg<std::string> loggerConfigArg(
+					       "l"
+					       , "logger-config"
+					       , "The xml logger file to configure log4cxx"
+					       , false
+					       , log4cxx_file
+					       , "string");
+  pCommandLine->add(loggerConfigArg);
+
+  std::vector<std::string> allowedLevels;
+  allowedLevels.push_back("INFO");
+  allowedLevels.push_back("WARN");
+  allowedLevels.push_back("DEBUG");
+  allowedLevels.push_back("TRACE");
+  allowedLevels.push_back("ERROR");
+  allowedLevels.push_back("FATAL");
+  allowedLevels.push_back("OFF");
+  allowedLevels.push_back("ALL");
+  TCLAP::ValuesConstraint<std::string> allowedLevelsContraint( allowedLevels );
+
+  TCLAP::ValueArg<std::string> verbosityArg(
+					    "v"
+					    , "verbosity"
+					    , "The verbosity level used for this application"
+					    , false
+					    , "WARN"
+					    , &allowedLevelsContraint);
+  pCommandLine->add(verbosityArg);
+
+  // parse command line
+  pCommandLine->parse(argc, argv);
+
+  log4cxx_file = loggerConfigArg.getValue();
+  log4cxx::xml::DOMConfigurator::configure(log4cxx_file);
+
+  // the per client logs of the collector would be measured too
+  dqmMainLogger->setLevel( log4cxx::Level::toLevel( verbosityArg.getValue() ) );
+
+  const unsigned int nEvents = std::max(1u, nEventsArg.getValue());
+  const std::string format = collectionMixArg.getValue().empty() ? "raw" : (bulkFormatArg.getValue() ? "bulk" : "lcio");
+
+  DQMSyntheticEventGenerator generator;
+
+  if(STATUS_CODE_SUCCESS != generator.setEventSize(eventSizeArg.getValue(), sizeSpreadArg.getValue())
+     || STATUS_CODE_SUCCESS != generator.setCollectionMix(collectionMixArg.getValue()))
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Invalid event size or collection mix" );
+      delete pCommandLine;
+      return 1;
+    }
+
+  // a pool of distinct events, cycled over
+  DQMEventStreamer *pEventStreamer = createEventStreamer(format);
+  StatusCode statusCode = generator.generate(std::min(nEvents, 256u), pEventStreamer);
+  delete pEventStreamer;
+
+  if(STATUS_CODE_SUCCESS != statusCode)
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Couldn't generate the events : " << statusCode );
+      delete pCommandLine;
+      return 1;
+    }
+
+  cout << "Collector : " << nEvents << " " << format << " events of " << fixed << setprecision(0) << generator.getMeanEventSize()
+       << " bytes on average, rate " << (rateArg.getValue() > 0.f ? rateArg.getValue() : 0.f) << " Hz (0 : max)" << endl;
+  cout << " clients   sub      evt/s     MB/s  rcv p50  rcv p90  rcv p99  rcv max  upd p50  upd p99  req p50  req p99"
+       << "  allocs  kB alloc  client MB/s" << endl;
+  cout << "                                       [us]     [us]     [us]      [us]     [us]     [us]     [us]     [us]   /evt      /evt" << endl;
+
+  std::vector<std::string> clientCounts;
+  DQM4HEP::tokenize(clientCountsArg.getValue(), clientCounts, ":");
+
+  for(auto &clientCount : clientCounts)
+    {
+      statusCode = runCollectorBenchmark(generator, format, atoi(clientCount.c_str()), nSubEventClientsArg.getValue(),
+					 nEvents, rateArg.getValue(), requestPeriodArg.getValue());
+
+      if(STATUS_CODE_SUCCESS != statusCode)
+	{
+	  LOG4CXX_ERROR( dqmMainLogger , "Collector benchmark with " << clientCount << " clients failed : " << statusCode );
+	  delete pCommandLine;
+	  return 1;
+	}
+    }
+
+  std::vector<std::string> producerCounts;
+  DQM4HEP::tokenize(producerCountsArg.getValue(), producerCounts, ":");
+
+  if(!producerCounts.empty())
+    {
+      cout << endl << "Event builder : " << nEvents << " triggers, max queue depth " << maxQueueDepthArg.getValue() << " (0 : unbounded)" << endl;
+      cout << " producers  skew    built/s  rcv p50  rcv p90  rcv p99   rcv max   allocs  backlog  dropped" << endl;
+      cout << "                               [us]     [us]     [us]      [us]   /built" << endl;
+    }
+
+  for(auto &producerCount : producerCounts)
+    {
+      const unsigned int nProducers = atoi(producerCount.c_str());
+
+      if(0 == nProducers)
+	continue;
+
+      runBuilderBenchmark(nProducers, maxSkewArg.getValue(), maxQueueDepthArg.getValue(), nEvents);
+    }
+
+  delete pCommandLine;
+
+  return 0;
+}
@@ -0,0 +1,549 @@
+// Soak test of the data path : DQMDataCollector reception, building and
+// conversion threads, fan-out to the collectors and DQMDimEudaqClient, over
+// many runs, with producers and clients coming and going. The resident
+// memory, the live allocations and the queue depths are sampled along the
+// way, and their drift per event after the warm up must stay under the
+// given thresholds.
+//
+// The eudaq DataCollector can not be instantiated here : its run cycle (DoStartRun,
+// DoStopRun, DoReceive, DoConnect, DoDisconnect) is mirrored on the same classes,
+// DQMDataCollectorPipeline, DQMEventBuilder and DQMEventFanOut. The main thread
+// stands for the dataserver thread, the conversion sends the pre-serialized event
+// of the built trigger number.
+//
+// Built as the collector benchmark, against the dim stand-in, i.e :
+//
+//   g++ -O2 -std=c++11 -I benchmarks/dim -I benchmarks -I . <dqm4hep, lcio, xdrstream, tclap flags>
+//       benchmarks/dqm4hep_collector_soak.cc benchmarks/DQMCollectorBenchmark.cc
+//       benchmarks/DQMBenchmarkTools.cc benchmarks/dim/DimStandIn.cc DQMEventFanOut.cc DQMThreadTopology.cc
+//       DQMDimEudaqClient.cc DQMSpillAggregator.cc DQMOccupancyAggregator.cc DQMEventJournal.cc
+//       DQMAsyncLogger.cc DQMEventPacer.cc DQMBulkLCEventStreamer.cc DQMXdrBulkCodec.cc
+//       <dqm4hep, dqm4ilc, lcio, log4cxx libraries>
+//
+// Exit code 1 if a drift is over its threshold.
+
+// -- std headers
+#include <iostream>
+#include <iomanip>
+#include <deque>
+#include <algorithm>
+
+// -- dqm4hep
+#include "dqm4hep/DQM4HEP.h"
+#include "dqm4hep/DQMLogging.h"
+
+// -- dqm4ilc headers
+#include "dqm4ilc/DQMLCEventStreamer.h"
+
+// -- tclap headers
+#include "tclap/CmdLine.h"
+#include "tclap/Arg.h"
+
+// -- dim stand-in headers
+#include "dis.hxx"
+
+#include "DQMBenchmarkTools.h"
+#include "DQMCollectorBenchmark.h"
+#include "DQMDataCollectorPipeline.h"
+#include "DQMBulkLCEventStreamer.h"
+#include "DQMEventFanOut.h"
+
+using namespace std;
+using namespace dqm4hep;
+
+// the streamer of the generated events
+DQMEventStreamer *createEventStreamer(const std::string &format)
+{
+  if("lcio" == format)
+    return new DQMLCEventStreamer();
+
+  if("bulk" == format)
+    return new DQMBulkLCEventStreamer();
+
+  return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+// the plugin name of the streamer, as known by the collector
+std::string getStreamerName(const std::string &format)
+{
+  return "bulk" == format ? "BulkLCIOStreamer" : "LCIOStreamer";
+}
+
+//-------------------------------------------------------------------------------------------------
+
+// as DQMDataCollector::DoStartRun
+DQMEventFanOut *startFanOut(const std::string &collectorName, unsigned int sendQueueSize)
+{
+  DQMEventFanOut *pFanOut = new DQMEventFanOut(std::vector<std::string>(1, collectorName), NULL,
+					       DQMEventFanOut::ROUND_ROBIN, sendQueueSize);
+  pFanOut->setDropWhenFull(true);
+  pFanOut->start();
+
+  return pFanOut;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+// as DQMDataCollector::DoStopRun
+void stopFanOut(DQMEventFanOut *&pFanOut)
+{
+  if(NULL == pFanOut)
+    return;
+
+  pFanOut->stop();
+  pFanOut->report();
+  delete pFanOut;
+  pFanOut = NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+// whether the built events reached the next multiple of a period (0 : never), then move to the following one
+bool reachPeriod(uint64_t nBuilt, unsigned int period, uint64_t &next)
+{
+  if(0 == period || nBuilt < next)
+    return false;
+
+  next = (nBuilt / period + 1) * period;
+
+  return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void printSample(const DQMMemoryMonitor::Sample &sample, double rate, size_t backlog, size_t fanOutQueueSize,
+		 const DQMCollectorBenchmark &benchmark)
+{
+  cout << setw(12) << sample.m_nEvents
+       << setw(11) << fixed << setprecision(0) << rate
+       << setw(10) << setprecision(1) << sample.m_residentSize / (1024.*1024.)
+       << setw(12) << sample.m_nLiveAllocations
+       << setw(9) << backlog
+       << setw(9) << fanOutQueueSize
+       << setw(9) << benchmark.getNClients()
+       << setw(10) << benchmark.getNRestoredClients()
+       << endl;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+  std::string cmdLineFooter = "Please report bug to <rete@ipnl.in2p3.fr>";
+  TCLAP::CmdLine *pCommandLine = new TCLAP::CmdLine(cmdLineFooter, ' ', DQM4HEP_VERSION_STR);
+  std::string log4cxx_file = std::string(DQMCore_DIR) + "/conf/defaultLoggerConfig.xml";
+
+  TCLAP::ValueArg<unsigned int> nEventsArg(
+					   "n"
+					   , "n-events"
+					   , "The total number of built events"
+					   , false
+					   , 20000000
+					   , "unsigned int");
+  pCommandLine->add(nEventsArg);
+
+  TCLAP::ValueArg<unsigned int> runLengthArg(
+					     "u"
+					     , "run-length"
+					     , "The number of built events per run, 0 for a single run"
+					     , false
+					     , 1000000
+					     , "unsigned int");
+  pCommandLine->add(runLengthArg);
+
+  TCLAP::ValueArg<unsigned int> nClientsArg(
+					    "c"
+					    , "clients"
+					    , "The number of update clients"
+					    , false
+					    , 8
+					    , "unsigned int");
+  pCommandLine->add(nClientsArg);
+
+  TCLAP::ValueArg<unsigned int> clientChurnArg(
+					       "C"
+					       , "client-churn"
+					       , "Replace the oldest client by a new one every n events, 0 for none"
+					       , false
+					       , 10000
+					       , "unsigned int");
+  pCommandLine->add(clientChurnArg);
+
+  TCLAP::ValueArg<unsigned int> nProducersArg(
+					      "p"
+					      , "producers"
+					      , "The number of producers of the event builder"
+					      , false
+					      , 4
+					      , "unsigned int");
+  pCommandLine->add(nProducersArg);
+
+  TCLAP::ValueArg<unsigned int> producerChurnArg(
+						 "P"
+						 , "producer-churn"
+						 , "Disconnect a producer, or reconnect the disconnected one, every n events, 0 for none"
+						 , false
+						 , 50000
+						 , "unsigned int");
+  pCommandLine->add(producerChurnArg);
+
+  TCLAP::ValueArg<unsigned int> maxSkewArg(
+					   "k"
+					   , "max-skew"
+					   , "The max trigger number advance of a producer over the slowest one"
+					   , false
+					   , 16
+					   , "unsigned int");
+  pCommandLine->add(maxSkewArg);
+
+  TCLAP::ValueArg<unsigned int> maxQueueDepthArg(
+						 "d"
+						 , "max-queue-depth"
+						 , "The builder max queue depth (DQM_MAX_QUEUE_DEPTH), 0 for unbounded"
+						 , false
+						 , 1024
+						 , "unsigned int");
+  pCommandLine->add(maxQueueDepthArg);
+
+  TCLAP::ValueArg<unsigned int> sendQueueSizeArg(
+						 "o"
+						 , "send-queue-size"
+						 , "The fan-out queue size (DQM_SEND_QUEUE_SIZE)"
+						 , false
+						 , 16
+						 , "unsigned int");
+  pCommandLine->add(sendQueueSizeArg);
+
+  TCLAP::ValueArg<unsigned int> receiveQueueSizeArg(
+						    "r"
+						    , "receive-queue-size"
+						    , "The reception queue size (DQM_RECEIVE_QUEUE_SIZE)"
+						    , false
+						    , 1024
+						    , "unsigned int");
+  pCommandLine->add(receiveQueueSizeArg);
+
+  TCLAP::ValueArg<unsigned int> conversionQueueSizeArg(
+						       "t"
+						       , "conversion-queue-size"
+						       , "The conversion queue size (DQM_CONVERSION_QUEUE_SIZE)"
+						       , false
+						       , 64
+						       , "unsigned int");
+  pCommandLine->add(conversionQueueSizeArg);
+
+  TCLAP::ValueArg<unsigned int> eventSizeArg(
+					     "s"
+					     , "event-size"
+					     , "The raw event size (unit bytes), when no collection mix is given"
+					     , false
+					     , 16*1024
+					     , "unsigned int");
+  pCommandLine->add(eventSizeArg);
+
+  TCLAP::ValueArg<float> sizeSpreadArg(
+				       "z"
+				       , "size-spread"
+				       , "The relative spread of the event size and of the collection sizes"
+				       , false
+				       , 0.1f
+				       , "float");
+  pCommandLine->add(sizeSpreadArg);
+
+  TCLAP::ValueArg<std::string> collectionMixArg(
+						"x"
+						, "collection-mix"
+						, "The lcio collections of the events, i.e 'EcalHits:CalorimeterHit:2000,SdhcalHits:RawCalorimeterHit:5000'"
+						, false
+						, ""
+						, "string");
+  pCommandLine->add(collectionMixArg);
+
+  TCLAP::SwitchArg bulkFormatArg(
+				 "b"
+				 , "bulk"
+				 , "Serialize the lcio events with the BulkLCIOStreamer instead of the LCIOStreamer"
+				 , false);
+  pCommandLine->add(bulkFormatArg);
+
+  TCLAP::ValueArg<unsigned int> requestPeriodArg(
+						 "q"
+						 , "request-period"
+						 , "Request the current event every n events, 0 for no request"
+						 , false
+						 , 100
+						 , "unsigned int");
+  pCommandLine->add(requestPeriodArg);
+
+  TCLAP::ValueArg<unsigned int> samplePeriodArg(
+						"m"
+						, "sample-period"
+						, "Sample the memory every n events"
+						, false
+						, 100000
+						, "unsigned int");
+  pCommandLine->add(samplePeriodArg);
+
+  TCLAP::ValueArg<float> warmUpArg(
+				   "w"
+				   , "warm-up"
+				   , "The fraction of the events not used for the drift fits"
+				   , false
+				   , 0.2f
+				   , "float");
+  pCommandLine->add(warmUpArg);
+
+  TCLAP::ValueArg<float> maxResidentDriftArg(
+					     "R"
+					     , "max-resident-drift"
+					     , "The max resident memory drift (unit bytes per event)"
+					     , false
+					     , 1.f
+					     , "float");
+  pCommandLine->add(maxResidentDriftArg);
+
+  TCLAP::ValueArg<float> maxAllocationDriftArg(
+					       "A"
+					       , "max-allocation-drift"
+					       , "The max live allocation drift (unit allocations per event)"
+					       , false
+					       , 0.001f
+					       , "float");
+  pCommandLine->add(maxAllocationDriftArg);
+
+  TCLAP::ValueArg<std::string> loggerConfigArg(
+					       "l"
+					       , "logger-config"
+					       , "The xml logger file to configure log4cxx"
+					       , false
+					       , log4cxx_file
+					       , "string");
+  pCommandLine->add(loggerConfigArg);
+
+  std::vector<std::string> allowedLevels;
+  allowedLevels.push_back("INFO");
+  allowedLevels.push_back("WARN");
+  allowedLevels.push_back("DEBUG");
+  allowedLevels.push_back("TRACE");
+  allowedLevels.push_back("ERROR");
+  allowedLevels.push_back("FATAL");
+  allowedLevels.push_back("OFF");
+  allowedLevels.push_back("ALL");
+  TCLAP::ValuesConstraint<std::string> allowedLevelsContraint( allowedLevels );
+
+  TCLAP::ValueArg<std::string> verbosityArg(
+					    "v"
+					    , "verbosity"
+					    , "The verbosity level used for this application"
+					    , false
+					    , "WARN"
+					    , &allowedLevelsContraint);
+  pCommandLine->add(verbosityArg);
+
+  // parse command line
+  pCommandLine->parse(argc, argv);
+
+  log4cxx_file = loggerConfigArg.getValue();
+  log4cxx::xml::DOMConfigurator::configure(log4cxx_file);
+  dqmMainLogger->setLevel( log4cxx::Level::toLevel( verbosityArg.getValue() ) );
+
+  const uint64_t nEvents = std::max(1u, nEventsArg.getValue());
+  const unsigned int nProducers = std::max(1u, nProducersArg.getValue());
+  const unsigned int samplePeriod = std::max(1u, samplePeriodArg.getValue());
+  const std::string format = collectionMixArg.getValue().empty() ? "raw" : (bulkFormatArg.getValue() ? "bulk" : "lcio");
+
+  DQMSyntheticEventGenerator generator;
+
+  if(STATUS_CODE_SUCCESS != generator.setEventSize(eventSizeArg.getValue(), sizeSpreadArg.getValue())
+     || STATUS_CODE_SUCCESS != generator.setCollectionMix(collectionMixArg.getValue()))
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Invalid event size or collection mix" );
+      delete pCommandLine;
+      return 1;
+    }
+
+  DQMEventStreamer *pEventStreamer = createEventStreamer(format);
+  StatusCode statusCode = generator.generate(256, pEventStreamer);
+  delete pEventStreamer;
+
+  if(STATUS_CODE_SUCCESS != statusCode)
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Couldn't generate the events : " << statusCode );
+      delete pCommandLine;
+      return 1;
+    }
+
+  const std::string subEventIdentifier(generator.getFirstCollectionName());
+  DQMCollectorBenchmark benchmark("SOAK");
+  DQMBuilderBenchmark builder(nProducers, maxSkewArg.getValue(), maxQueueDepthArg.getValue());
+  DQMEventFanOut *pFanOut = NULL;
+
+  // as DQMDataCollector::BuiltEvent and ConvertEvent : the conversion sends the
+  // pre-serialized event of the built trigger number
+  auto builtEvent = [](uint32_t triggerNumber, const std::vector<DQMSyntheticTriggerEventPtr> &, uint32_t &converted)
+    {
+      converted = triggerNumber;
+      return true;
+    };
+  auto convertEvent = [&generator, &pFanOut](const uint32_t &triggerNumber)
+    {
+      const std::vector<char> &buffer(generator.getEvent(triggerNumber));
+      pFanOut->sendBuffer(&buffer[0], buffer.size(), triggerNumber);
+    };
+  DQMDataCollectorPipeline<unsigned int, DQMSyntheticTriggerEventPtr, uint32_t> pipeline(builder.getBuilder(), builtEvent, convertEvent);
+
+  // update clients, in connection order. Each new client has a new name,
+  // as a restarted client (pid@node)
+  // The odd ones ask for the sub event
+  std::deque<int> clientIds;
+  int nextClientId = 1;
+  auto clientSubEvent = [&subEventIdentifier](int clientId) { return 1 == clientId % 2 ? subEventIdentifier : std::string(); };
+
+  if(STATUS_CODE_SUCCESS != (statusCode = benchmark.startCollector(createEventStreamer(format), getStreamerName(format))))
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Couldn't start the collector : " << statusCode );
+      delete pCommandLine;
+      return 1;
+    }
+
+  for(unsigned int c=0 ; c<nClientsArg.getValue() ; c++, nextClientId++)
+    {
+      benchmark.connectClient(nextClientId, true, clientSubEvent(nextClientId));
+      clientIds.push_back(nextClientId);
+    }
+
+  pFanOut = startFanOut("SOAK", sendQueueSizeArg.getValue());
+  pipeline.start(receiveQueueSizeArg.getValue(), conversionQueueSizeArg.getValue(), true);
+
+  cout << "Soak : " << nEvents << " " << format << " events of " << fixed << setprecision(0) << generator.getMeanEventSize()
+       << " bytes on average, " << nProducers << " producers, " << nClientsArg.getValue() << " clients, runs of "
+       << runLengthArg.getValue() << " events" << endl;
+  cout << "      events      evt/s    RSS MB  live allocs  backlog  fan-out  clients  restored" << endl;
+
+  DQMMemoryMonitor monitor;
+  unsigned int producer = 0, nRuns = 1;
+  int disconnectedProducer = -1;
+  uint64_t nBuilt = 0, nReceived = 0, nSampleBuilt = 0;
+  uint64_t nextRequest = 0, nextClientChurn = 0, nextProducerChurn = 0, nextRunEnd = 0, nextSample = 0;
+  reachPeriod(0, requestPeriodArg.getValue(), nextRequest);
+  reachPeriod(0, clientChurnArg.getValue(), nextClientChurn);
+  reachPeriod(0, producerChurnArg.getValue(), nextProducerChurn);
+  reachPeriod(0, runLengthArg.getValue(), nextRunEnd);
+  reachPeriod(0, samplePeriod, nextSample);
+  int eventSize = 0;
+  DQMSyntheticTriggerEventPtr event;
+  DQMLatencyRecorder::Clock::time_point sampleTime = DQMLatencyRecorder::Clock::now();
+
+  printSample(monitor.sample(0, 0), 0., 0, 0, benchmark);
+
+  while(nBuilt < nEvents)
+    {
+      // reception, as DQMDataCollector::DoReceive : waits if the building lags
+      if(builder.nextEvent(producer, event))
+	{
+	  pipeline.receive(producer, event);
+	  event.reset();
+	  nReceived++;
+	}
+
+      nBuilt = pipeline.getNBuilt();
+
+      if(reachPeriod(nBuilt, requestPeriodArg.getValue(), nextRequest))
+	benchmark.requestEvent(subEventIdentifier, eventSize);
+
+      if(reachPeriod(nBuilt, clientChurnArg.getValue(), nextClientChurn) && !clientIds.empty())
+	{
+	  benchmark.disconnectClient(clientIds.front());
+	  clientIds.pop_front();
+
+	  benchmark.connectClient(nextClientId, true, clientSubEvent(nextClientId));
+	  clientIds.push_back(nextClientId++);
+	}
+
+      // as DQMDataCollector::DoConnect and DoDisconnect
+      if(reachPeriod(nBuilt, producerChurnArg.getValue(), nextProducerChurn))
+	{
+	  if(disconnectedProducer >= 0)
+	    {
+	      if(builder.connectProducer(disconnectedProducer))
+		pipeline.connect(disconnectedProducer);
+
+	      disconnectedProducer = -1;
+	    }
+	  else if(nProducers > 1)
+	    {
+	      disconnectedProducer = (nBuilt / producerChurnArg.getValue()) % nProducers;
+
+	      if(builder.disconnectProducer(disconnectedProducer))
+		pipeline.disconnect(disconnectedProducer);
+	    }
+	}
+
+      // end of run : the collector stops and restarts, the clients register again
+      if(reachPeriod(nBuilt, runLengthArg.getValue(), nextRunEnd) && nBuilt < nEvents)
+	{
+	  // as DQMDataCollector::DoStopRun : the received events are built and sent
+	  // first, no event must reach a stopped collector
+	  pipeline.stop();
+	  stopFanOut(pFanOut);
+
+	  if(STATUS_CODE_SUCCESS != (statusCode = benchmark.stopCollector())
+	     || STATUS_CODE_SUCCESS != (statusCode = benchmark.startCollector(NULL)))
+	    {
+	      LOG4CXX_ERROR( dqmMainLogger , "Couldn't restart the collector : " << statusCode );
+	      benchmark.deleteCollector();
+	      delete pCommandLine;
+	      return 1;
+	    }
+
+	  for(std::deque<int>::iterator iter = clientIds.begin(), endIter = clientIds.end() ; endIter != iter ; ++iter)
+	    benchmark.connectClient(*iter, true, clientSubEvent(*iter));
+
+	  // as DQMDataCollector::DoStartRun
+	  builder.startRun();
+	  pFanOut = startFanOut("SOAK", sendQueueSizeArg.getValue());
+	  pipeline.start(receiveQueueSizeArg.getValue(), conversionQueueSizeArg.getValue(), true);
+	  nRuns++;
+	}
+
+      if(reachPeriod(nBuilt, samplePeriod, nextSample))
+	{
+	  const DQMLatencyRecorder::Clock::time_point now = DQMLatencyRecorder::Clock::now();
+	  const double elapsed = std::chrono::duration<double>(now - sampleTime).count();
+	  const size_t backlog = builder.getBuilder().getBacklog() + pipeline.getQueueSize();
+	  const size_t fanOutQueueSize = pFanOut->getQueueSize();
+
+	  printSample(monitor.sample(nBuilt, backlog + fanOutQueueSize), elapsed > 0. ? (nBuilt - nSampleBuilt) / elapsed : 0.,
+		      backlog, fanOutQueueSize, benchmark);
+
+	  sampleTime = now;
+	  nSampleBuilt = nBuilt;
+	}
+    }
+
+  pipeline.stop();
+  nBuilt = pipeline.getNBuilt();
+  stopFanOut(pFanOut);
+  benchmark.deleteCollector();
+
+  const float warmUp = std::min(std::max(warmUpArg.getValue(), 0.f), 0.9f);
+  const double residentDrift = monitor.getResidentSizeDrift(warmUp);
+  const double allocationDrift = monitor.getLiveAllocationDrift(warmUp);
+  const bool residentDriftOk = residentDrift <= maxResidentDriftArg.getValue();
+  const bool allocationDriftOk = allocationDrift <= maxAllocationDriftArg.getValue();
+
+  cout << endl << nRuns << " runs, " << nReceived << " received and " << nBuilt << " built events, "
+       << builder.getBuilder().getNDropped() << " dropped by the builder, "
+       << pipeline.getNConversionDropped() << " not converted" << endl;
+  cout << "RSS drift        : " << setprecision(4) << residentDrift << " bytes/evt (max " << maxResidentDriftArg.getValue() << ") "
+       << (residentDriftOk ? "ok" : "FAILED") << endl;
+  cout << "Allocation drift : " << setprecision(6) << allocationDrift << " allocs/evt (max " << maxAllocationDriftArg.getValue() << ") "
+       << (allocationDriftOk ? "ok" : "FAILED") << endl;
+  cout << "Max queue depth  : " << monitor.getMaxQueueDepth(warmUp) << " events after warm up" << endl;
+
+  delete pCommandLine;
+
+  return residentDriftOk && allocationDriftOk ? 0 : 1;
+}
@@ -3,6 +3,15 @@
 #include "eudaq/BufferSerializer.hh"
 #include "eudaq/Logger.hh"
 #include "eudaq/Utils.hh"
+#include "DQMAsyncLogger.h"
+#include "DQMBulkLCEventWriter.h"
+#include "DQMDataCollectorPipeline.h"
+#include "DQMEudaqConverter.h"
+#include "DQMEventBuilder.h"
+#include "DQMEventFanOut.h"
+#include "DQMThreadTopology.h"
+#include "dqm4hep/DQMPluginManager.h"
+#include "xdrstream/BufferDevice.h"
 #include <iostream>
 #include <ostream>
 #include <ctime>
@@ -12,6 +21,11 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <memory>
+#include <thread>
 
  namespace eudaq {
 
@@ -19,6 +33,8 @@
 
    public:
      DataCollector(const std::string &name, const std::string &runcontrol);
+     // the building, conversion and sender threads must be joined
+     ~DQMDataCollector() { StopPipeline(); StopFanOut(); }
 
      // Below, we should only mention the ones we actually need to override.
      // What do we need to override? We basically need to add features that 1) open/create the xdrlcio device, and 2) look at the incoming data and send it to the xdrlcio device
@@ -35,6 +51,8 @@
 
      //running in commandreceiver thread
      virtual void DoInitialise(){
+       // no data is received, built or converted before the (re)initialisation is done
+       StopPipeline();
        auto ini = GetInitConfiguration();
        std::ofstream ofile;
        std::string stream_target;
@@ -47,69 +65,283 @@
        ofile << stream_target;
        // We might do other stuff here; the output file is now open, the string that contains the stream target has now been written to it, and it's about to be closed.
        ofile.close();
+       m_stream_target = stream_target;
+
+       // sub event description -> converter plugin, i.e "Ex0Raw:Ex0RawConverter"
+       std::string converters = ini->Get("DQM_CONVERTERS", "");
+       m_detector_name = ini->Get("DQM_DETECTOR_NAME", "EUDAQ");
+       // rebuilt on each initialisation, the conversion thread is stopped
+       m_converters.clear();
+       if(!converters.empty()){
+	 if(dqm4hep::STATUS_CODE_SUCCESS != dqm4hep::DQMPluginManager::instance()->loadLibraries())
+	   EUDAQ_THROW("could not load the dqm4hep plugin libraries");
+	 if(dqm4hep::STATUS_CODE_SUCCESS != m_converters.configure(converters))
+	   EUDAQ_THROW("invalid DQM_CONVERTERS (" + converters + ")");
+       }
+
+       // data path thread placement, i.e DQM_THREAD_BUILDING_CPUS = 2-3 and
+       // DQM_THREAD_BUILDING_PRIORITY = 50 (SCHED_FIFO, 0 for normal scheduling)
+       const std::map<std::string, dqm4hep::DQMThreadTopology::Role> thread_roles = {
+	 {"RECEPTION", dqm4hep::DQMThreadTopology::RECEPTION},
+	 {"BUILDING", dqm4hep::DQMThreadTopology::BUILDING},
+	 {"CONVERSION", dqm4hep::DQMThreadTopology::CONVERSION},
+	 {"FANOUT", dqm4hep::DQMThreadTopology::FAN_OUT}};
+       for(auto &thread_role: thread_roles){
+	 std::string key = "DQM_THREAD_" + thread_role.first;
+	 std::string cpus = ini->Get(key + "_CPUS", "");
+	 int priority = ini->Get(key + "_PRIORITY", 0);
+	 if(dqm4hep::STATUS_CODE_SUCCESS != m_topology.setCpus(thread_role.second, cpus))
+	   EUDAQ_THROW("invalid " + key + "_CPUS (" + cpus + ")");
+	 if(dqm4hep::STATUS_CODE_SUCCESS != m_topology.setPriority(thread_role.second, priority))
+	   EUDAQ_THROW("invalid " + key + "_PRIORITY (" + std::to_string(priority) + ")");
+       }
+       m_topology_generation++;
+
+       // the pipeline runs from the start to the stop of each run
+       m_receive_queue_size = ini->Get("DQM_RECEIVE_QUEUE_SIZE", 1024);
+       m_conversion_queue_size = ini->Get("DQM_CONVERSION_QUEUE_SIZE", 64);
      };
 
-     virtual void DoConfigure(){};
+     virtual void DoConfigure(){
+       auto conf = GetConfiguration();
+       // 0 means unbounded: a lagging producer then grows its queue forever
+       m_builder.setMaxQueueDepth(conf->Get("DQM_MAX_QUEUE_DEPTH", 0));
+     };
      virtual void DoStartRun(){
-       xdrstream::BufferDevice *pOutDevice = new xdrstream::BufferDevice(1024*1024);
-       pOutDevice->setOwner(false);
+       // trigger numbers restart with the run: events left from the previous
+       // run would stay at the queue fronts, and in memory, forever.
+       // The pipeline was drained at the previous stop, none is left in its queues
+       StopPipeline();
+       StopFanOut();
+       m_builder.clear();
+       m_trigger_n_received = 0;
+       m_trigger_n_built = 0;
+       if(!m_converters.empty() && !m_stream_target.empty())
+	 StartFanOut();
+       StartPipeline();
      };
      virtual void DoStopRun(){
-       delete pOutDevice;
+       // the received events are built, written and converted in this run
+       StopPipeline();
+       StopFanOut();
+     };
+     virtual void DoTerminate(){
+       // terminating while running: the events of the run are still sent
+       StopPipeline();
+       StopFanOut();
      };
-     virtual void DoTerminate(){};
+
+     // running in commandreceiver thread, before the pipeline starts
+     void StartFanOut(){
+       auto conf = GetConfiguration();
+       // pre-sized for a typical event, grown by the device if needed
+       m_out_buffer_size = conf->Get("DQM_OUT_BUFFER_SIZE", 1024*1024);
+       unsigned int send_queue_size = conf->Get("DQM_SEND_QUEUE_SIZE", 16);
+       std::vector<std::string> collectors;
+       std::stringstream target_stream(m_stream_target);
+       std::string collector;
+       while(std::getline(target_stream, collector, ':'))
+	 if(!collector.empty())
+	   collectors.push_back(collector);
+
+       std::unique_lock<std::mutex> lk(m_mtx_conv);
+       m_fan_out = new dqm4hep::DQMEventFanOut(collectors, nullptr, dqm4hep::DQMEventFanOut::ROUND_ROBIN, send_queue_size);
+       // the data path never waits for a slow collector
+       m_fan_out->setDropWhenFull(true);
+       m_fan_out->setThreadTopology(&m_topology);
+       if(dqm4hep::STATUS_CODE_SUCCESS != m_fan_out->start()){
+	 // no collector name in the target: nothing would be streamed
+	 delete m_fan_out;
+	 m_fan_out = nullptr;
+	 EUDAQ_THROW("invalid STREAM_TARGET (" + m_stream_target + ")");
+       }
+     }
+
+     // running in commandreceiver thread, after the pipeline is stopped:
+     // the queued events are sent before the sender threads stop
+     void StopFanOut(){
+       std::unique_lock<std::mutex> lk(m_mtx_conv);
+       if(m_fan_out){
+	 m_fan_out->stop();
+	 m_fan_out->report();
+	 delete m_fan_out;
+	 m_fan_out = nullptr;
+       }
+       delete m_out_device;
+       m_out_device = nullptr;
+     }
 
      //running in dataserver thread
+     // the connection changes reach the builder through the building thread, in order
+     // with the events of the connection. While the pipeline is stopped, they are applied
+     // here, once the building thread has built the events queued before the stop
      virtual void DoConnect(ConnectionSPC id) {
-       std::unique_lock<std::mutex> lk(m_mtx_map);
-       m_conn_evque[idx].clear();
-       m_conn_inactive.erase(idx);
+       m_pipeline.connect(id);
      }
 
      virtual void DoDisconnect(ConnectionSPC id) {
-       std::unique_lock<std::mutex> lk(m_mtx_map);
-       m_conn_inactive.insert(idx);
+       m_pipeline.disconnect(id);
      }
 
+     // running in dataserver thread: counts and hands the events over to the building thread
      virtual void DoReceive(ConnectionSPC id, EventUP ev){
+       // the dataserver thread is created by eudaq: placed on its first event
+       thread_local uint32_t reception_generation = 0;
+       if(reception_generation != m_topology_generation){
+	 reception_generation = m_topology_generation;
+	 m_topology.apply(dqm4hep::DQMThreadTopology::RECEPTION);
+       }
  
-       std::unique_lock<std::mutex> lk(m_mtx_map);
        eudaq::EventSP evsp = std::move(ev);
        if(!evsp->IsFlagTrigger()){
 	 EUDAQ_THROW("!evsp->IsFlagTrigger()");
        }
-       m_conn_evque[idx].push_back(evsp);
 
-       // More stuff? Stuff below hasn't been renamed for this file, and also I don't know what it does
+       m_evt_received++;
+       if(evsp->GetTriggerN() > m_trigger_n_received)
+	 m_trigger_n_received = evsp->GetTriggerN();
+       // payload size is only available through block copies, so estimate it from a sample
+       if(0 == (m_evt_received % DQM_SIZE_SAMPLING)){
+	 uint64_t size = 0;
+	 for(auto &subev: evsp->GetSubEvents())
+	   for(auto &n: subev->GetBlockNumList())
+	     size += subev->GetBlock(n).size();
+	 for(auto &n: evsp->GetBlockNumList())
+	   size += evsp->GetBlock(n).size();
+	 m_sampled_evt_size = size;
+       }
+
+       // waits if the building lags: back pressure on the producers, as when building here.
+       // Dropped while the pipeline is stopped
+       m_pipeline.receive(id, evsp);
+     };
 
+     // building thread: writes the built events and gives them to the conversion
+     bool BuiltEvent(uint32_t trigger_n, const std::vector<eudaq::EventSPC> &subevs, eudaq::EventSPC &ev_conv){
        auto ev_sync = eudaq::Event::MakeUnique("Ex0Tg");
        ev_sync->SetFlagPacket();
        ev_sync->SetTriggerN(trigger_n);
-       for(auto &conn_evque: m_conn_evque){
-	 auto &ev_front = conn_evque.second.front(); 
-	 if(ev_front->GetTriggerN() == trigger_n){
-	   ev_sync->AddSubEvent(ev_front);
-	   conn_evque.second.pop_front();
-	 }
+       for(auto &subev: subevs)
+	 ev_sync->AddSubEvent(subev);
+       bool converting = m_pipeline.isConverting();
+       if(converting){
+	 // the writer owns the built event: the conversion gets its own, sharing the sub-events
+	 eudaq::EventSP ev = eudaq::Event::MakeShared("Ex0Tg");
+	 ev->SetFlagPacket();
+	 ev->SetTriggerN(trigger_n);
+	 for(auto &subev: subevs)
+	   ev->AddSubEvent(subev);
+	 ev_conv = ev;
        }
-  
-       if(!m_conn_inactive.empty()){
-	 std::set<eudaq::ConnectionSPC> conn_inactive_empty;
-	 for(auto &conn: m_conn_inactive){
-	   if(m_conn_evque.find(conn) != m_conn_evque.end() && 
-	      m_conn_evque[conn].empty()){
-	     m_conn_evque.erase(conn);
-	     conn_inactive_empty.insert(conn);	
-	   }
-	 }
-	 for(auto &conn: conn_inactive_empty){
-	   m_conn_inactive.erase(conn);
-	 }
-       }
-       ev_sync->Print(std::cout);
+       m_trigger_n_built = trigger_n;
+       // printing every built event caps the rate, keep it to a sampled async debug record
+       DQM_ASYNC_LOG_EVERY_N(dqm4hep::dqmMainLogger, log4cxx::Level::getDebug(), 100,
+			     "Built Ex0Tg event {} with {} sub-event(s)", trigger_n, ev_sync->GetNumSubEvent());
        WriteEvent(std::move(ev_sync));
+       return converting;
+     }
+
+     // running in commandreceiver thread, the threads place themselves
+     void StartPipeline(){
+       m_pipeline.setThreadTopology(&m_topology);
+       m_pipeline.start(m_receive_queue_size, m_conversion_queue_size, !m_converters.empty() && !m_stream_target.empty());
+     }
+
+     // running in commandreceiver thread: the queued events are built and converted first.
+     // The received events are then dropped until the next start
+     void StopPipeline(){
+       m_pipeline.stop();
+     }
+
+     // running in commandreceiver thread, once per status cycle.
+     // Counters are plain atomics bumped on the data path, only the
+     // queue walk takes the builder lock (one entry per connection).
+     virtual void DoStatus(){
+       auto now = std::chrono::steady_clock::now();
+       uint64_t received = m_evt_received;
+       uint64_t built = m_pipeline.getNBuilt();
+       double elapsed = std::chrono::duration<double>(now - m_status_time).count();
+       double evt_rate = 0., build_rate = 0.;
+       if(elapsed > 0.){
+	 evt_rate = (received - m_status_evt_received) / elapsed;
+	 build_rate = (built - m_status_evt_built) / elapsed;
+       }
+       m_status_time = now;
+       m_status_evt_received = received;
+       m_status_evt_built = built;
+
+       size_t backlog = 0;
+       std::vector<std::pair<eudaq::ConnectionSPC, size_t>> queue_sizes;
+       std::set<std::string> queue_tags;
+       m_builder.getQueueSizes(queue_sizes);
+       for(auto &queue_size: queue_sizes){
+	 backlog += queue_size.second;
+	 std::string tag = "DQM_QUEUE_" + queue_size.first->GetName();
+	 SetStatusTag(tag, std::to_string(queue_size.second));
+	 queue_tags.insert(tag);
+       }
+       // eudaq can not remove a status tag: the removed connections report an empty queue
+       for(auto &tag: m_status_queue_tags)
+	 if(queue_tags.find(tag) == queue_tags.end())
+	   SetStatusTag(tag, "0");
+       m_status_queue_tags.swap(queue_tags);
+
+       uint32_t trigger_n_received = m_trigger_n_received;
+       uint32_t trigger_n_built = m_trigger_n_built;
+       uint32_t lag = trigger_n_received > trigger_n_built ? trigger_n_received - trigger_n_built : 0;
+
+       SetStatusTag("DQM_EVENT_RATE", std::to_string(evt_rate));
+       SetStatusTag("DQM_BUILD_RATE", std::to_string(build_rate));
+       SetStatusTag("DQM_MB_RATE", std::to_string(evt_rate * m_sampled_evt_size / (1024.*1024.)));
+       SetStatusTag("DQM_BUILD_BACKLOG", std::to_string(backlog));
+       SetStatusTag("DQM_DROPPED", std::to_string(m_builder.getNDropped()));
+       SetStatusTag("DQM_LAG_EVENTS", std::to_string(lag));
+
+       uint64_t converted = m_evt_converted;
+       uint64_t conversion_time_ns = m_conversion_time_ns;
+       double conversion_time_us = 0.;
+       if(converted > m_status_evt_converted)
+	 conversion_time_us = (conversion_time_ns - m_status_conversion_time_ns) / 1000. / (converted - m_status_evt_converted);
+       m_status_evt_converted = converted;
+       m_status_conversion_time_ns = conversion_time_ns;
+       SetStatusTag("DQM_CONVERSION_TIME_US", std::to_string(conversion_time_us));
+       SetStatusTag("DQM_CONVERSION_FAILED", std::to_string(m_evt_conversion_failed));
+       SetStatusTag("DQM_UNCONVERTED", std::to_string(m_subevt_unconverted));
+       SetStatusTag("DQM_CONVERSION_DROPPED", std::to_string(m_pipeline.getNConversionDropped()));
      };
 
+     // running in conversion thread. Converts a built event to lcio, straight
+     // into the xdr output buffer, and queues it for the stream target collector(s)
+     void ConvertEvent(const eudaq::Event &ev_sync){
+       std::unique_lock<std::mutex> lk(m_mtx_conv);
+       if(!m_fan_out)
+	 return;
+       // first touched by the conversion thread: allocated on its numa node
+       if(!m_out_device)
+	 m_out_device = new xdrstream::BufferDevice(m_out_buffer_size);
+       auto start = std::chrono::steady_clock::now();
+       auto subevs = ev_sync.GetSubEvents();
+       uint64_t timestamp = subevs.empty() ? ev_sync.GetTimestampBegin() : subevs.front()->GetTimestampBegin();
+       m_lcio_writer.beginEvent(GetRunNumber(), ev_sync.GetTriggerN(), timestamp, m_detector_name);
+       unsigned int unconverted = 0;
+       dqm4hep::StatusCode status = m_converters.convert(ev_sync, m_lcio_writer, unconverted);
+       m_subevt_unconverted += unconverted;
+       if(dqm4hep::STATUS_CODE_SUCCESS == status && 0 != m_lcio_writer.getNCollections()){
+	 m_out_device->reset();
+	 status = m_lcio_writer.endEvent(m_out_device);
+	 if(dqm4hep::STATUS_CODE_SUCCESS == status)
+	   status = m_fan_out->sendBuffer(m_out_device->getBuffer(), m_out_device->getPosition(), ev_sync.GetTriggerN());
+       }
+       if(dqm4hep::STATUS_CODE_SUCCESS != status){
+	 m_evt_conversion_failed++;
+	 DQM_ASYNC_LOG_RATE_LIMITED(dqm4hep::dqmMainLogger, log4cxx::Level::getWarn(), 1,
+				    "Conversion of event {} failed ({})", ev_sync.GetTriggerN(), static_cast<int>(status));
+	 return;
+       }
+       m_conversion_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+       m_evt_converted++;
+     }
+
      void WriteEvent(EventUP ev);
      void SetServerAddress(const std::string &addr){m_data_addr = addr;};
      void StartDataCollector();
@@ -132,6 +364,45 @@
      uint32_t m_dct_n;
      uint32_t m_evt_c;
      std::unique_ptr<const Configuration> m_conf;
+
+     dqm4hep::DQMThreadTopology m_topology;
+     std::atomic<uint32_t> m_topology_generation{0};
+     size_t m_receive_queue_size = 1024;
+     size_t m_conversion_queue_size = 64;
+
+     // per connection queues, built by trigger number
+     dqm4hep::DQMEventBuilder<eudaq::ConnectionSPC, eudaq::EventSPC> m_builder;
+     // data path threads: dataserver (reception) -> building -> conversion -> fan-out senders
+     dqm4hep::DQMDataCollectorPipeline<eudaq::ConnectionSPC, eudaq::EventSPC, eudaq::EventSPC> m_pipeline{m_builder,
+	 [this](uint32_t trigger_n, const std::vector<eudaq::EventSPC> &subevs, eudaq::EventSPC &ev_conv){ return BuiltEvent(trigger_n, subevs, ev_conv); },
+	 [this](const eudaq::EventSPC &ev_conv){ ConvertEvent(*ev_conv); }};
+
+     // pipeline health, written on the data path and sampled by DoStatus
+     static const uint64_t DQM_SIZE_SAMPLING = 64;
+     std::atomic<uint64_t> m_evt_received{0};
+     std::atomic<uint64_t> m_sampled_evt_size{0};
+     std::atomic<uint32_t> m_trigger_n_received{0};
+     std::atomic<uint32_t> m_trigger_n_built{0};
+     std::chrono::steady_clock::time_point m_status_time = std::chrono::steady_clock::now();
+     uint64_t m_status_evt_received = 0;
+     uint64_t m_status_evt_built = 0;
+     std::set<std::string> m_status_queue_tags;
+
+     // eudaq -> lcio conversion and sending, guarded by m_mtx_conv (run start/stop vs data path)
+     std::mutex m_mtx_conv;
+     std::string m_stream_target;
+     std::string m_detector_name;
+     dqm4hep::DQMEudaqConverterRegistry m_converters;
+     dqm4hep::DQMBulkLCEventWriter m_lcio_writer;
+     xdrstream::BufferDevice *m_out_device = nullptr;
+     size_t m_out_buffer_size = 1024*1024;
+     dqm4hep::DQMEventFanOut *m_fan_out = nullptr;
+     std::atomic<uint64_t> m_evt_converted{0};
+     std::atomic<uint64_t> m_evt_conversion_failed{0};
+     std::atomic<uint64_t> m_subevt_unconverted{0};
+     std::atomic<uint64_t> m_conversion_time_ns{0};
+     uint64_t m_status_evt_converted = 0;
+     uint64_t m_status_conversion_time_ns = 0;
    };
 
  }
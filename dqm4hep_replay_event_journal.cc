@@ -0,0 +1,176 @@
+// -- std headers
+#include <iostream>
+#include <chrono>
+
+// -- dqm4hep
+#include "dqm4hep/DQM4HEP.h"
+#include "dqm4hep/DQMLogging.h"
+
+#include "DQMEventJournal.h"
+
+// -- tclap headers
+#include "tclap/CmdLine.h"
+#include "tclap/Arg.h"
+
+// -- dim headers
+#include "dic.hxx"
+
+using namespace std;
+using namespace dqm4hep;
+
+int main(int argc, char* argv[])
+{
+  DQM4HEP::screenSplash();
+
+  std::string cmdLineFooter = "Please report bug to <rete@ipnl.in2p3.fr>";
+  TCLAP::CmdLine *pCommandLine = new TCLAP::CmdLine(cmdLineFooter, ' ', DQM4HEP_VERSION_STR);
+  std::string log4cxx_file = std::string(DQMCore_DIR) + "/conf/defaultLoggerConfig.xml";
+
+  TCLAP::ValueArg<std::string> journalArg(
+					  "j"
+					  , "journal"
+					  , "The journal directory or the list of journal segment files (separated by a ':' character)"
+					  , true
+					  , ""
+					  , "string");
+  pCommandLine->add(journalArg);
+
+  TCLAP::ValueArg<std::string> eventCollectorNameArg(
+						     "c"
+						     , "collector-name"
+						     , "The event collector name in which the events will be replayed"
+						     , true
+						     , ""
+						     , "string");
+  pCommandLine->add(eventCollectorNameArg);
+
+  TCLAP::ValueArg<unsigned int> firstEntryArg(
+					      "f"
+					      , "first-entry"
+					      , "The first journal entry to replay"
+					      , false
+					      , 0
+					      , "unsigned int");
+  pCommandLine->add(firstEntryArg);
+
+  TCLAP::ValueArg<unsigned int> nEntriesArg(
+					    "n"
+					    , "n-entries"
+					    , "The number of journal entries to replay (0 : up to the end)"
+					    , false
+					    , 0
+					    , "unsigned int");
+  pCommandLine->add(nEntriesArg);
+
+  TCLAP::ValueArg<float> speedFactorArg(
+					"s"
+					, "speed-factor"
+					, "The replay speed relative to the recording (1 : original timing, 0 : max speed)"
+					, false
+					, 1.f
+					, "float");
+  pCommandLine->add(speedFactorArg);
+
+  TCLAP::ValueArg<std::string> loggerConfigArg(
+					       "l"
+					       , "logger-config"
+					       , "The xml logger file to configure log4cxx"
+					       , false
+					       , log4cxx_file
+					       , "string");
+  pCommandLine->add(loggerConfigArg);
+
+  std::vector<std::string> allowedLevels;
+  allowedLevels.push_back("INFO");
+  allowedLevels.push_back("WARN");
+  allowedLevels.push_back("DEBUG");
+  allowedLevels.push_back("TRACE");
+  allowedLevels.push_back("ERROR");
+  allowedLevels.push_back("FATAL");
+  allowedLevels.push_back("OFF");
+  allowedLevels.push_back("ALL");
+  TCLAP::ValuesConstraint<std::string> allowedLevelsContraint( allowedLevels );
+
+  TCLAP::ValueArg<std::string> verbosityArg(
+					    "v"
+					    , "verbosity"
+					    , "The verbosity level used for this application"
+					    , false
+					    , "INFO"
+					    , &allowedLevelsContraint);
+  pCommandLine->add(verbosityArg);
+
+  // parse command line
+  pCommandLine->parse(argc, argv);
+
+  log4cxx_file = loggerConfigArg.getValue();
+  log4cxx::xml::DOMConfigurator::configure(log4cxx_file);
+
+  if( verbosityArg.isSet() )
+    dqmMainLogger->setLevel( log4cxx::Level::toLevel( verbosityArg.getValue() ) );
+
+  DQMEventJournalReader *pJournalReader = new DQMEventJournalReader();
+  std::vector<std::string> journalFiles;
+  DQM4HEP::tokenize(journalArg.getValue(), journalFiles, ":");
+
+  for(auto &journalFile : journalFiles)
+    {
+      // a directory or a single segment
+      StatusCode statusCode = pJournalReader->openDirectory(journalFile);
+
+      if(STATUS_CODE_SUCCESS != statusCode)
+	statusCode = pJournalReader->open(journalFile);
+
+      if(STATUS_CODE_SUCCESS != statusCode)
+	{
+	  LOG4CXX_ERROR( dqmMainLogger , "Couldn't open journal " << journalFile );
+	  delete pJournalReader;
+	  delete pCommandLine;
+	  return 1;
+	}
+    }
+
+  const size_t nEntries = pJournalReader->getNEntries();
+  const size_t firstEntry = firstEntryArg.getValue();
+  size_t lastEntry = nEntries ? nEntries-1 : 0;
+
+  if( nEntriesArg.getValue() && firstEntry + nEntriesArg.getValue() - 1 < lastEntry )
+    lastEntry = firstEntry + nEntriesArg.getValue() - 1;
+
+  LOG4CXX_INFO( dqmMainLogger , "Replaying entries [" << firstEntry << ", " << lastEntry << "] out of " << nEntries
+		<< " at speed factor " << speedFactorArg.getValue() );
+
+  const std::string commandName("DQM4HEP/EventCollector/" + eventCollectorNameArg.getValue() + "/COLLECT_RAW_EVENT");
+  size_t nReplayed = 0;
+  uint64_t nBytes = 0;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  // blocking send : the collector sets the pace at max speed
+  StatusCode statusCode = pJournalReader->replay(firstEntry, lastEntry, speedFactorArg.getValue(),
+						 [&](const DQMEventJournalReader::Entry &entry)
+						 {
+						   if( ! DimClient::sendCommand(commandName.c_str(), (void *) entry.m_pBuffer, entry.m_size) )
+						     {
+						       LOG4CXX_ERROR( dqmMainLogger , "Couldn't send event " << entry.m_eventNumber << " to " << commandName );
+						       return false;
+						     }
+
+						   nReplayed++;
+						   nBytes += entry.m_size;
+						   return true;
+						 });
+
+  if(STATUS_CODE_SUCCESS != statusCode)
+    LOG4CXX_ERROR( dqmMainLogger , "Couldn't replay journal : " << statusCode );
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  LOG4CXX_INFO( dqmMainLogger , "Replayed " << nReplayed << " events in " << elapsed << " s ("
+		<< (elapsed > 0. ? nReplayed / elapsed : 0.) << " evt/s, "
+		<< (elapsed > 0. ? nBytes / elapsed / (1024.*1024.) : 0.) << " MB/s)" );
+
+  delete pJournalReader;
+  delete pCommandLine;
+
+  return STATUS_CODE_SUCCESS == statusCode ? 0 : 1;
+}
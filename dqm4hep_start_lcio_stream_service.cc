@@ -1,21 +1,19 @@
 
 // -- std headers
 #include <iostream>
+#include <vector>
 #include <ctime>
 
 // -- lcio headers
 #include "EVENT/LCIO.h"
-#include "IO/LCReader.h"
-#include "IOIMPL/LCFactory.h"
 
 // -- dqm4hep
 #include "dqm4hep/DQM4HEP.h"
 #include "dqm4hep/DQMLogging.h"
 #include "dqm4hep/DQMPluginManager.h"
-#include "dqm4hep/DQMDimEventClient.h"
 
 // -- dqm4ilc headers
-#include "dqm4ilc/DQMLcioReaderListener.h"
+#include "dqm4ilc/DQMLCEvent.h"
 #include "dqm4ilc/DQMLCEventStreamer.h"
 
 // -- tclap headers
@@ -31,6 +29,11 @@
 // -- xdrlcio headers
 #include "xdrlcio/XdrLcio.h"
 
+#include "DQMXdrEventSource.h"
+#include "DQMLcioStreamPipeline.h"
+#include "DQMEventPacer.h"
+#include "DQMEventFanOut.h"
+
 // -- lcio headers
 #include "IMPL/CalorimeterHitImpl.h"
 #include "IMPL/LCCollectionVec.h"
@@ -64,7 +67,7 @@ int main(int argc, char* argv[])
   TCLAP::ValueArg<unsigned int> sleepTimeArg(
 					     "t"
 					     , "sleep-time"
-					     , "The sleep time between each event (unit msec)"
+					     , "The sleep time between each event (unit msec). Sets the target rate if not given"
 					     , false
 					     , 1000
 					     , "unsigned int");
@@ -79,29 +82,55 @@ int main(int argc, char* argv[])
 					       , "unsigned int");
   pCommandLine->add(skipNEventsArg);
 
-  // Section for lcio filenames commented out -- will be replaced with commandline argument parsing for event stream
-  // Should probably hardcode this to begin with, then worry about parsing later
-
-  /*
-    TCLAP::ValueArg<std::string> lcioFileNamesArg(
-    "f"
-    , "lcio-files"
-    , "The list of lcio files to process (separated by a ':' character)"
-    , true
-    , ""
-    , "string");
-    pCommandLine->add(lcioFileNamesArg);
-  */
+  TCLAP::ValueArg<std::string> lcioFileNamesArg(
+						"f"
+						, "lcio-files"
+						, "The list of xdr lcio files to process (separated by a ':' character). The files are memory mapped. Without files, length framed records (32 bits big endian size, then the xdr lcio record) are read from the standard input one at a time, as they arrive"
+						, false
+						, ""
+						, "string");
+  pCommandLine->add(lcioFileNamesArg);
 
   TCLAP::ValueArg<std::string> eventCollectorNameArg(
 						     "c"
 						     , "collector-name"
-						     , "The event collector name in which the event will be published"
+						     , "The event collector name(s) in which the events will be published (separated by a ':' character)"
 						     , true
 						     , ""
 						     , "string");
   pCommandLine->add(eventCollectorNameArg);
 
+  std::vector<std::string> allowedFanOutPolicies;
+  allowedFanOutPolicies.push_back("round-robin");
+  allowedFanOutPolicies.push_back("event-number");
+  allowedFanOutPolicies.push_back("duplicate");
+  TCLAP::ValuesConstraint<std::string> allowedFanOutPoliciesContraint( allowedFanOutPolicies );
+
+  TCLAP::ValueArg<std::string> fanOutPolicyArg(
+					       "o"
+					       , "fan-out-policy"
+					       , "How events are distributed over several collectors"
+					       , false
+					       , "round-robin"
+					       , &allowedFanOutPoliciesContraint);
+  pCommandLine->add(fanOutPolicyArg);
+
+  TCLAP::ValueArg<unsigned int> sendQueueSizeArg(
+						 "q"
+						 , "send-queue-size"
+						 , "The maximum number of events waiting to be sent to each collector"
+						 , false
+						 , 16
+						 , "unsigned int");
+  pCommandLine->add(sendQueueSizeArg);
+
+  TCLAP::SwitchArg waitWhenFullArg(
+				   "w"
+				   , "wait-when-full"
+				   , "Whether to wait for a collector with a full send queue instead of dropping its events. Waiting delays all the collectors"
+				   , false);
+  pCommandLine->add(waitWhenFullArg);
+
   TCLAP::ValueArg<std::string> loggerConfigArg(
 					       "l"
 					       , "logger-config"
@@ -131,13 +160,64 @@ int main(int argc, char* argv[])
 					    , &allowedLevelsContraint);
   pCommandLine->add(verbosityArg);
 
+  TCLAP::ValueArg<unsigned int> pipelineSlotsArg(
+						"p"
+						, "pipeline-slots"
+						, "The maximum number of events in flight between the read, decode and publish stages"
+						, false
+						, 8
+						, "unsigned int");
+  pCommandLine->add(pipelineSlotsArg);
+
   TCLAP::SwitchArg simulateSpillArg(
 				    "s"
 				    , "simulate-spill"
-				    , "Whether a spill structure has to be simulated using getTimeStamp() of LCEvents"
+				    , "Whether a spill structure has to be simulated using getTimeStamp() of LCEvents (same as --pacing-mode original)"
 				    , false);
   pCommandLine->add(simulateSpillArg);
 
+  std::vector<std::string> allowedPacingModes;
+  allowedPacingModes.push_back("rate");
+  allowedPacingModes.push_back("original");
+  allowedPacingModes.push_back("max");
+  TCLAP::ValuesConstraint<std::string> allowedPacingModesContraint( allowedPacingModes );
+
+  TCLAP::ValueArg<std::string> pacingModeArg(
+					     "m"
+					     , "pacing-mode"
+					     , "How events are paced : constant target rate, original timing from getTimeStamp() of LCEvents or max rate"
+					     , false
+					     , "rate"
+					     , &allowedPacingModesContraint);
+  pCommandLine->add(pacingModeArg);
+
+  TCLAP::ValueArg<float> targetRateArg(
+				       "r"
+				       , "target-rate"
+				       , "The target event rate in rate pacing mode (unit Hz)"
+				       , false
+				       , 1.f
+				       , "float");
+  pCommandLine->add(targetRateArg);
+
+  TCLAP::ValueArg<float> speedFactorArg(
+					"x"
+					, "speed-factor"
+					, "The replay speed factor in original pacing mode (2 : twice faster)"
+					, false
+					, 1.f
+					, "float");
+  pCommandLine->add(speedFactorArg);
+
+  TCLAP::ValueArg<unsigned int> maxLagArg(
+					  "g"
+					  , "max-lag"
+					  , "The maximum lag caught up after a stall, the schedule restarts from the current time above (unit msec, 0 : always catch up)"
+					  , false
+					  , 1000
+					  , "unsigned int");
+  pCommandLine->add(maxLagArg);
+
   // parse command line
   pCommandLine->parse(argc, argv);
 
@@ -148,75 +228,129 @@ int main(int argc, char* argv[])
     dqmMainLogger->setLevel( log4cxx::Level::toLevel( verbosityArg.getValue() ) );
 
   // Arranging input files
-  /*std::vector<std::string> lcioInputFiles;
-    DQM4HEP::tokenize(lcioFileNamesArg.getValue(), lcioInputFiles, ":");*/
+  std::vector<std::string> lcioInputFiles;
+  DQM4HEP::tokenize(lcioFileNamesArg.getValue(), lcioInputFiles, ":");
+
+  DQMXdrEventSource *pEventSource = NULL;
+
+  if( ! lcioInputFiles.empty() )
+    {
+      DQMXdrFileEventSource *pFileEventSource = new DQMXdrFileEventSource(lcioInputFiles);
+      pEventSource = pFileEventSource;
+
+      if( STATUS_CODE_SUCCESS != pFileEventSource->open()
+	  || ( skipNEventsArg.getValue() && STATUS_CODE_SUCCESS != pFileEventSource->skipNEvents( skipNEventsArg.getValue() ) ) )
+	{
+	  LOG4CXX_ERROR( dqmMainLogger , "Couldn't open input files or skip " << skipNEventsArg.getValue() << " events" );
+	  delete pEventSource;
+	  delete pCommandLine;
+	  return 1;
+	}
+    }
+  else
+    {
+      // records are read one at a time, as the producer writes them
+      pEventSource = new DQMXdrStreamEventSource(std::cin);
+    }
 
-  // New XDRLCIO stuff
-  xdrlcio::XdrLcio *pXdrLcio = new xdrlcio::XdrLcio();
-  xdrstream::BufferDevice *pInDevice = new xdrstream::BufferDevice(pOutDevice->getBuffer() , pOutDevice->getPosition(), false);
-  pInDevice->setOwner(false);
-  // ==    ==    == //
+  // events are serialized once and sent to the collectors by the fan out
+  std::vector<std::string> collectorNames;
+  DQM4HEP::tokenize(eventCollectorNameArg.getValue(), collectorNames, ":");
 
-  // file reader
-  IO::LCReader *pLCReader = IOIMPL::LCFactory::getInstance()->createLCReader(0);
+  DQMEventFanOut::Policy fanOutPolicy = DQMEventFanOut::ROUND_ROBIN;
 
-  // event collector client
-  DQMEventClient *pEventClient = new DQMDimEventClient();
+  if( "event-number" == fanOutPolicyArg.getValue() )
+    fanOutPolicy = DQMEventFanOut::EVENT_NUMBER_HASH;
+  else if( "duplicate" == fanOutPolicyArg.getValue() )
+    fanOutPolicy = DQMEventFanOut::DUPLICATE;
 
   DQMLCEventStreamer *pEventStreamer = new DQMLCEventStreamer();
-  pEventClient->setEventStreamer(pEventStreamer);
+  DQMEventFanOut *pFanOut = new DQMEventFanOut(collectorNames, pEventStreamer, fanOutPolicy, sendQueueSizeArg.getValue());
+  pFanOut->setDropWhenFull(!waitWhenFullArg.getValue());
 
-  pEventClient->setCollectorName(eventCollectorNameArg.getValue());
+  // wrapper reused for each event, the lcio event is not owned
+  DQMEvent *pDQMEvent = new DQMLCEvent();
 
-  // lcio file listener
-  DQMLcioReaderListener *pListener = new DQMLcioReaderListener(pLCReader);
-  pListener->setSimulateSpill(simulateSpillArg.getValue());
-  pListener->setEventClient(pEventClient);
-  pListener->setSleepTime(sleepTimeArg.getValue());
+  DQMEventPacer::Mode pacingMode = DQMEventPacer::CONSTANT_RATE;
+  float targetRate = targetRateArg.getValue();
 
-  while(1)
+  if( simulateSpillArg.getValue() || "original" == pacingModeArg.getValue() )
+    pacingMode = DQMEventPacer::ORIGINAL_TIMING;
+  else if( "max" == pacingModeArg.getValue() )
+    pacingMode = DQMEventPacer::MAX_RATE;
+  else if( ! targetRateArg.isSet() )
     {
-      try
-	{
+      // backward compatibility with the sleep time between events
+      if( 0 == sleepTimeArg.getValue() )
+	pacingMode = DQMEventPacer::MAX_RATE;
+      else
+	targetRate = 1000.f / sleepTimeArg.getValue();
+    }
 
-	  // This is the actual meat; here is where we will pull events from the in-stream. We have to figure out how to send this event we're read in to the event collector service.
+  DQMEventPacer *pPacer = new DQMEventPacer(pacingMode);
+  pPacer->setMaxLag(maxLagArg.getValue());
 
-	  // New XDRLCIO stuff
-	  CH_TEST_RETURN( pXdrLcio->readNextEvent( pInDevice ) );
-	  EVENT::LCEvent *pReadLCEvent = pXdrLcio->getLCEvent();
-	  pXdrLcio->readStream();
-	  // ==    ==    == //
+  if( STATUS_CODE_SUCCESS != pPacer->setTargetRate(targetRate)
+      || STATUS_CODE_SUCCESS != pPacer->setSpeedFactor(speedFactorArg.getValue()) )
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "Invalid target rate or speed factor" );
+      delete pPacer;
+      delete pDQMEvent;
+      delete pFanOut;
+      delete pEventStreamer;
+      delete pEventSource;
+      delete pCommandLine;
+      return 1;
+    }
 
-	  // Old static file stuff: 
-	  /*pLCReader->open(lcioInputFiles);
+  // read, decode and publish stages run in parallel, the fan out sends the events
+  DQMLcioStreamPipeline *pPipeline = new DQMLcioStreamPipeline(pEventSource,
+							      [pFanOut, pPacer, pDQMEvent](EVENT::LCEvent *pLCEvent)
+							      {
+								pPacer->pace(pLCEvent->getTimeStamp());
+								pDQMEvent->setEvent<EVENT::LCEvent>(pLCEvent, false);
+								THROW_RESULT_IF(STATUS_CODE_SUCCESS, !=, pFanOut->sendEvent(pDQMEvent, pLCEvent->getEventNumber()));
+							      },
+							      pipelineSlotsArg.getValue());
 
-	    if( skipNEventsArg.getValue() )
-	    pLCReader->skipNEvents( skipNEventsArg.getValue() );
+  int exitCode = 0;
 
-	    pLCReader->readStream();
-	    pLCReader->close();
-	  */
+  try
+    {
+      THROW_RESULT_IF(STATUS_CODE_SUCCESS, !=, pFanOut->start());
+      StatusCode statusCode = pPipeline->run();
 
-	}
-      catch(StatusCodeException &exception)
+      if(STATUS_CODE_SUCCESS != statusCode)
 	{
-	  LOG4CXX_ERROR( dqmMainLogger , "StatusCodeException caught while reading stream : " << exception.toString() );
-	  break;
-	}
-      catch(std::exception & exception)
-	{
-	  LOG4CXX_ERROR( dqmMainLogger , "std::exception caught while reading stream : " << exception.what() );
-	  break;
+	  LOG4CXX_ERROR( dqmMainLogger , "Stream pipeline stopped with status : " << statusCode );
+	  exitCode = 1;
 	}
+    }
+  catch(StatusCodeException &exception)
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "StatusCodeException caught while reading stream : " << exception.toString() );
+      exitCode = 1;
+    }
+  catch(std::exception & exception)
+    {
+      LOG4CXX_ERROR( dqmMainLogger , "std::exception caught while reading stream : " << exception.what() );
+      exitCode = 1;
+    }
 
-      LOG4CXX_INFO( dqmMainLogger , "Exiting lcio file service ..." );
+  LOG4CXX_INFO( dqmMainLogger , "Exiting lcio file service (" << pPipeline->getNPublishedEvents() << " events published) ..." );
 
-    }
+  // send what is still queued
+  pFanOut->stop();
+  pPacer->report();
+  pFanOut->report();
 
-  delete pEventClient;
-  delete pListener;
-  delete pLCReader;
+  delete pPipeline;
+  delete pPacer;
+  delete pDQMEvent;
+  delete pFanOut;
+  delete pEventStreamer;
+  delete pEventSource;
   delete pCommandLine;
 
-  return 0;
+  return exitCode;
 }